@@ -197,7 +197,9 @@ struct config {
 		bool rtcp_enable;       /**< RTCP is enabled                */
 		bool rtcp_mux;          /**< RTP/RTCP multiplexing          */
 		struct range jbuf_del;  /**< Delay, number of frames        */
+		enum jbuf_type jbtype;  /**< Fixed or adaptive jitter buf.  */
 		uint32_t rtp_timeout;   /**< RTP Timeout in seconds (0=off) */
+		bool rtp_rxpull;        /**< Decode RTP on playout clock    */
 	} avt;
 
 	/* Audio recording */
@@ -351,7 +353,20 @@ int auplay_alloc(struct auplay_st **stp, const char *name,
 /*
  * Audio recorder
  */
-int recorder_start(const char* const filename, unsigned int rec_channels);
+enum recorder_format {
+	RECORDER_FMT_PCM16 = 0,	/**< 16-bit linear PCM WAV          */
+	RECORDER_FMT_PCMU,	/**< G.711 u-law WAV, 8 bits/sample */
+	RECORDER_FMT_PCMA,	/**< G.711 A-law WAV, 8 bits/sample */
+	RECORDER_FMT_IMA_ADPCM	/**< IMA ADPCM WAV, 4 bits/sample   */
+};
+
+int recorder_start(const char* const filename, unsigned int rec_channels,
+		   enum recorder_format rec_format);
+
+/*
+ * Software volume
+ */
+int softvol_level_get(bool tx, unsigned int *peak, unsigned int *rms);
 
 /*
  * Audio Filter
@@ -379,6 +394,7 @@ struct aufilt_prm {
 
 typedef int (aufilt_encupd_h)(struct aufilt_enc_st **stp, void **ctx,
 			      const struct aufilt *af, struct aufilt_prm *prm);
+/* An encode filter with a VAD returns ENODATA for a frame without speech */
 typedef int (aufilt_encode_h)(struct aufilt_enc_st *st,
 			      int16_t *sampv, size_t *sampc);
 
@@ -1,12 +1,19 @@
 /** \file
 	\brief Audio recorder
+
+	Audio filter feeds TX and RX samples into two lock-free ring buffers.
+	A writer thread is woken by the filter once enough audio is queued,
+	mixes or interleaves both directions, encodes them and writes the
+	file in large blocks, so that disk access (potentially blocking for
+	a long time in case of slow or networked media) never stalls audio.
 */
 
 #include <re.h>
 #include <rem.h>
 #include <baresip.h>
-#include <stdio.h>
-#include <assert.h>
+#include <pthread.h>
+#include <string.h>
+#include <time.h>
 #include "recorder.h"
 #include "wavfile.h"
 
@@ -14,19 +21,29 @@
 #define DEBUG_LEVEL 5
 #include <re_dbg.h>
 
-static DWORD WINAPI ThreadRecWrite(LPVOID data);
+enum {
+	REC_CHUNK_MS = 100,	/* writer is woken when this much audio is queued */
+	REC_WAIT_MS = 500,	/* writer wakes at least this often */
+	REC_QUEUE_MS = 5000,	/* capacity of each direction */
+	REC_SYNC_MS = 10000,	/* file data is committed to disk this often */
+	REC_SKEW_FRAMES = 2,	/* direction difference ignored as jitter */
+	REC_BUF_SAMPLES = 4096
+};
 
 static struct lock* rec_lock = NULL;
-static bool filename_set = false;
+static volatile bool filename_set = false;
 static char filename[512];
 static unsigned int channels = 1;
+static enum recorder_format format = RECORDER_FMT_PCM16;
 
-int recorder_start(const char* const file, unsigned int rec_channels) {
+int recorder_start(const char* const file, unsigned int rec_channels,
+	enum recorder_format rec_format) {
 	if (rec_lock == NULL)
 		return -1;
 	lock_write_get(rec_lock);
 	filename_set = false;
 	channels = rec_channels;
+	format = rec_format;
 	strncpy(filename, file, sizeof(filename));
 	filename[sizeof(filename)-1] = '\0';
 	filename_set = true;
@@ -35,13 +52,19 @@ int recorder_start(const char* const file, unsigned int rec_channels) {
 }
 
 struct recorder_st {
-	bool active;
-	bool terminated;
-	FILE *pFile;
-	HANDLE thread;
+	bool run;
+	bool thread_started;
+	volatile bool recording;
+	struct wavfile *wf;
+	unsigned int channels;
+	pthread_t thread;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
 
 	unsigned frame_size;
 	unsigned int srate;
+	size_t chunk_sz;		/* bytes per direction that wake the writer */
+	uint64_t sync_ts;
 	struct aubuf *abrx;
 	struct aubuf *abtx;
 };
@@ -55,6 +78,8 @@ struct dec_st {
 	struct aufilt_dec_st af;  /* base class */
 	struct recorder_st *st;
 };
+
+static void *rec_thread(void *arg);
 
 static void enc_destructor(void *arg)
 {
@@ -78,28 +103,33 @@ static void recorder_destructor(void *arg)
 
 	DEBUG_NOTICE("Unloading recorder\n");
 
-	st->active = false;
-	while (!st->terminated) {
-    	Sleep(10);
+	if (st->thread_started) {
+		pthread_mutex_lock(&st->mutex);
+		st->run = false;
+		pthread_cond_signal(&st->cond);
+		pthread_mutex_unlock(&st->mutex);
+
+		pthread_join(st->thread, NULL);
 	}
-   	Sleep(10);	
-	CloseHandle(st->thread);
+
+	pthread_cond_destroy(&st->cond);
+	pthread_mutex_destroy(&st->mutex);
 
 	mem_deref(st->abrx);
 	mem_deref(st->abtx);
 
-	if (st->pFile) {
-		wavfile_close(st->pFile);
-		st->pFile = NULL;
+	if (st->wf) {
+		wavfile_close(st->wf);
+		st->wf = NULL;
 	}
 }
 
 
 static int recorder_alloc(struct recorder_st **stp, void **ctx, struct aufilt_prm *prm)
 {
-	DWORD dwtid;
 	struct recorder_st *st;
-	int err = 0, tmp, fl;
+	size_t frame_bytes;
+	int err = 0;
 
     filename_set = false;
 
@@ -119,30 +149,40 @@ static int recorder_alloc(struct recorder_st **stp, void **ctx, struct aufilt_pr
 	if (!st)
 		return ENOMEM;
 
-	st->srate = prm->srate;
+	pthread_mutex_init(&st->mutex, NULL);
+	pthread_cond_init(&st->cond, NULL);
 
+	st->srate = prm->srate;
 	st->frame_size = prm->frame_size;
-	err = aubuf_alloc(&st->abrx, prm->frame_size, prm->frame_size*250);
+
+	frame_bytes = prm->frame_size * sizeof(int16_t);
+	st->chunk_sz = max(frame_bytes,
+		prm->srate * REC_CHUNK_MS / 1000 * sizeof(int16_t));
+
+	err = aubuf_alloc_ring(&st->abrx, frame_bytes,
+		prm->srate * REC_QUEUE_MS / 1000 * sizeof(int16_t));
 	if (err)
 		goto out;
-	err = aubuf_alloc(&st->abtx, prm->frame_size, prm->frame_size*250);
+	err = aubuf_alloc_ring(&st->abtx, frame_bytes,
+		prm->srate * REC_QUEUE_MS / 1000 * sizeof(int16_t));
 	if (err)
 		goto out;
 
-	st->active = true;
-	st->thread = CreateThread(NULL, 0, ThreadRecWrite, st, 0, &dwtid);
-	if (st->thread == NULL) {
+	st->run = true;
+	err = pthread_create(&st->thread, NULL, rec_thread, st);
+	if (err) {
 		DEBUG_WARNING("recorder: failed to create worker thread\n");
-		err = ENOMEM;
+		st->run = false;
 		goto out;
 	}
+	st->thread_started = true;
 
  out:
 	if (err)
 		mem_deref(st);
 	else {
 		*ctx = *stp = st;
-		DEBUG_NOTICE("Recorder loaded: enc=%uHz\n", prm->srate);		
+		DEBUG_NOTICE("Recorder loaded: enc=%uHz\n", prm->srate);
 	}
 
 	return err;
@@ -203,12 +243,24 @@ static int decode_update(struct aufilt_dec_st **stp, void **ctx,
 }
 
 
+/* Wake up writer thread if there is work for it */
+static void rec_notify(struct recorder_st *rec, struct aubuf *ab)
+{
+	if (!rec->recording && !filename_set)
+		return;
+
+	if (aubuf_cur_size(ab) >= rec->chunk_sz)
+		pthread_cond_signal(&rec->cond);
+}
+
+
 static int encode(struct aufilt_enc_st *st, int16_t *sampv, size_t *sampc)
 {
 	struct enc_st *est = (struct enc_st *)st;
 	struct recorder_st *rec = est->st;
 
 	aubuf_write(rec->abrx, (uint8_t *)sampv, (*sampc)*sizeof(int16_t));
+	rec_notify(rec, rec->abrx);
 
 	return 0;
 }
@@ -220,6 +272,7 @@ static int decode(struct aufilt_dec_st *st, int16_t *sampv, size_t *sampc)
 	struct recorder_st *rec = dst->st;
 
 	aubuf_write(rec->abtx, (uint8_t *)sampv, (*sampc)*sizeof(int16_t));
+	rec_notify(rec, rec->abtx);
 
 	return 0;
 }
@@ -254,90 +307,143 @@ EXPORT_SYM const struct mod_export DECL_EXPORTS(recorder) = {
 	module_close
 };
 
-/** This thread is intended to decouple disk write (potentially blocking
-	for a long time in case of slow or networked media) from
-	audio thread
-*/
-DWORD WINAPI ThreadRecWrite(LPVOID data)
-{
-	struct recorder_st *rec = (struct recorder_st*)data;
-
-	while (rec->active)
-	{
-		char bufrx[8000];
-		char buftx[8000];
-		int cnt, i;
-		size_t delta;		
+
+static void rec_open(struct recorder_st *rec)
+{
+	lock_write_get(rec_lock);
+	if (filename_set) {
+		rec->channels = channels;
+		rec->wf = wavfile_open(filename, channels, rec->srate,
+			(enum wavfile_fmt)format);
+		if (!rec->wf) {
+			DEBUG_WARNING("recorder: failed to create file\n");
+			filename_set = false;
+		}
+	}
+	lock_rel(rec_lock);
+
+	if (rec->wf) {
+		/* start with fresh audio, not what was queued before */
+		aubuf_flush(rec->abrx);
+		aubuf_flush(rec->abtx);
+		rec->sync_ts = tmr_jiffies();
+		rec->recording = true;
+	}
+}
+
+
+/* Take everything queued in both directions and pass it to the encoder */
+static void rec_process(struct recorder_st *rec)
+{
+	const size_t frame_bytes = rec->frame_size * sizeof(int16_t);
+	int16_t bufrx[REC_BUF_SAMPLES];
+	int16_t buftx[REC_BUF_SAMPLES];
+	int16_t bufout[REC_BUF_SAMPLES * 2];
+
+	for (;;) {
 		size_t sizerx = aubuf_cur_size(rec->abrx);
-		size_t sizetx = aubuf_cur_size(rec->abrx);
-		//DEBUG_WARNING("sizerx=%d, sizetx=%d\n", (int)sizerx, (int)sizetx);
+		size_t sizetx = aubuf_cur_size(rec->abtx);
+		size_t cnt, padrx = 0, padtx = 0;
+		size_t n, i;
 
-		if (rec->pFile == NULL) {
-			lock_write_get(rec_lock);
-			if (filename_set) {
-				rec->pFile = wavfile_open(filename, channels, rec->srate);
-				if (!rec->pFile) {
-					DEBUG_WARNING("recorder: failed to create file\n");
-					lock_rel(rec_lock);
-					break;
-				}
+		cnt = min(sizerx, sizetx);
+
+		// let's try to handle clock skew between two sound devices
+		// (or some crappy hardware): if one direction runs ahead,
+		// insert some silence into the other one
+		if (sizerx > sizetx + frame_bytes * REC_SKEW_FRAMES)
+			padtx = frame_bytes;
+		else if (sizetx > sizerx + frame_bytes * REC_SKEW_FRAMES)
+			padrx = frame_bytes;
+
+		cnt = cnt / frame_bytes * frame_bytes;
+		cnt = min(cnt, sizeof(bufrx) - frame_bytes);
+		if (cnt == 0 && padrx == 0 && padtx == 0)
+			break;
+
+		if (cnt + padtx) {
+			aubuf_read(rec->abrx, (uint8_t *)bufrx, cnt + padtx);
+		}
+		if (cnt + padrx) {
+			aubuf_read(rec->abtx, (uint8_t *)buftx, cnt + padrx);
+		}
+		if (padrx)
+			memmove(&bufrx[frame_bytes / 2], bufrx, cnt);
+		if (padtx)
+			memmove(&buftx[frame_bytes / 2], buftx, cnt);
+		if (padrx || padtx) {
+			memset(padrx ? bufrx : buftx, 0, frame_bytes);
+			cnt += frame_bytes;
+		}
+		n = cnt / sizeof(int16_t);
+
+		if (rec->channels == 2) {
+			for (i=0; i<n; i++) {
+				bufout[2*i]     = bufrx[i];
+				bufout[2*i + 1] = buftx[i];
 			}
-			lock_rel(rec_lock);
-			Sleep(50);
-			continue;
+			(void)wavfile_write(rec->wf, bufout, 2*n);
+		}
+		else {
+			for (i=0; i<n; i++)
+				bufrx[i] = saturate_s16((int32_t)bufrx[i] + buftx[i]);
+			(void)wavfile_write(rec->wf, bufrx, n);
+		}
+	}
+
+	if (tmr_jiffies() - rec->sync_ts >= REC_SYNC_MS) {
+		if (wavfile_sync(rec->wf))
+			DEBUG_WARNING("recorder: failed to write file\n");
+		rec->sync_ts = tmr_jiffies();
+	}
+}
+
+
+static bool rec_ready(const struct recorder_st *rec)
+{
+	if (!rec->wf)
+		return filename_set;
+
+	return aubuf_cur_size(rec->abrx) >= rec->chunk_sz ||
+		aubuf_cur_size(rec->abtx) >= rec->chunk_sz;
+}
+
+
+static void *rec_thread(void *arg)
+{
+	struct recorder_st *rec = arg;
+
+	pthread_mutex_lock(&rec->mutex);
+
+	while (rec->run) {
+
+		if (!rec_ready(rec)) {
+			struct timespec abstime;
+			uint64_t ms;
+
+			ms = tmr_jiffies_unix(tmr_jiffies() + REC_WAIT_MS);
+			abstime.tv_sec  = (time_t)(ms / 1000);
+			abstime.tv_nsec = (long)(ms % 1000) * 1000000;
+			(void)pthread_cond_timedwait(&rec->cond, &rec->mutex,
+						     &abstime);
+			if (!rec->run)
+				break;
 		}
 
-		// let's try to handle clock skew between two sound devices
-		// (or some crappy hardware)
-		if (sizerx > sizetx)
-			delta = sizerx - sizetx;
+		pthread_mutex_unlock(&rec->mutex);
+
+		if (!rec->wf)
+			rec_open(rec);
 		else
-			delta = sizetx - sizerx;
-		// typically delta = 0
-		if (delta < rec->frame_size * 2) {
-			// ignore minor differences
-			delta = 0;
-		}
-
-		cnt = sizeof(bufrx);
-		if (sizerx < cnt)
-			cnt = sizerx;
-		if (sizetx < cnt)
-			cnt = sizetx;
-		// this would effectively insert some silence into one of the directions
-		cnt += delta/2;
+			rec_process(rec);
 
-		aubuf_read(rec->abrx, bufrx, cnt);
-		aubuf_read(rec->abtx, buftx, cnt);
+		pthread_mutex_lock(&rec->mutex);
+	}
 
-		sizerx = aubuf_cur_size(rec->abrx);
-		sizetx = aubuf_cur_size(rec->abrx);
-		//DEBUG_WARNING("AFTER: sizerx=%d, sizetx=%d\n", (int)sizerx, (int)sizetx);
+	pthread_mutex_unlock(&rec->mutex);
 
-		if (channels == 1) {
-			//DEBUG_WARNING("write %d\n", cnt);
-			short *dst = (short*)bufrx;
-			short *src = (short*)buftx;
-			for (i=0; i<cnt/sizeof(short); i++) {
-				dst[i] += src[i];
-			}
-			fwrite(bufrx, cnt, 1, rec->pFile);
-		} else if (channels == 2) {
-			short bufstereo[8000];
-			short *srcA = (short*)bufrx;
-			short *srcB = (short*)buftx;
-			for (i=0; i<cnt/sizeof(short)*channels; i += channels) {
-				bufstereo[i]     = *srcA++;
-				bufstereo[i + 1] = *srcB++;
-			}
-			fwrite(bufstereo, cnt * sizeof(short), 1, rec->pFile);
-		} else {
-			assert(!"Unhandled channel count");
-		}
+	if (rec->wf)
+		rec_process(rec);
 
-		Sleep(50);
-	}
-	rec->terminated = true;
-	return 0;
+	return NULL;
 }
-
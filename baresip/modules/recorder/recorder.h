@@ -6,6 +6,7 @@
 
 /** \note This simplified interface cannot handle multiple simultaneous calls
 */
-int recorder_start(const char* const filename, unsigned int rec_channels);
+int recorder_start(const char* const filename, unsigned int rec_channels,
+	enum recorder_format rec_format);
 
 #endif
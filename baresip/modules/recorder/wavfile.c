@@ -1,68 +1,437 @@
 #include "wavfile.h"
 
+#include <re.h>
+#include <rem.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#ifdef WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
 
-struct wav_header {
-	char	riff_tag[4];
-	int	riff_length;
-	char	wave_tag[4];
-	char	fmt_tag[4];
-	int	fmt_length;
-	short	audio_format;
-	short	num_channels;
-	int	sample_rate;
-	int	byte_rate;
-	short	block_align;
-	short	bits_per_sample;
-	char	data_tag[4];
-	int	data_length;
+enum {
+	OUTBUF_SIZE = 65536,	/* encoded data is written in blocks this large */
+	HEADER_MAX = 64
 };
 
-FILE * wavfile_open(const char *filename, unsigned int channels, unsigned int samples_per_sec)
+struct ima_state {
+	int pred;
+	int index;
+};
+
+struct wavfile {
+	FILE *file;
+	enum wavfile_fmt fmt;
+	unsigned int channels;
+	unsigned int srate;
+	size_t header_len;
+	uint32_t data_len;	/* bytes of encoded audio written so far */
+	uint32_t frames;	/* samples per channel written so far */
+
+	uint8_t *out;		/* encoded data not yet written to file */
+	size_t out_len;
+
+	/* IMA ADPCM only */
+	unsigned int block_align;
+	unsigned int spb;	/* samples per channel in one block */
+	int16_t *blk;		/* interleaved samples of block being filled */
+	unsigned int blk_len;	/* samples per channel in blk */
+	struct ima_state ima[2];
+};
+
+static const int16_t ima_step[89] = {
+	7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37,
+	41, 45, 50, 55, 60, 66, 73, 80, 88, 97, 107, 118, 130, 143, 157, 173,
+	190, 209, 230, 253, 279, 307, 337, 371, 408, 449, 494, 544, 598, 658,
+	724, 796, 876, 963, 1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066,
+	2272, 2499, 2749, 3024, 3327, 3660, 4026, 4428, 4871, 5358, 5894,
+	6484, 7132, 7845, 8630, 9493, 10442, 11487, 12635, 13899, 15289,
+	16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767
+};
+
+static const int8_t ima_index[8] = {
+	-1, -1, -1, -1, 2, 4, 6, 8
+};
+
+
+static uint8_t *put_le16(uint8_t *p, uint16_t v)
+{
+	*p++ = v & 0xff;
+	*p++ = v >> 8;
+	return p;
+}
+
+static uint8_t *put_le32(uint8_t *p, uint32_t v)
 {
-	FILE * file = fopen(filename,"wb+");
-	if(!file) {
+	p = put_le16(p, v & 0xffff);
+	return put_le16(p, v >> 16);
+}
+
+static uint8_t *put_tag(uint8_t *p, const char *tag)
+{
+	memcpy(p, tag, 4);
+	return p + 4;
+}
+
+/* Build RIFF header for current data length, return its size */
+static size_t header_build(const struct wavfile *wf, uint8_t *buf)
+{
+	const unsigned int ch = wf->channels;
+	uint16_t tag, bits, align, ext;
+	uint32_t byte_rate;
+	uint8_t *p = buf;
+	size_t len;
+
+	switch (wf->fmt) {
+
+	case WAVFILE_PCMU:
+	case WAVFILE_PCMA:
+		tag = (wf->fmt == WAVFILE_PCMU) ? 7 : 6;
+		bits = 8;
+		align = ch;
+		byte_rate = wf->srate * ch;
+		ext = 0;
+		break;
+
+	case WAVFILE_IMA_ADPCM:
+		tag = 0x11;
+		bits = 4;
+		align = wf->block_align;
+		byte_rate = (uint32_t)((uint64_t)wf->srate * align / wf->spb);
+		ext = 2;
+		break;
+
+	default:
+		tag = 1;
+		bits = 16;
+		align = 2 * ch;
+		byte_rate = wf->srate * 2 * ch;
+		ext = 0;
+		break;
+	}
+
+	p = put_tag(p, "RIFF");
+	p = put_le32(p, 0);	/* filled in below */
+	p = put_tag(p, "WAVE");
+
+	p = put_tag(p, "fmt ");
+	p = put_le32(p, tag == 1 ? 16 : 18 + ext);
+	p = put_le16(p, tag);
+	p = put_le16(p, ch);
+	p = put_le32(p, wf->srate);
+	p = put_le32(p, byte_rate);
+	p = put_le16(p, align);
+	p = put_le16(p, bits);
+	if (tag != 1) {
+		p = put_le16(p, ext);
+		if (ext)
+			p = put_le16(p, wf->spb);
+
+		/* non-PCM formats carry sample count in fact chunk */
+		p = put_tag(p, "fact");
+		p = put_le32(p, 4);
+		p = put_le32(p, wf->frames);
+	}
+
+	p = put_tag(p, "data");
+	p = put_le32(p, wf->data_len);
+
+	len = p - buf;
+	put_le32(buf + 4, (uint32_t)(len - 8 + wf->data_len));
+
+	return len;
+}
+
+static int out_flush(struct wavfile *wf)
+{
+	if (!wf->out_len)
+		return 0;
+
+	if (fwrite(wf->out, wf->out_len, 1, wf->file) != 1)
+		return EIO;
+
+	wf->out_len = 0;
+	return 0;
+}
+
+/* Reserve n bytes in output buffer, writing it out first if needed */
+static uint8_t *out_get(struct wavfile *wf, size_t n)
+{
+	uint8_t *p;
+
+	if (wf->out_len + n > OUTBUF_SIZE && out_flush(wf))
 		return NULL;
-	} else {
-		struct wav_header header;
-
-		int bits_per_sample = 16;
-
-		strncpy(header.riff_tag, "RIFF", 4);
-		strncpy(header.wave_tag, "WAVE", 4);
-		strncpy(header.fmt_tag, "fmt ", 4);
-		strncpy(header.data_tag, "data", 4);
-
-		header.riff_length = 0;
-		header.fmt_length = 16;
-		header.audio_format = 1;
-		header.num_channels = channels;
-		header.sample_rate = samples_per_sec;
-		header.byte_rate = samples_per_sec*(bits_per_sample/8) * channels;
-		header.block_align = bits_per_sample/8 * channels;
-		header.bits_per_sample = bits_per_sample;
-		header.data_length = 0;
-
-		fwrite(&header, sizeof(header), 1, file);
-		return file;
+
+	p = wf->out + wf->out_len;
+	wf->out_len += n;
+	wf->data_len += (uint32_t)n;
+
+	return p;
+}
+
+static uint8_t ima_encode(struct ima_state *s, int sample)
+{
+	int step = ima_step[s->index];
+	int diff = sample - s->pred;
+	int vpdiff = step >> 3;
+	uint8_t code = 0;
+
+	if (diff < 0) {
+		code = 8;
+		diff = -diff;
 	}
+	if (diff >= step) {
+		code |= 4;
+		diff -= step;
+		vpdiff += step;
+	}
+	step >>= 1;
+	if (diff >= step) {
+		code |= 2;
+		diff -= step;
+		vpdiff += step;
+	}
+	step >>= 1;
+	if (diff >= step) {
+		code |= 1;
+		vpdiff += step;
+	}
+
+	if (code & 8)
+		s->pred -= vpdiff;
+	else
+		s->pred += vpdiff;
+
+	if (s->pred > 32767)
+		s->pred = 32767;
+	else if (s->pred < -32768)
+		s->pred = -32768;
+
+	s->index += ima_index[code & 7];
+	if (s->index < 0)
+		s->index = 0;
+	else if (s->index > 88)
+		s->index = 88;
+
+	return code;
+}
+
+/* Encode one full block from wf->blk */
+static int ima_block(struct wavfile *wf)
+{
+	const unsigned int ch = wf->channels;
+	uint8_t *p = out_get(wf, wf->block_align);
+	unsigned int c, i, j;
+
+	if (!p)
+		return EIO;
+
+	/* block header: first sample is stored verbatim */
+	for (c=0; c<ch; c++) {
+		struct ima_state *s = &wf->ima[c];
+
+		s->pred = wf->blk[c];
+		p = put_le16(p, (uint16_t)s->pred);
+		*p++ = (uint8_t)s->index;
+		*p++ = 0;
+	}
+
+	/* then groups of 8 samples per channel, low nibble first */
+	for (i=1; i<wf->spb; i+=8) {
+		for (c=0; c<ch; c++) {
+			for (j=0; j<8; j+=2) {
+				const int16_t *x = &wf->blk[(i + j) * ch + c];
+				uint8_t b;
+
+				b  = ima_encode(&wf->ima[c], x[0]);
+				b |= ima_encode(&wf->ima[c], x[ch]) << 4;
+				*p++ = b;
+			}
+		}
+	}
+
+	return 0;
+}
+
+struct wavfile * wavfile_open(const char *filename, unsigned int channels,
+	unsigned int samples_per_sec, enum wavfile_fmt fmt)
+{
+	struct wavfile *wf;
+	uint8_t header[HEADER_MAX];
+
+	if (channels < 1 || channels > 2)
+		return NULL;
+
+	wf = calloc(1, sizeof(*wf));
+	if (!wf)
+		return NULL;
+
+	wf->fmt = fmt;
+	wf->channels = channels;
+	wf->srate = samples_per_sec;
+
+	if (fmt == WAVFILE_IMA_ADPCM) {
+		/* usual block sizes: 256 bytes per channel at 8 kHz */
+		unsigned int align = 256;
+		if (samples_per_sec > 11025)
+			align = 512;
+		if (samples_per_sec > 22050)
+			align = 1024;
+		wf->block_align = align * channels;
+		wf->spb = (wf->block_align - 4 * channels) * 2 / channels + 1;
+		wf->blk = calloc(wf->spb * channels, sizeof(int16_t));
+		if (!wf->blk)
+			goto error;
+	}
+
+	wf->out = malloc(OUTBUF_SIZE);
+	if (!wf->out)
+		goto error;
+
+	wf->file = fopen(filename, "wb+");
+	if (!wf->file)
+		goto error;
+
+	/* data is already collected into large blocks */
+	setvbuf(wf->file, NULL, _IONBF, 0);
+
+	wf->header_len = header_build(wf, header);
+	if (fwrite(header, wf->header_len, 1, wf->file) != 1) {
+		fclose(wf->file);
+		goto error;
+	}
+
+	return wf;
+
+error:
+	free(wf->blk);
+	free(wf->out);
+	free(wf);
+	return NULL;
+}
+
+/** Encode and append interleaved samples */
+int wavfile_write(struct wavfile *wf, const int16_t *sampv, size_t sampc)
+{
+	const size_t frames = sampc / wf->channels;
+	uint8_t *p;
+	int err;
+
+	switch (wf->fmt) {
+
+	case WAVFILE_PCMU:
+	case WAVFILE_PCMA:
+		while (sampc) {
+			const size_t n = min(sampc, (size_t)OUTBUF_SIZE);
+
+			p = out_get(wf, n);
+			if (!p)
+				return EIO;
+			if (wf->fmt == WAVFILE_PCMU)
+				g711_pcm2ulaw_v(p, sampv, n);
+			else
+				g711_pcm2alaw_v(p, sampv, n);
+			sampv += n;
+			sampc -= n;
+		}
+		break;
+
+	case WAVFILE_IMA_ADPCM:
+		while (sampc) {
+			const size_t n = min(sampc / wf->channels,
+				(size_t)(wf->spb - wf->blk_len));
+
+			memcpy(&wf->blk[wf->blk_len * wf->channels], sampv,
+				n * wf->channels * sizeof(int16_t));
+			wf->blk_len += (unsigned int)n;
+			sampv += n * wf->channels;
+			sampc -= n * wf->channels;
+
+			if (wf->blk_len == wf->spb) {
+				err = ima_block(wf);
+				if (err)
+					return err;
+				wf->blk_len = 0;
+			}
+			if (!n)
+				break;
+		}
+		break;
+
+	default:
+		while (sampc) {
+			const size_t n = min(sampc, (size_t)OUTBUF_SIZE / 2);
+			size_t i;
+
+			p = out_get(wf, n * 2);
+			if (!p)
+				return EIO;
+			for (i=0; i<n; i++)
+				p = put_le16(p, (uint16_t)sampv[i]);
+			sampv += n;
+			sampc -= n;
+		}
+		break;
+	}
+
+	wf->frames += (uint32_t)frames;
+
+	return 0;
 }
 
-void wavfile_close(FILE *file)
+/** Write out buffered data and header, then commit file to disk */
+int wavfile_sync(struct wavfile *wf)
 {
-    int riff_length = 0;
-	int file_length = ftell(file);
+	uint8_t header[HEADER_MAX];
+	int err;
 
-	int data_length = file_length - sizeof(struct wav_header);
-	fseek(file, sizeof(struct wav_header) - sizeof(int), SEEK_SET);
-	fwrite(&data_length, sizeof(data_length), 1, file);
+	err = out_flush(wf);
+	if (err)
+		return err;
 
-	riff_length = file_length - 8;
-	fseek(file, 4, SEEK_SET);
-	fwrite(&riff_length, sizeof(riff_length), 1, file);
+	header_build(wf, header);
+	fseek(wf->file, 0, SEEK_SET);
+	fwrite(header, wf->header_len, 1, wf->file);
+	fseek(wf->file, 0, SEEK_END);
 
-	fclose(file);
+	if (fflush(wf->file))
+		return EIO;
+#ifdef WIN32
+	if (_commit(_fileno(wf->file)))
+		return EIO;
+#else
+	if (fsync(fileno(wf->file)))
+		return EIO;
+#endif
+
+	return 0;
 }
 
+void wavfile_close(struct wavfile *wf)
+{
+	uint8_t header[HEADER_MAX];
+
+	if (!wf)
+		return;
+
+	/* last partial ADPCM block is padded with silence; the fact chunk
+	   still holds the real number of samples */
+	if (wf->fmt == WAVFILE_IMA_ADPCM && wf->blk_len) {
+		memset(&wf->blk[wf->blk_len * wf->channels], 0,
+			(wf->spb - wf->blk_len) * wf->channels * sizeof(int16_t));
+		(void)ima_block(wf);
+	}
+
+	(void)out_flush(wf);
+
+	header_build(wf, header);
+	fseek(wf->file, 0, SEEK_SET);
+	fwrite(header, wf->header_len, 1, wf->file);
+
+	fclose(wf->file);
+	free(wf->blk);
+	free(wf->out);
+	free(wf);
+}
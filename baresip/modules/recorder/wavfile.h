@@ -1,9 +1,23 @@
 #ifndef WavFileH
 #define WavFileH
 
-#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
 
-FILE * wavfile_open(const char *filename, unsigned int channels, unsigned int samples_per_sec);
-void wavfile_close(FILE * file);
+struct wavfile;
+
+/** WAV encodings, same values as enum recorder_format */
+enum wavfile_fmt {
+	WAVFILE_PCM16 = 0,
+	WAVFILE_PCMU,
+	WAVFILE_PCMA,
+	WAVFILE_IMA_ADPCM
+};
+
+struct wavfile * wavfile_open(const char *filename, unsigned int channels,
+	unsigned int samples_per_sec, enum wavfile_fmt fmt);
+int wavfile_write(struct wavfile *wf, const int16_t *sampv, size_t sampc);
+int wavfile_sync(struct wavfile *wf);
+void wavfile_close(struct wavfile *wf);
 
 #endif
@@ -1,5 +1,6 @@
 #include <stdlib.h>
 #include <string.h>
+#include <math.h>
 #include <re.h>
 #include <baresip.h>
 
@@ -10,6 +11,19 @@
 
 #define SOFTVOL_BASE 128
 
+/* Gain is applied in Q12 so that a ramp can move in steps finer than
+ * one SOFTVOL_BASE unit; 512/128 * 4096 * 32768 still fits in int32.
+ */
+#define GAIN_SHIFT 12
+#define GAIN_UNITY (1 << GAIN_SHIFT)
+
+/* Level snapshots, (peak << 16) | rms of the last processed frame.
+ * Written with a single 32-bit store by the audio thread, so readers
+ * never see a torn peak/rms pair and need no lock.
+ */
+static volatile uint32_t level_tx;
+static volatile uint32_t level_rx;
+
 struct softvol_st {
 	int dummy;
 };
@@ -17,11 +31,13 @@ struct softvol_st {
 struct enc_st {
 	struct aufilt_enc_st af;  /* base class */
 	struct softvol_st *st;
+	int gain;                 /* gain reached at end of last frame, Q12 */
 };
 
 struct dec_st {
 	struct aufilt_dec_st af;  /* base class */
 	struct softvol_st *st;
+	int gain;                 /* gain reached at end of last frame, Q12 */
 };
 
 static void enc_destructor(void *arg)
@@ -100,6 +116,8 @@ static int encode_update(struct aufilt_enc_st **stp, void **ctx,
 		return ENOMEM;
 
 	err = softvol_alloc(&st->st, ctx, prm);
+	st->gain = (int)conf_config()->audio.softvol_tx
+		* (GAIN_UNITY / SOFTVOL_BASE);
 
 	if (err)
 		mem_deref(st);
@@ -126,6 +144,8 @@ static int decode_update(struct aufilt_dec_st **stp, void **ctx,
 		return ENOMEM;
 
 	err = softvol_alloc(&st->st, ctx, prm);
+	st->gain = (int)conf_config()->audio.softvol_rx
+		* (GAIN_UNITY / SOFTVOL_BASE);
 
 	if (err)
 		mem_deref(st);
@@ -149,20 +169,93 @@ static int16_t saturate_s16(int32_t val) {
 #endif
 }
 
-static int encode(struct aufilt_enc_st *st, int16_t *sampv, size_t *sampc)
+/* Constant gain, unrolled by 4 */
+static void gain_const(int16_t *sampv, size_t sampc, int32_t g)
 {
-	struct enc_st *est = (struct enc_st *)st;
-	struct softvol_st *wr = est->st;
-	int status;
-	unsigned int i;
-	int softvol_tx = (int)(conf_config()->audio.softvol_tx);
+	size_t i = 0;
+
+	for (; i + 4 <= sampc; i += 4) {
+		const int32_t s0 = (sampv[i]   * g) >> GAIN_SHIFT;
+		const int32_t s1 = (sampv[i+1] * g) >> GAIN_SHIFT;
+		const int32_t s2 = (sampv[i+2] * g) >> GAIN_SHIFT;
+		const int32_t s3 = (sampv[i+3] * g) >> GAIN_SHIFT;
+
+		sampv[i]   = saturate_s16(s0);
+		sampv[i+1] = saturate_s16(s1);
+		sampv[i+2] = saturate_s16(s2);
+		sampv[i+3] = saturate_s16(s3);
+	}
+
+	for (; i < sampc; i++)
+		sampv[i] = saturate_s16((sampv[i] * g) >> GAIN_SHIFT);
+}
+
+
+/* Linear ramp from g0 to g1 across the frame, g1 reached at last sample */
+static void gain_ramp(int16_t *sampv, size_t sampc, int32_t g0, int32_t g1)
+{
+	const int32_t d = g1 - g0;
+	size_t i;
+
+	for (i=0; i<sampc; i++) {
+		const int32_t g = g0 + (int32_t)(d * (int32_t)(i + 1)
+						 / (int32_t)sampc);
+
+		sampv[i] = saturate_s16((sampv[i] * g) >> GAIN_SHIFT);
+	}
+}
+
+
+/* Peak and RMS of one frame, packed as (peak << 16) | rms */
+static uint32_t level_calc(const int16_t *sampv, size_t sampc)
+{
+	uint32_t peak = 0;
+	uint64_t sum = 0;
+	size_t i;
+
+	if (!sampc)
+		return 0;
+
+	for (i=0; i<sampc; i++) {
+		const int32_t s = sampv[i];
+		const uint32_t a = s < 0 ? (uint32_t)-s : (uint32_t)s;
+
+		if (a > peak)
+			peak = a;
+		sum += (uint32_t)(s * s);
+	}
 
-	(void)wr;
+	if (peak > 32767)
+		peak = 32767;
 
-	for (i=0; i<*sampc; i++) {
-		sampv[i] = saturate_s16(((int32_t)sampv[i] * softvol_tx) / SOFTVOL_BASE);
+	return (peak << 16) | (uint32_t)sqrt((double)sum / sampc);
+}
+
+
+static void process(int16_t *sampv, size_t sampc, int *gain,
+		    unsigned int softvol, volatile uint32_t *level)
+{
+	const int32_t target = (int32_t)softvol * (GAIN_UNITY / SOFTVOL_BASE);
+
+	if (*gain != target) {
+		gain_ramp(sampv, sampc, *gain, target);
+		*gain = target;
+	}
+	else if (target != GAIN_UNITY) {
+		gain_const(sampv, sampc, target);
 	}
 
+	*level = level_calc(sampv, sampc);
+}
+
+
+static int encode(struct aufilt_enc_st *st, int16_t *sampv, size_t *sampc)
+{
+	struct enc_st *est = (struct enc_st *)st;
+
+	process(sampv, *sampc, &est->gain, conf_config()->audio.softvol_tx,
+		&level_tx);
+
 	return 0;
 }
 
@@ -170,20 +263,36 @@ static int encode(struct aufilt_enc_st *st, int16_t *sampv, size_t *sampc)
 static int decode(struct aufilt_dec_st *st, int16_t *sampv, size_t *sampc)
 {
 	struct dec_st *dst = (struct dec_st *)st;
-	struct softvol_st *wr = dst->st;
-	int status = 0;
-	unsigned int i;
-	int softvol_rx = (int)(conf_config()->audio.softvol_rx);
 
-	(void)wr;
+	process(sampv, *sampc, &dst->gain, conf_config()->audio.softvol_rx,
+		&level_rx);
+
+	return 0;
+}
 
-	for (i=0; i<*sampc; i++) {
-		sampv[i] = saturate_s16(((int32_t)sampv[i] * softvol_rx) / SOFTVOL_BASE);
-	}
 
-	return status;
+/**
+ * Get audio level of the last frame processed by softvol
+ *
+ * @param tx   True for the TX (microphone) direction, false for RX
+ * @param peak Returned absolute peak, 0..32767 (optional)
+ * @param rms  Returned RMS, 0..32767 (optional)
+ *
+ * @return 0 for success, otherwise error code
+ */
+int softvol_level_get(bool tx, unsigned int *peak, unsigned int *rms)
+{
+	const uint32_t v = tx ? level_tx : level_rx;
+
+	if (peak)
+		*peak = v >> 16;
+	if (rms)
+		*rms = v & 0xffff;
+
+	return 0;
 }
 
+
 static struct aufilt softvol = {
 	LE_INIT, "softvol", encode_update, encode, decode_update, decode
 };
@@ -195,6 +304,7 @@ static int module_init(void) {
 
 static int module_close(void) {
 	aufilt_unregister(&softvol);
+	level_tx = level_rx = 0;
 	return 0;
 }  
 
@@ -20,6 +20,7 @@ struct preproc {
 	struct aufilt_enc_st af;    /* base class */
 	uint32_t psize;
 	SpeexPreprocessState *state;
+	bool vad;
 };
 
 static void speexpp_destructor(void *arg)
@@ -71,6 +72,7 @@ static int encode_update(struct aufilt_enc_st **stp, void **ctx,
 
 	val = cfg->audio_preproc_tx.vad_enabled;
 	speex_preprocess_ctl(st->state, SPEEX_PREPROCESS_SET_VAD, &val);
+	st->vad = cfg->audio_preproc_tx.vad_enabled;
 	val = cfg->audio_preproc_tx.dereverb_enabled;
 	speex_preprocess_ctl(st->state, SPEEX_PREPROCESS_SET_DEREVERB, &val);
 
@@ -102,8 +104,9 @@ static int encode(struct aufilt_enc_st *st, int16_t *sampv, size_t *sampc)
 	is_speech = speex_preprocess(st->state, sampv, NULL);
 #endif
 
-	/* XXX: Handle is_speech and VAD */
-	(void)is_speech;
+	/* tell the encoder side that it may use DTX for this frame */
+	if (pp->vad && !is_speech)
+		return ENODATA;
 
 	return 0;
 }
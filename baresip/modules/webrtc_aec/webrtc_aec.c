@@ -11,6 +11,7 @@
 #define WEBRTC_USE_NS 0	///< use noise suppression
 #include <webrtc/modules/audio_processing/aec/include/echo_cancellation.h>
 #include <webrtc/modules/audio_processing/ns/include/noise_suppression_x.h>
+#include <webrtc/common_audio/signal_processing/include/signal_processing_library.h>
 
 
 #define DEBUG_MODULE "webrtc_aec"
@@ -18,14 +19,41 @@
 #include <re_dbg.h>
 
 
+/*
+ * The AEC core runs on 10 ms blocks: 80 or 160 samples at 8 or 16 kHz.
+ * At 32 kHz each 320 sample block is split by the QMF filter bank into
+ * 0-8 kHz and 8-16 kHz bands of 160 samples. Audio frames of any length
+ * are re-chunked into such blocks on both near-end and far-end side.
+ */
+enum {
+	AEC_BLOCK_MAX = 320,	///< 10 ms at 32 kHz
+	AEC_BAND_LEN = 160,	///< one band of split 32 kHz block
+	QMF_STATE_LEN = 6
+};
+
 struct webrtc_st {
 	uint32_t nsamp;
-	int16_t *out;
+	uint32_t block;		///< samples in 10 ms
+	uint32_t srate;
 
 	void*		AEC_inst;
 	NsxHandle*  NS_inst;
-	int16_t* 	tmp_frame;
-	int16_t* 	tmp_frame2;
+
+	/* near-end: block being collected and FIFO of processed samples */
+	int16_t near_blk[AEC_BLOCK_MAX];
+	uint32_t near_len;
+	int16_t *outq;
+	uint32_t outq_len;
+	uint32_t outq_size;	///< capacity of outq in samples
+
+	/* far-end: preallocated block, filled from decoded frames */
+	int16_t far_blk[AEC_BLOCK_MAX];
+	uint32_t far_len;
+
+	/* QMF filter bank states, used at 32 kHz only */
+	int32_t near_ana1[QMF_STATE_LEN], near_ana2[QMF_STATE_LEN];
+	int32_t near_syn1[QMF_STATE_LEN], near_syn2[QMF_STATE_LEN];
+	int32_t far_ana1[QMF_STATE_LEN], far_ana2[QMF_STATE_LEN];
 
 	int msInSndCardBuf;
 	int skew;
@@ -78,9 +106,7 @@ static void webrtc_aec_destructor(void *arg)
 	}
 #endif
 
-	mem_deref(st->out);
-	mem_deref(st->tmp_frame);
-	mem_deref(st->tmp_frame2);
+	mem_deref(st->outq);
 }
 
 
@@ -94,16 +120,12 @@ static int aec_alloc(struct webrtc_st **stp, void **ctx, struct aufilt_prm *prm)
 	if (!stp || !ctx || !prm)
 		return EINVAL;
 
-	{
-		int nsamp = prm->ch * prm->frame_size;
-		if (nsamp != 80 && nsamp != 160) {
-			/** \todo For 16kHz sampling frame size = 320, unsupported by WebRTC.
-				Additional framing required.
-			*/
-			DEBUG_WARNING("WebRTC AEC disabled - unsupported frame length\n");
-			return EFAULT;        
-        }
-    }
+	if (prm->ch != 1 ||
+		(prm->srate != 8000 && prm->srate != 16000 && prm->srate != 32000)) {
+		DEBUG_WARNING("WebRTC AEC disabled - unsupported format"
+			" (%uHz, %u channels)\n", prm->srate, prm->ch);
+		return EFAULT;
+	}
 
 	if (*ctx) {
 		*stp = mem_ref(*ctx);
@@ -115,11 +137,16 @@ static int aec_alloc(struct webrtc_st **stp, void **ctx, struct aufilt_prm *prm)
 		return ENOMEM;
 
 	st->nsamp = prm->ch * prm->frame_size;
+	st->srate = prm->srate;
+	st->block = prm->srate / 100;
 	st->msInSndCardBuf = cfg->webrtc.msInSndCardBuf;
 	st->skew = cfg->webrtc.skew;
 
-	st->out = mem_alloc(2 * st->nsamp, NULL);
-	if (!st->out) {
+	/* processed samples are queued here until the encoder takes them;
+	   grown by encode() if it sees longer frames */
+	st->outq_size = st->nsamp + 2 * st->block;
+	st->outq = mem_zalloc(2 * st->outq_size, NULL);
+	if (!st->outq) {
 		err = ENOMEM;
 		goto out;
 	}
@@ -167,14 +194,9 @@ static int aec_alloc(struct webrtc_st **stp, void **ctx, struct aufilt_prm *prm)
 	}
 #endif
 
-	st->tmp_frame = mem_zalloc(2 * st->nsamp, NULL);
-	st->tmp_frame2 = mem_zalloc(2 * st->nsamp, NULL);
-	if (!st->tmp_frame || !st->tmp_frame2) {
-		err = ENOMEM;
-		goto out;
-	}
-	DEBUG_NOTICE("WebRTC AEC loaded: enc=%uHz, msInSndCardBuf=%d, skew=%d\n",
-		prm->srate, st->msInSndCardBuf, st->skew);
+	DEBUG_NOTICE("WebRTC AEC loaded: enc=%uHz, frame=%u, msInSndCardBuf=%d,"
+		" skew=%d\n",
+		prm->srate, st->nsamp, st->msInSndCardBuf, st->skew);
 
 out:
 	if (err) {
@@ -251,59 +273,154 @@ static int decode_update(struct aufilt_dec_st **stp, void **ctx,
 }
 
 
-static int encode(struct aufilt_enc_st *st, int16_t *sampv, size_t *sampc)
+/* Run echo cancellation on one 10 ms block */
+static int process_block(struct webrtc_st *wr, const int16_t *in, int16_t *out)
 {
-	struct enc_st *est = (struct enc_st *)st;
-	struct webrtc_st *wr = est->st;
+	int16_t low[AEC_BAND_LEN], high[AEC_BAND_LEN];
+	int16_t low_out[AEC_BAND_LEN], high_out[AEC_BAND_LEN];
+	const int16_t *near = in, *nearH = NULL;
+	int16_t *o = out, *oH = NULL;
+	int16_t n = (int16_t)wr->block;
 	int status;
 
-	if (*sampc == wr->nsamp) {
-		// cancel echo (modify samples)
+	if (wr->srate == 32000) {
+		WebRtcSpl_AnalysisQMF(in, low, high,
+			wr->near_ana1, wr->near_ana2);
+		near = low;
+		nearH = high;
+		o = low_out;
+		oH = high_out;
+		n = AEC_BAND_LEN;
+	}
+
 #if WEBRTC_USE_NS == 1
-		if(wr->NS_inst){
-			/* Noise suppression */
-			status = WebRtcNsx_Process(
-				wr->NS_inst,
-				sampv, NULL,
-				wr->tmp_frame, NULL);
-		}
+	if (wr->NS_inst) {
+		int16_t ns[AEC_BLOCK_MAX], nsH[AEC_BAND_LEN];
+
+		/* Noise suppression */
+		WebRtcNsx_Process(wr->NS_inst, (short *)near, (short *)nearH,
+			ns, nearH ? nsH : NULL);
+		near = ns;
+		if (nearH)
+			nearH = nsH;
+	}
 #endif
-		/* Process echo cancellation */
-		status = WebRtcAec_Process(
-			wr->AEC_inst,
-			(wr->NS_inst)?wr->tmp_frame:sampv, NULL,
-			wr->tmp_frame2, NULL,
-			wr->nsamp,
-			wr->msInSndCardBuf,   // 40: PortAudio/DS (60ms/60ms), 120: winwave
-			wr->skew);
-		if(status != 0){
-			print_webrtc_aec_error("Process echo", wr->AEC_inst);
-			return status;
-		}
-		/* Copy temporary buffer back to original */
-		memcpy(sampv, wr->tmp_frame2, 2 * wr->nsamp);
-	} else if (*sampc) {
-		static int unexpected = 0;
-		unexpected++;
+
+	/* Process echo cancellation */
+	status = WebRtcAec_Process(
+		wr->AEC_inst,
+		near, nearH,
+		o, oH,
+		n,
+		wr->msInSndCardBuf,   // 40: PortAudio/DS (60ms/60ms), 120: winwave
+		wr->skew);
+	if (status != 0) {
+		print_webrtc_aec_error("Process echo", wr->AEC_inst);
+		return status;
+	}
+
+	if (wr->srate == 32000) {
+		WebRtcSpl_SynthesisQMF(low_out, high_out, out,
+			wr->near_syn1, wr->near_syn2);
 	}
+
 	return 0;
 }
 
 
+static int encode(struct aufilt_enc_st *st, int16_t *sampv, size_t *sampc)
+{
+	struct enc_st *est = (struct enc_st *)st;
+	struct webrtc_st *wr = est->st;
+	const uint32_t nsamp = (uint32_t)*sampc;
+	int status = 0;
+	uint32_t i = 0;
+
+	/* frame length may differ from the one seen at allocation */
+	if (nsamp + 2 * wr->block > wr->outq_size) {
+		const uint32_t size = nsamp + 2 * wr->block;
+		int16_t *outq = mem_realloc(wr->outq, 2 * size);
+		if (!outq)
+			return ENOMEM;
+		wr->outq = outq;
+		wr->outq_size = size;
+	}
+
+	while (i < nsamp) {
+		const uint32_t n = min(wr->block - wr->near_len, nsamp - i);
+
+		memcpy(&wr->near_blk[wr->near_len], &sampv[i], 2 * n);
+		wr->near_len += n;
+		i += n;
+
+		if (wr->near_len == wr->block) {
+			int16_t *out = &wr->outq[wr->outq_len];
+
+			if (process_block(wr, wr->near_blk, out)) {
+				/* keep audio going, unprocessed */
+				memcpy(out, wr->near_blk, 2 * wr->block);
+				status = EFAULT;
+			}
+			wr->outq_len += wr->block;
+			wr->near_len = 0;
+		}
+	}
+
+	/* Frames that are not a multiple of 10 ms cannot always be filled
+	   from whole blocks; pad with silence once, adding that much delay */
+	if (wr->outq_len < nsamp) {
+		const uint32_t pad = nsamp - wr->outq_len;
+		memmove(&wr->outq[pad], wr->outq, 2 * wr->outq_len);
+		memset(wr->outq, 0, 2 * pad);
+		wr->outq_len = nsamp;
+	}
+
+	/* Copy processed samples back to original */
+	memcpy(sampv, wr->outq, 2 * nsamp);
+	wr->outq_len -= nsamp;
+	memmove(wr->outq, &wr->outq[nsamp], 2 * wr->outq_len);
+
+	return status;
+}
+
+
 static int decode(struct aufilt_dec_st *st, int16_t *sampv, size_t *sampc)
 {
 	struct dec_st *dst = (struct dec_st *)st;
 	struct webrtc_st *wr = dst->st;
+	const uint32_t nsamp = (uint32_t)*sampc;
 	int status = 0;
-	if (*sampc == wr->nsamp) {
-		status = WebRtcAec_BufferFarend(wr->AEC_inst, sampv, wr->nsamp);
-		if(status != 0) {
-			print_webrtc_aec_error("WebRtcAec_BufferFarend", wr->AEC_inst);
+	uint32_t i = 0;
+
+	while (i < nsamp) {
+		const uint32_t n = min(wr->block - wr->far_len, nsamp - i);
+
+		memcpy(&wr->far_blk[wr->far_len], &sampv[i], 2 * n);
+		wr->far_len += n;
+		i += n;
+
+		if (wr->far_len == wr->block) {
+			const int16_t *far = wr->far_blk;
+			int16_t low[AEC_BAND_LEN], high[AEC_BAND_LEN];
+			int16_t n_far = (int16_t)wr->block;
+
+			/* far-end is referenced in low band only */
+			if (wr->srate == 32000) {
+				WebRtcSpl_AnalysisQMF(wr->far_blk, low, high,
+					wr->far_ana1, wr->far_ana2);
+				far = low;
+				n_far = AEC_BAND_LEN;
+			}
+
+			if (WebRtcAec_BufferFarend(wr->AEC_inst, far, n_far)) {
+				print_webrtc_aec_error("WebRtcAec_BufferFarend",
+					wr->AEC_inst);
+				status = EFAULT;
+			}
+			wr->far_len = 0;
 		}
-	} else if (*sampc) {
-		static int unexpected = 0;
-		unexpected++;
 	}
+
 	return status;
 }
 
@@ -28,6 +28,12 @@
 #include "magic.h"
 
 
+enum {
+	TXCLK_MAX_LATE = 4,  /**< Resync after this many late packets  */
+	TXCLK_HIST_N   = 6   /**< Send-jitter histogram buckets         */
+};
+
+
 /**
  * \page GenericAudioStream Generic Audio Stream
  *
@@ -56,7 +62,13 @@
  */
 
 enum {
-	AUDIO_SAMPSZ    = 3*1920  /* Max samples, 48000Hz 2ch at 60ms */
+	AUDIO_SAMPSZ    = 3*1920, /* Max samples, 48000Hz 2ch at 60ms */
+	RX_PULL_MAX     = 4,      /* Max. frames decoded per auplay period */
+	CN_SRATE        = 8000,   /* RTP clock rate of static CN payload   */
+	CN_HANGOVER     = 200,    /* [ms] Speech sent after VAD goes quiet */
+	CN_SID_INTERVAL = 1000,   /* [ms] Max. time between SID frames     */
+	CN_SID_DELTA    = 3,      /* [dB] Level change that sends a SID    */
+	CN_SID_SIZE     = 16      /* Max. SID payload size                 */
 };
 
 
@@ -99,16 +111,27 @@ struct autx {
 	bool is_g722;                 /**< Set if encoder is G.722 codec   */
 	bool muted;                   /**< Audio source is muted           */
 	int cur_key;                  /**< Currently transmitted event     */
+	struct aucng *cng;            /**< Noise analysis for SID frames   */
+	int pt_cn;                    /**< CN payload type, -1 if no DTX   */
+	bool dtx;                     /**< Silence, only SID frames sent   */
+	uint32_t hangover;            /**< [ms] Silence before DTX starts  */
+	uint32_t ts_sid;              /**< Timestamp of last SID frame     */
+	uint8_t level_sid;            /**< Noise level of last SID frame   */
 
 	union {
 		struct tmr tmr;       /**< Timer for sending RTP packets   */
 #ifdef HAVE_PTHREAD
 		struct {
-			pthread_t tid;/**< Audio transmit thread           */
-			bool run;     /**< Audio transmit thread running   */
+			struct le le; /**< Member of shared TX clock list  */
+			uint64_t next;/**< Absolute deadline of next packet */
+			bool run;     /**< Registered with TX clock        */
 		} thr;
 #endif
 	} u;
+
+	/** Send jitter histogram (lateness vs. deadline) for TX clock,
+	    buckets 0, 1, 2-3, 4-7, 8-15 and 16+ ms */
+	uint32_t jitter_hist[TXCLK_HIST_N];
 };
 
 
@@ -125,6 +148,7 @@ struct autx {
  |/    |        |   |       |   |        |   |        |   |        |
        '--------'   '-------'   '--------'   '--------'   '--------'
 
+ 	clocked by: rtp, or auplay in pull mode (jitter buffer before decode)
  \endverbatim
  */
 struct aurx {
@@ -134,6 +158,7 @@ struct aurx {
 	struct audec_state *dec;      /**< Audio decoder state (optional)  */
 	struct aubuf *ab;             /**< Incoming audio buffer           */
 	struct auresamp *resamp;      /**< Optional resampler for DSP      */
+	struct auplc *plc;            /**< Loss concealment if codec has none */
 	struct list filtl;            /**< Audio filters in decoding order */
     char mod[32];
 	char device[128];
@@ -142,6 +167,10 @@ struct aurx {
 	uint32_t ptime;               /**< Packet time for receiving       */
 	int pt;                       /**< Payload type for incoming RTP   */
 	int pt_tel;                   /**< Event payload type - receive    */
+	bool pull;                    /**< Decode on the playout clock     */
+	struct lock *lock;            /**< Decoder in pull mode, CN state  */
+	struct aucng *cng;            /**< Comfort noise generator         */
+	bool cn_active;               /**< Sender is in DTX, play CN       */
 };
 
 
@@ -177,6 +206,10 @@ static void audio_destructor(void *arg)
 	mem_deref(a->tx.resamp);
 	mem_deref(a->rx.sampv_rs);
 	mem_deref(a->rx.resamp);
+	mem_deref(a->rx.plc);
+	mem_deref(a->rx.lock);
+	mem_deref(a->tx.cng);
+	mem_deref(a->rx.cng);
 
 	list_flush(&a->tx.filtl);
 	list_flush(&a->rx.filtl);
@@ -304,22 +337,102 @@ static void encode_rtp_send(struct audio *a, struct autx *tx,
 }
 
 
+/*
+ * Discontinuous transmission with Comfort Noise (RFC 3389). Speech is
+ * sent for a short hangover after the VAD went quiet, then only SID
+ * frames: one at the start, then on a noise level change, or when the
+ * last one is CN_SID_INTERVAL old. The RTP timestamp keeps running, and
+ * the first packet of the next talkspurt has the marker bit set.
+ *
+ * @note This function has REAL-TIME properties
+ *
+ * @return true if the frame was replaced by DTX
+ */
+static bool autx_dtx(struct audio *a, struct autx *tx, bool speech,
+		     const int16_t *sampv, size_t sampc)
+{
+	const uint32_t ts_sid = CN_SID_INTERVAL * (CN_SRATE / 1000);
+	uint8_t level;
+	size_t len;
+	bool send;
+	int err;
+
+	if (tx->pt_cn < 0 || !tx->cng)
+		return false;
+
+	if (speech) {
+		if (tx->dtx)
+			tx->marker = true;
+
+		tx->dtx = false;
+		tx->hangover = 0;
+
+		return false;
+	}
+
+	aucng_analyse(tx->cng, sampv, sampc);
+
+	if (!tx->dtx) {
+
+		tx->hangover += tx->ptime;
+		if (tx->hangover < CN_HANGOVER)
+			return false;
+
+		tx->dtx = true;
+		send = true;
+	}
+	else {
+		level = aucng_level(tx->cng);
+
+		send = (tx->ts - tx->ts_sid >= ts_sid) ||
+			(level > tx->level_sid + CN_SID_DELTA) ||
+			(level + CN_SID_DELTA < tx->level_sid);
+	}
+
+	if (send) {
+
+		tx->mb->pos = tx->mb->end = STREAM_PRESZ;
+		len = min(mbuf_get_space(tx->mb), (size_t)CN_SID_SIZE);
+
+		err = aucng_sid_encode(tx->cng, mbuf_buf(tx->mb), &len);
+		if (!err) {
+			tx->mb->end = STREAM_PRESZ + len;
+			err = stream_send(a->strm, false, tx->pt_cn, tx->ts,
+					  tx->mb);
+		}
+		if (err) {
+			DEBUG_WARNING("send SID: %m\n", err);
+		}
+
+		tx->ts_sid    = tx->ts;
+		tx->level_sid = aucng_level(tx->cng);
+	}
+
+	tx->ts += (uint32_t)(tx->is_g722 ? sampc/2 : sampc);
+
+	return true;
+}
+
+
 /*
  * @note This function has REAL-TIME properties
+ *
+ * @return true if one packet time was taken from the audio buffer
  */
-static void poll_aubuf_tx(struct audio *a)
+static bool poll_aubuf_tx(struct audio *a)
 {
 	struct autx *tx = &a->tx;
 	int16_t *sampv = tx->sampv;
 	size_t sampc;
 	struct le *le;
+	bool speech = true;
 	int err = 0;
 
 	sampc = tx->psize / 2;
 
 	/* timed read from audio-buffer */
 	if (aubuf_get_samp(tx->ab, tx->ptime, tx->sampv, sampc))
-		return;
+		return false;
 
 	/* optional resampler */
 	if (tx->resamp) {
@@ -329,7 +442,7 @@ static void poll_aubuf_tx(struct audio *a)
 				       tx->sampv_rs, &sampc_rs,
 				       tx->sampv, sampc);
 		if (err)
-			return;
+			return true;
 
 		sampv = tx->sampv_rs;
 		sampc = sampc_rs;
@@ -339,12 +452,24 @@ static void poll_aubuf_tx(struct audio *a)
 	for (le = tx->filtl.head; le; le = le->next) {
 		struct aufilt_enc_st *st = le->data;
 
-		if (st->af && st->af->ench)
-			err |= st->af->ench(st, sampv, &sampc);
+		if (st->af && st->af->ench) {
+			const int ferr = st->af->ench(st, sampv, &sampc);
+
+			/* frame without speech, as found by a VAD filter */
+			if (ferr == ENODATA)
+				speech = false;
+			else
+				err |= ferr;
+		}
 	}
 
+	if (autx_dtx(a, tx, speech, sampv, sampc))
+		return true;
+
 	/* Encode and send */
 	encode_rtp_send(a, tx, sampv, sampc);
+
+	return true;
 }
 
 
@@ -375,29 +500,6 @@ static void check_telev(struct audio *a, struct autx *tx)
 }
 
 
-/**
- * Write samples to Audio Player.
- *
- * @note This function has REAL-TIME properties
- *
- * @note The application is responsible for filling in silence in
- *       the case of underrun
- *
- * @note This function may be called from any thread
- *
- * @return true for valid audio samples, false for silence
- */
-static bool auplay_write_handler(uint8_t *buf, size_t sz, void *arg)
-{
-	struct audio *a = arg;
-	struct aurx *rx = &a->rx;
-
-	aubuf_read(rx->ab, buf, sz);
-
-	return true;
-}
-
-
 /**
  * Read samples from Audio Source
  *
@@ -483,6 +585,12 @@ static int aurx_stream_decode(struct aurx *rx, struct mbuf *mb)
 	if (!rx->ac)
 		return 0;
 
+	/* the sender is in DTX, comfort noise fills the gap */
+	if (!mbuf_get_left(mb) && rx->cn_active)
+		return 0;
+
+	rx->cn_active = false;
+
 	if (mbuf_get_left(mb)) {
 		err = rx->ac->dech(rx->dec, rx->sampv, &sampc,
 				   mbuf_buf(mb), mbuf_get_left(mb));
@@ -490,6 +598,10 @@ static int aurx_stream_decode(struct aurx *rx, struct mbuf *mb)
 	else if (rx->ac->plch) {
 		err = rx->ac->plch(rx->dec, rx->sampv, &sampc);
 	}
+	else if (rx->plc) {
+		/* no PLC in the codec, synthesize from the decoded history */
+		err = auplc_conceal(rx->plc, rx->sampv, &sampc);
+	}
 	else {
 		/* no PLC in the codec, might be done in filters below */
 		sampc = 0;
@@ -501,6 +613,9 @@ static int aurx_stream_decode(struct aurx *rx, struct mbuf *mb)
 		goto out;
 	}
 
+	if (rx->plc && mbuf_get_left(mb))
+		auplc_update(rx->plc, rx->sampv, sampc);
+
 	/* Process exactly one audio-frame in reverse list order */
 	for (le = rx->filtl.tail; le; le = le->prev) {
 		struct aufilt_dec_st *st = le->data;
@@ -537,6 +652,27 @@ static int aurx_stream_decode(struct aurx *rx, struct mbuf *mb)
 }
 
 
+/* SID frame, play comfort noise until the next talkspurt */
+static void aurx_cn(struct aurx *rx, struct mbuf *mb)
+{
+	if (!rx->cng)
+		return;
+
+	if (!aucng_sid_decode(rx->cng, mbuf_buf(mb), mbuf_get_left(mb)))
+		rx->cn_active = true;
+}
+
+
+static void handle_cn(struct audio *a, struct mbuf *mb)
+{
+	struct aurx *rx = &a->rx;
+
+	lock_write_get(rx->lock);
+	aurx_cn(rx, mb);
+	lock_rel(rx->lock);
+}
+
+
 /* Handle incoming stream data from the network */
 static void stream_recv_handler(const struct rtp_header *hdr,
 				struct mbuf *mb, void *arg)
@@ -555,8 +691,10 @@ static void stream_recv_handler(const struct rtp_header *hdr,
 	}
 
 	/* Comfort Noise (CN) as of RFC 3389 */
-	if (PT_CN == hdr->pt)
+	if (PT_CN == hdr->pt) {
+		handle_cn(a, mb);
 		return;
+	}
 
 	/* Audio payload-type changed? */
 	/* XXX: this logic should be moved to stream.c */
@@ -567,11 +705,85 @@ static void stream_recv_handler(const struct rtp_header *hdr,
 			return;
 	}
 
+	/* the player thread decodes the frame from the jitter buffer */
+	if (rx->pull)
+		return;
+
  out:
 	(void)aurx_stream_decode(&a->rx, mb);
 }
 
 
+/*
+ * Pull mode: decode frames from the jitter buffer until the player has
+ * enough audio for this period
+ */
+static void aurx_pull(struct audio *a, size_t sz)
+{
+	struct aurx *rx = &a->rx;
+	unsigned i;
+
+	lock_write_get(rx->lock);
+
+	for (i=0; i<RX_PULL_MAX && aubuf_cur_size(rx->ab) < sz; i++) {
+
+		struct rtp_header hdr;
+		struct mbuf *mb;
+
+		if (stream_jbuf_poll(a->strm, &hdr, &mb))
+			break;
+
+		/* SID frames come through the jitter buffer in sequence */
+		if (mb && hdr.pt == PT_CN)
+			aurx_cn(rx, mb);
+
+		/* frames queued before a payload type change are dropped */
+		else if (!mb || hdr.pt == rx->pt)
+			(void)aurx_stream_decode(rx, mb);
+
+		mem_deref(mb);
+	}
+
+	lock_rel(rx->lock);
+}
+
+
+/**
+ * Write samples to Audio Player.
+ *
+ * @note This function has REAL-TIME properties
+ *
+ * @note The application is responsible for filling in silence in
+ *       the case of underrun
+ *
+ * @note This function may be called from any thread
+ *
+ * @return true for valid audio samples, false for silence
+ */
+static bool auplay_write_handler(uint8_t *buf, size_t sz, void *arg)
+{
+	struct audio *a = arg;
+	struct aurx *rx = &a->rx;
+
+	if (rx->pull)
+		aurx_pull(a, sz);
+
+	/* comfort noise, once the decoded audio has run out */
+	if (rx->cn_active && aubuf_cur_size(rx->ab) < sz) {
+
+		lock_write_get(rx->lock);
+		aucng_generate(rx->cng, (int16_t *)buf, sz / 2);
+		lock_rel(rx->lock);
+
+		return true;
+	}
+
+	aubuf_read(rx->ab, buf, sz);
+
+	return true;
+}
+
+
 static int add_telev_codec(struct audio *a)
 {
 	struct sdp_media *m = stream_sdpmedia(audio_strm(a));
@@ -592,6 +804,16 @@ static int add_telev_codec(struct audio *a)
 }
 
 
+/* Offer Comfort Noise (RFC 3389) at the static payload type */
+static int add_cn_codec(struct audio *a)
+{
+	struct sdp_media *m = stream_sdpmedia(audio_strm(a));
+
+	return sdp_format_add(NULL, m, false, "13", "CN", CN_SRATE, 1,
+			      NULL, NULL, NULL, false, NULL);
+}
+
+
 int audio_alloc(struct audio **ap, const struct config *cfg,
 		struct call *call, struct sdp_session *sdp_sess, int label,
 		const struct mnat *mnat, struct mnat_sess *mnat_sess,
@@ -629,6 +851,14 @@ int audio_alloc(struct audio **ap, const struct config *cfg,
 		stream_set_bw(a->strm, AUDIO_BANDWIDTH);
 	}
 
+	err = lock_alloc(&rx->lock);
+	if (err)
+		goto out;
+
+	/* decoding on the playout clock needs the jitter buffer */
+	if (cfg->avt.rtp_rxpull)
+		rx->pull = (0 == stream_set_pull(a->strm, true, -1));
+
 	err = sdp_media_set_lattr(stream_sdpmedia(a->strm), true,
 				  "ptime", "%u", ptime);
 	if (err)
@@ -657,10 +887,19 @@ int audio_alloc(struct audio **ap, const struct config *cfg,
 	if (err)
 		goto out;
 
+	/* DTX needs a VAD in the encoding filter chain */
+	if (cfg->audio_preproc_tx.enabled &&
+	    cfg->audio_preproc_tx.vad_enabled) {
+		err = add_cn_codec(a);
+		if (err)
+			goto out;
+	}
+
 	str_ncpy(tx->device, a->cfg.src_dev, sizeof(tx->device));
 	tx->ptime  = ptime;
 	tx->ts     = rand_u16();
 	tx->marker = true;
+	tx->pt_cn  = -1;
 
 	str_ncpy(rx->device, a->cfg.play_dev, sizeof(rx->device));
 	rx->pt     = -1;
@@ -736,6 +975,7 @@ int audio_alloc2(struct audio **ap, const struct config *cfg,
 	tx->ptime  = ptime;
 	tx->ts     = rand_u16();
 	tx->marker = true;
+	tx->pt_cn  = -1;
 
 	str_ncpy(rx->device, a->cfg.play_dev, sizeof(rx->device));
 	rx->pt     = -1;
@@ -759,23 +999,167 @@ int audio_alloc2(struct audio **ap, const struct config *cfg,
 
 
 #ifdef HAVE_PTHREAD
-static void *tx_thread(void *arg)
+/*
+ * Shared TX clock
+ *
+ * One thread paces all audio streams in thread mode. It sleeps until
+ * the earliest absolute packet deadline, then encodes and sends every
+ * stream that is due, so the number of wakeups follows the packet rate
+ * instead of a fixed 5 ms poll, and deadlines do not drift.
+ */
+static struct {
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	pthread_t tid;
+	struct list txl;      /**< Registered audio objects            */
+	bool run;
+	bool realtime;
+} txclk = {
+	PTHREAD_MUTEX_INITIALIZER,
+	PTHREAD_COND_INITIALIZER
+};
+
+
+static void txclk_jitter(struct autx *tx, uint64_t late)
 {
-	struct audio *a = arg;
+	unsigned i = 0;
+
+	while (late && i < TXCLK_HIST_N - 1) {
+		late >>= 1;
+		++i;
+	}
+
+	++tx->jitter_hist[i];
+}
+
+
+/* Send all due streams, return the earliest pending deadline */
+static uint64_t txclk_poll(uint64_t now)
+{
+	uint64_t next = now + 1000;
+	struct le *le;
+
+	for (le = txclk.txl.head; le; le = le->next) {
+
+		struct audio *a = le->data;
+		struct autx *tx = &a->tx;
+
+		if (now >= tx->u.thr.next) {
+
+			if (poll_aubuf_tx(a)) {
+
+				txclk_jitter(tx, now - tx->u.thr.next);
+
+				tx->u.thr.next += tx->ptime;
+
+				/* do not burst to catch up after a stall */
+				if (now > tx->u.thr.next +
+				    tx->ptime * TXCLK_MAX_LATE)
+					tx->u.thr.next = now + tx->ptime;
+			}
+			else {
+				/* audio buffer clock is a bit behind */
+				tx->u.thr.next = now + 1;
+			}
+		}
+
+		if (tx->u.thr.next < next)
+			next = tx->u.thr.next;
+	}
+
+	return next;
+}
+
+
+static void *txclk_thread(void *arg)
+{
+	(void)arg;
 
 	/* Enable Real-time mode for this thread, if available */
-	if (a->cfg.txmode == AUDIO_MODE_THREAD_REALTIME)
+	if (txclk.realtime)
 		(void)realtime_enable(true, 1);
 
-	while (a->tx.u.thr.run) {
+	pthread_mutex_lock(&txclk.mutex);
 
-		poll_aubuf_tx(a);
+	while (txclk.run) {
+
+		struct timespec abstime;
+		uint64_t now = tmr_jiffies();
+		uint64_t next, ms;
+
+		next = txclk_poll(now);
 
-		sys_msleep(5);
+		if (next > now) {
+			ms = tmr_jiffies_unix(next);
+			abstime.tv_sec  = (time_t)(ms / 1000);
+			abstime.tv_nsec = (long)(ms % 1000) * 1000000;
+			(void)pthread_cond_timedwait(&txclk.cond,
+						     &txclk.mutex, &abstime);
+		}
 	}
 
+	pthread_mutex_unlock(&txclk.mutex);
+
 	return NULL;
 }
+
+
+static int txclk_register(struct audio *a)
+{
+	struct autx *tx = &a->tx;
+	int err = 0;
+
+	pthread_mutex_lock(&txclk.mutex);
+
+	tx->u.thr.next = tmr_jiffies();
+	tx->u.thr.run  = true;
+	list_append(&txclk.txl, &tx->u.thr.le, a);
+
+	if (!txclk.run) {
+		txclk.run = true;
+		txclk.realtime =
+			a->cfg.txmode == AUDIO_MODE_THREAD_REALTIME;
+		err = pthread_create(&txclk.tid, NULL, txclk_thread, NULL);
+		if (err) {
+			txclk.run = false;
+			list_unlink(&tx->u.thr.le);
+			tx->u.thr.run = false;
+		}
+	}
+	else {
+		/* new stream may be due before current deadline */
+		pthread_cond_signal(&txclk.cond);
+	}
+
+	pthread_mutex_unlock(&txclk.mutex);
+
+	return err;
+}
+
+
+static void txclk_unregister(struct audio *a)
+{
+	struct autx *tx = &a->tx;
+	bool stop = false;
+
+	pthread_mutex_lock(&txclk.mutex);
+
+	/* clock thread holds the mutex while sending, so after this the
+	   stream is not referenced anymore */
+	list_unlink(&tx->u.thr.le);
+	tx->u.thr.run = false;
+
+	if (txclk.run && list_isempty(&txclk.txl)) {
+		txclk.run = false;
+		pthread_cond_signal(&txclk.cond);
+		stop = true;
+	}
+
+	pthread_mutex_unlock(&txclk.mutex);
+
+	if (stop)
+		pthread_join(txclk.tid, NULL);
+}
 #endif
 
 
@@ -785,7 +1169,7 @@ static void timeout_tx(void *arg)
 
 	tmr_start(&a->tx.u.tmr, 5, timeout_tx, a);
 
-	poll_aubuf_tx(a);
+	(void)poll_aubuf_tx(a);
 }
 
 
@@ -957,7 +1341,18 @@ static int start_player(struct aurx *rx, struct audio *a)
 		if (!rx->ab) {
 			const size_t psize = 2 * prm.frame_size;
 
-			err = aubuf_alloc(&rx->ab, psize * 1, psize * 8);
+			err = aubuf_alloc_ring(&rx->ab, psize * 1, psize * 8);
+			if (err)
+				return err;
+		}
+
+		/* comfort noise is generated at the player rate */
+		if (rx->lock) {
+			lock_write_get(rx->lock);
+			rx->cn_active = false;
+			rx->cng = mem_deref(rx->cng);
+			err = aucng_alloc(&rx->cng, prm.srate, prm.ch);
+			lock_rel(rx->lock);
 			if (err)
 				return err;
 		}
@@ -1020,8 +1415,8 @@ static int start_source(struct autx *tx, struct audio *a)
 		tx->psize = 2 * prm.frame_size;
 
 		if (!tx->ab) {
-			err = aubuf_alloc(&tx->ab, tx->psize * 2,
-					  tx->psize * 30);
+			err = aubuf_alloc_ring(&tx->ab, tx->psize * 2,
+					       tx->psize * 30);
 			if (err)
 				return err;
 		}
@@ -1039,13 +1434,9 @@ static int start_source(struct autx *tx, struct audio *a)
 		case AUDIO_MODE_THREAD:
 		case AUDIO_MODE_THREAD_REALTIME:
 			if (!tx->u.thr.run) {
-				tx->u.thr.run = true;
-				err = pthread_create(&tx->u.thr.tid, NULL,
-						     tx_thread, a);
-				if (err) {
-					tx->u.thr.tid = false;
+				err = txclk_register(a);
+				if (err)
 					return err;
-				}
 			}
 			break;
 #endif
@@ -1138,10 +1529,8 @@ void audio_stop(struct audio *a)
 #ifdef HAVE_PTHREAD
 	case AUDIO_MODE_THREAD:
 	case AUDIO_MODE_THREAD_REALTIME:
-		if (tx->u.thr.run) {
-			tx->u.thr.run = false;
-			pthread_join(tx->u.thr.tid, NULL);
-		}
+		if (tx->u.thr.run)
+			txclk_unregister(a);
 		break;
 #endif
 	case AUDIO_MODE_TMR:
@@ -1166,6 +1555,7 @@ void audio_stop(struct audio *a)
 int audio_encoder_set(struct audio *a, const struct aucodec *ac,
 		      int pt_tx, const char *params)
 {
+	const struct sdp_format *fmt;
 	struct autx *tx;
 	int err = 0;
 	bool reset;
@@ -1189,6 +1579,23 @@ int audio_encoder_set(struct audio *a, const struct aucodec *ac,
 		tx->is_g722 = (0 == str_casecmp(ac->name, "G722"));
 		tx->enc = mem_deref(tx->enc);
 		tx->ac = ac;
+		tx->cng = mem_deref(tx->cng);
+	}
+
+	/* DTX if the peer takes CN at the clock rate of this codec */
+	fmt = sdp_media_rformat(stream_sdpmedia(a->strm), "CN");
+	if (fmt && fmt->srate == CN_SRATE && ac->srate == CN_SRATE) {
+
+		if (!tx->cng) {
+			err = aucng_alloc(&tx->cng, get_srate(ac), ac->ch);
+			if (err)
+				return err;
+		}
+
+		tx->pt_cn = fmt->pt;
+	}
+	else {
+		tx->pt_cn = -1;
 	}
 
 	if (ac->encupdh) {
@@ -1228,6 +1635,10 @@ int audio_decoder_set(struct audio *a, const struct aucodec *ac,
 
 	reset = !aucodec_equal(ac, rx->ac);
 
+	/* in pull mode the player thread may be decoding */
+	if (rx->pull)
+		lock_write_get(rx->lock);
+
 	if (ac != rx->ac) {
 
 		(void)re_printf("Set audio decoder: %s %uHz %dch\n",
@@ -1236,16 +1647,31 @@ int audio_decoder_set(struct audio *a, const struct aucodec *ac,
 		rx->pt = pt_rx;
 		rx->ac = ac;
 		rx->dec = mem_deref(rx->dec);
+		rx->plc = mem_deref(rx->plc);
+
+		/* generic concealment for codecs without their own */
+		if (!ac->plch &&
+		    auplc_alloc(&rx->plc, get_srate(ac), ac->ch)) {
+			DEBUG_WARNING("no loss concealment for %s\n",
+				      ac->name);
+		}
 	}
 
 	if (ac->decupdh) {
 		err = ac->decupdh(&rx->dec, ac, params);
 		if (err) {
 			DEBUG_WARNING("alloc decoder: %m\n", err);
-			return err;
 		}
 	}
 
+	if (rx->pull) {
+		(void)stream_set_pull(a->strm, true, rx->pt);
+		lock_rel(rx->lock);
+	}
+
+	if (err)
+		return err;
+
 	stream_set_srate(a->strm, get_srate(ac), get_srate(ac));
 
 	if (reset) {
@@ -1408,6 +1834,15 @@ int audio_debug(struct re_printf *pf, const struct audio *a)
 			  aubuf_debug, rx->ab,
 			  rx->ptime, rx->pt, rx->pt_tel);
 
+	if (a->cfg.txmode == AUDIO_MODE_THREAD ||
+	    a->cfg.txmode == AUDIO_MODE_THREAD_REALTIME) {
+		err |= re_hprintf(pf, " tx send jitter [ms]: 0:%u 1:%u 2-3:%u"
+				  " 4-7:%u 8-15:%u 16+:%u\n",
+				  tx->jitter_hist[0], tx->jitter_hist[1],
+				  tx->jitter_hist[2], tx->jitter_hist[3],
+				  tx->jitter_hist[4], tx->jitter_hist[5]);
+	}
+
 	err |= re_hprintf(pf,
 			  " %H"
 			  " %H",
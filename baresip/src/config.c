@@ -62,7 +62,9 @@ static struct config core_config = {
 		true,
 		false,
 		{5, 10},
-		0
+		JBUF_FIXED,
+		0,
+		false
 	},
 
 	/* recording */
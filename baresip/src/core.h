@@ -298,6 +298,9 @@ int stream_alloc2(struct stream **sp, const struct config_avt *cfg,
 		 stream_rtp_h *rtph, stream_rtcp_h *rtcph, void *arg);		  
 struct sdp_media *stream_sdpmedia(const struct stream *s);
 int  stream_start(struct stream *s);
+int  stream_set_pull(struct stream *s, bool enable, int pt);
+int  stream_jbuf_poll(struct stream *s, struct rtp_header *hdr,
+		      struct mbuf **mbp);
 int  stream_send(struct stream *s, bool marker, int pt, uint32_t ts,
 		 struct mbuf *mb);
 void stream_update(struct stream *s, const char *cname);
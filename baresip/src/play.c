@@ -145,7 +145,8 @@ static int aufile_load(struct mbuf *mb, const char *filename,
 
 	while (!err) {
 		uint8_t buf[4096];
-		size_t i, n;
+		int16_t sampv[4096];
+		size_t n;
 
 		n = sizeof(buf);
 
@@ -160,17 +161,13 @@ static int aufile_load(struct mbuf *mb, const char *filename,
 			break;
 
 		case AUFMT_PCMA:
-			for (i=0; i<n; i++) {
-				err |= mbuf_write_u16(mb,
-						      g711_alaw2pcm(buf[i]));
-			}
+			g711_alaw2pcm_v(sampv, buf, n);
+			err = mbuf_write_mem(mb, (uint8_t *)sampv, n * 2);
 			break;
 
 		case AUFMT_PCMU:
-			for (i=0; i<n; i++) {
-				err |= mbuf_write_u16(mb,
-						      g711_ulaw2pcm(buf[i]));
-			}
+			g711_ulaw2pcm_v(sampv, buf, n);
+			err = mbuf_write_mem(mb, (uint8_t *)sampv, n * 2);
 			break;
 
 		default:
@@ -117,7 +117,8 @@ const struct sdp_format *sdp_media_format_cycle(struct sdp_media *m)
 	list_append(lst, &sf->le, sf);
 
 	sf = (struct sdp_format *)sdp_media_rformat(m, NULL);
-	if (!str_casecmp(sf->name, telev_rtpfmt))
+	if (!str_casecmp(sf->name, telev_rtpfmt) ||
+	    !str_casecmp(sf->name, "CN"))
 		goto again;
 
 	return sf;
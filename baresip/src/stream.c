@@ -19,7 +19,9 @@
 
 
 enum {
-	RTP_RECV_SIZE    = 8192,  /**< Receive buffer for incoming RTP     */
+	RTP_RECV_SIZE    = 2048,  /**< Receive buffer for incoming RTP     */
+	RTP_RXPOOL_SIZE  = 8,     /**< Number of recycled receive buffers  */
+	RTP_PLC_MAX      = 3,     /**< Max. concealed frames per gap       */
 	RTP_CHECK_INTERVAL = 1000  /* how often to check for RTP [ms] */
 };
 
@@ -44,6 +46,12 @@ struct stream {
 	bool rtcp;               /**< Enable RTCP                           */
 	bool rtcp_mux;           /**< RTP/RTCP multiplex supported by peer  */
 	bool jbuf_started;
+	bool pull;               /**< Decode on the playout clock           */
+	int pt_pull;             /**< Payload type queued in pull mode      */
+	struct mbuf *mb_pull;    /**< Frame held back while gap is concealed*/
+	struct rtp_header hdr_pull; /**< RTP header of held back frame     */
+	int lostc_pull;          /**< Lost frames still to be concealed     */
+	uint32_t plc_pull;       /**< Concealed frames since buffer ran dry */
 	stream_rtp_h *rtph;      /**< Stream RTP handler                    */
 	stream_rtcp_h *rtcph;    /**< Stream RTCP handler                   */
 	void *arg;               /**< Handler argument                      */
@@ -148,6 +156,17 @@ static inline int lostcalc(struct stream *s, uint16_t seq)
 }
 
 
+/* Let the decoder conceal each lost frame, up to RTP_PLC_MAX */
+static void conceal_lost(struct stream *s, const struct rtp_header *hdr,
+			 int lostc)
+{
+	int i;
+
+	for (i=0; i<lostc && i<RTP_PLC_MAX; i++)
+		s->rtph(hdr, NULL, s->arg);
+}
+
+
 static void stream_destructor(void *arg)
 {
 	struct stream *s = arg;
@@ -160,6 +179,7 @@ static void stream_destructor(void *arg)
 	mem_deref(s->mes);
 	mem_deref(s->mencs);
 	mem_deref(s->mns);
+	mem_deref(s->mb_pull);
 	mem_deref(s->jbuf);
 	mem_deref(s->rtp);
 }
@@ -195,7 +215,30 @@ static void rtp_recv(const struct sa *src, const struct rtp_header *hdr,
 		s->ssrc_rx = hdr->ssrc;
 	}
 
-	if (s->jbuf) {
+	if (s->jbuf && s->pull) {
+
+		/* media frames and comfort noise are queued for the player,
+		   so that a SID frame takes effect after the speech before
+		   it. Events and payload type changes are handled here */
+		if (hdr->pt != s->pt_pull && hdr->pt != PT_CN) {
+
+			s->rtph(hdr, mb, s->arg);
+
+			if (hdr->pt != s->pt_pull)
+				return;
+		}
+
+		if (flush)
+			jbuf_flush(s->jbuf);
+
+		err = jbuf_put(s->jbuf, hdr, mb);
+		if (err) {
+			(void)re_printf("%s: dropping %u bytes from %J (%m)\n",
+					sdp_media_name(s->sdp), mb->end,
+					src, err);
+		}
+	}
+	else if (s->jbuf) {
 
 		struct rtp_header hdr2;
 		void *mb2 = NULL;
@@ -221,16 +264,15 @@ static void rtp_recv(const struct sa *src, const struct rtp_header *hdr,
 
 		s->jbuf_started = true;
 
-		if (lostcalc(s, hdr2.seq) > 0)
-			s->rtph(hdr, NULL, s->arg);
+		if (mb2)
+			conceal_lost(s, hdr, lostcalc(s, hdr2.seq));
 
 		s->rtph(&hdr2, mb2, s->arg);
 
 		mem_deref(mb2);
 	}
 	else {
-		if (lostcalc(s, hdr->seq) > 0)
-			s->rtph(hdr, NULL, s->arg);
+		conceal_lost(s, hdr, lostcalc(s, hdr->seq));
 
 		s->rtph(hdr, mb, s->arg);
 	}
@@ -271,6 +313,7 @@ static int stream_sock_alloc(struct stream *s, int af)
 			     &tos, sizeof(tos));
 
 	udp_rxsz_set(rtp_sock(s->rtp), RTP_RECV_SIZE);
+	udp_rxpool_set(rtp_sock(s->rtp), RTP_RXPOOL_SIZE);
 
 	return 0;
 }
@@ -340,6 +383,8 @@ int stream_alloc(struct stream **sp, const struct config_avt *cfg,
 				 cfg->jbuf_del.max);
 		if (err)
 			goto out;
+
+		(void)jbuf_set_type(s->jbuf, cfg->jbtype);
 	}
 
 	err = sdp_media_add(&s->sdp, sdp_sess, name,
@@ -433,6 +478,8 @@ int stream_alloc2(struct stream **sp, const struct config_avt *cfg,
 				 cfg->jbuf_del.max);
 		if (err)
 			goto out;
+
+		(void)jbuf_set_type(s->jbuf, cfg->jbtype);
 	}
 #if 0
 	err = sdp_media_add(&s->sdp, sdp_sess, name,
@@ -536,6 +583,109 @@ int stream_send(struct stream *s, bool marker, int pt, uint32_t ts,
 }
 
 
+/**
+ * Decode incoming RTP on the playout clock. In pull mode the receive
+ * path only queues packets of one payload type in the jitter buffer, and
+ * the player takes them out with stream_jbuf_poll(). Packets of other
+ * payload types are passed to the RTP handler as before.
+ *
+ * @param s      Stream object
+ * @param enable True to enable pull mode
+ * @param pt     Payload type to queue, -1 if not known yet
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int stream_set_pull(struct stream *s, bool enable, int pt)
+{
+	if (!s)
+		return EINVAL;
+
+	if (enable && !s->jbuf)
+		return ENOENT;
+
+	if (enable != s->pull)
+		jbuf_set_pull(s->jbuf, enable);
+
+	s->pull    = enable;
+	s->pt_pull = pt;
+
+	return 0;
+}
+
+
+/**
+ * Take the next frame to play from the jitter buffer, in pull mode.
+ * Every lost frame still takes one playout slot and is returned with
+ * no payload, so that the decoder can conceal it.
+ *
+ * @param s    Stream object
+ * @param hdr  Returned RTP header
+ * @param mbp  Returned frame (referenced), or NULL to conceal one frame
+ *
+ * @return 0 if success, ENOENT if there is nothing to play
+ *
+ * @note Called from the audio player thread
+ */
+int stream_jbuf_poll(struct stream *s, struct rtp_header *hdr,
+		     struct mbuf **mbp)
+{
+	void *mb = NULL;
+	int lostc;
+
+	if (!s || !hdr || !mbp)
+		return EINVAL;
+
+	*mbp = NULL;
+
+	if (!s->jbuf)
+		return ENOENT;
+
+	/* frame held back until the gap before it was concealed */
+	if (s->mb_pull) {
+
+		*hdr = s->hdr_pull;
+
+		if (s->lostc_pull > 0) {
+			--s->lostc_pull;
+			return 0;
+		}
+
+		*mbp = s->mb_pull;
+		s->mb_pull = NULL;
+
+		return 0;
+	}
+
+	if (jbuf_get(s->jbuf, hdr, &mb)) {
+
+		/* buffer ran dry, conceal a few frames then go silent */
+		if (!s->jbuf_started || s->plc_pull >= RTP_PLC_MAX)
+			return ENOENT;
+
+		++s->plc_pull;
+		memset(hdr, 0, sizeof(*hdr));
+
+		return 0;
+	}
+
+	s->jbuf_started = true;
+	s->plc_pull = 0;
+
+	lostc = lostcalc(s, hdr->seq);
+	if (lostc > 0) {
+		s->hdr_pull   = *hdr;
+		s->mb_pull    = mb;
+		s->lostc_pull = min(lostc, RTP_PLC_MAX) - 1;
+
+		return 0;
+	}
+
+	*mbp = mb;
+
+	return 0;
+}
+
+
 static void stream_remote_set(struct stream *s, const char *cname)
 {
 	struct sa rtcp;
@@ -614,9 +764,11 @@ int stream_jbuf_stat(struct re_printf *pf, const struct stream *s)
 		err = re_hprintf(pf, "Jbuf stat: (not available)");
 	}
 	else {
-		err = re_hprintf(pf, "Jbuf stat: put=%u get=%u or=%u ur=%u",
+		err = re_hprintf(pf, "Jbuf stat: put=%u get=%u or=%u ur=%u"
+				  " skip=%u wish=%u jitter=%ums",
 				  stat.n_put, stat.n_get,
-				  stat.n_overflow, stat.n_underflow);
+				  stat.n_overflow, stat.n_underflow,
+				  stat.n_skip, stat.wish, stat.jitter);
 	}
 
 	return err;
@@ -638,6 +790,7 @@ void stream_set_srate(struct stream *s, uint32_t srate_tx, uint32_t srate_rx)
 		return;
 
 	rtcp_set_srate(s->rtp, srate_tx, srate_rx);
+	jbuf_set_srate(s->jbuf, srate_rx);
 }
 
 
@@ -198,6 +198,15 @@ struct dnsc_conf {
 	bool udp_conn;
 };
 
+/** DNS Client cache statistics */
+struct dnsc_cache_stat {
+	uint32_t entries;     /**< Number of cached answers        */
+	uint32_t hits;        /**< Answers served from the cache   */
+	uint32_t stale_hits;  /**< Expired answers served, refresh */
+	uint32_t misses;      /**< Queries sent to the network     */
+	uint32_t evictions;   /**< Entries evicted by size limit   */
+};
+
 int  dnsc_alloc(struct dnsc **dcpp, const struct dnsc_conf *conf,
 		const struct sa *srvv, uint32_t srvc);
 int  dnsc_srv_set(struct dnsc *dnsc, const struct sa *srvv, uint32_t srvc);
@@ -212,6 +221,11 @@ int  dnsc_notify(struct dns_query **qp, struct dnsc *dnsc, const char *name,
 		 uint16_t type, uint16_t dnsclass, const struct dnsrr *ans_rr,
 		 int proto, const struct sa *srvv, const uint32_t *srvc,
 		 dns_query_h *qh, void *arg);
+int  dnsc_cache_max(struct dnsc *dnsc, uint32_t max);
+void dnsc_cache_flush(struct dnsc *dnsc);
+int  dnsc_cache_stat_get(const struct dnsc *dnsc,
+			 struct dnsc_cache_stat *stat);
+int  dnsc_cache_debug(struct re_printf *pf, const struct dnsc *dnsc);
 
 
 /* DNS System functions */
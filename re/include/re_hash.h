@@ -7,9 +7,33 @@
 
 struct hash;
 struct pl;
+struct re_printf;
+
+
+/**
+ * Defines the hash key handler, used by automatic resizing to move
+ * elements to their new bucket
+ *
+ * @param le List element
+ *
+ * @return Hash key of the element
+ */
+typedef uint32_t (hash_key_h)(const struct le *le);
+
+/** Hashmap table statistics */
+struct hash_stat {
+	uint32_t bsize;      /**< Bucket size                        */
+	uint32_t nelem;      /**< Number of elements                 */
+	uint32_t nused;      /**< Number of non-empty buckets        */
+	uint32_t chain_max;  /**< Longest bucket chain               */
+	uint32_t load;       /**< Load factor in percent             */
+	uint32_t resizes;    /**< Number of completed resizes        */
+	bool rehashing;      /**< Incremental rehash in progress     */
+};
 
 
 int  hash_alloc(struct hash **hp, uint32_t bsize);
+int  hash_autosize(struct hash *h, hash_key_h *keyh);
 void hash_append(struct hash *h, uint32_t key, struct le *le, void *data);
 void hash_unlink(struct le *le);
 struct le *hash_lookup(const struct hash *h, uint32_t key, list_apply_h *ah,
@@ -20,6 +44,8 @@ uint32_t hash_bsize(const struct hash *h);
 void hash_flush(struct hash *h);
 void hash_clear(struct hash *h);
 uint32_t hash_valid_size(uint32_t size);
+int  hash_stat_get(const struct hash *h, struct hash_stat *stat);
+int  hash_debug(struct re_printf *pf, const struct hash *h);
 
 
 /* Hash functions */
@@ -6,6 +6,12 @@
 struct jbuf;
 struct rtp_header;
 
+/** Jitter buffer type */
+enum jbuf_type {
+	JBUF_FIXED = 0,  /**< Fixed delay of min frames                 */
+	JBUF_ADAPTIVE,   /**< Delay follows measured jitter, min .. max */
+};
+
 /** Jitter buffer statistics */
 struct jbuf_stat {
 	uint32_t n_put;        /**< Number of frames put into jitter buffer */
@@ -17,6 +23,10 @@ struct jbuf_stat {
 	uint32_t n_overflow;   /**< Number of overflows                     */
 	uint32_t n_underflow;  /**< Number of underflows                    */
 	uint32_t n_flush;      /**< Number of times jitter buffer flushed   */
+	uint32_t n_skip;       /**< Frames dropped to lower the delay       */
+	uint32_t wish;         /**< Current target delay in [frames]        */
+	uint32_t jitter;       /**< Interarrival jitter in [ms]             */
+	uint32_t jitter_p95;   /**< 95th percentile delay variation [ms]    */
 };
 
 
@@ -24,5 +34,8 @@ int  jbuf_alloc(struct jbuf **jbp, uint32_t min, uint32_t max);
 int  jbuf_put(struct jbuf *jb, const struct rtp_header *hdr, void *mem);
 int  jbuf_get(struct jbuf *jb, struct rtp_header *hdr, void **mem);
 void jbuf_flush(struct jbuf *jb);
+int  jbuf_set_type(struct jbuf *jb, enum jbuf_type jbtype);
+void jbuf_set_srate(struct jbuf *jb, uint32_t srate);
+void jbuf_set_pull(struct jbuf *jb, bool pull);
 int  jbuf_stats(const struct jbuf *jb, struct jbuf_stat *jstat);
 int  jbuf_debug(struct re_printf *pf, const struct jbuf *jb);
@@ -44,6 +44,7 @@ void  libre_close(void);
 
 int   re_main(re_signal_h *signalh, control_poll_callback_h *controlh);
 void  re_cancel(void);
+void  re_wakeup(void);
 int   re_debug(struct re_printf *pf, void *unused);
 
 int  re_thread_init(void);
@@ -38,6 +38,7 @@ void     mem_threshold_set(ssize_t n);
 struct re_printf;
 int      mem_status(struct re_printf *pf, void *unused);
 int      mem_get_stat(struct memstat *mstat);
+void     mem_pool_flush(void);
 
 #endif
 
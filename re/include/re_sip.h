@@ -232,7 +232,6 @@ struct sip_msg {
 	struct pl expires;
 	struct pl ctype;
 	struct pl clen;
-	struct hash *hdrht;
 	struct mbuf mb_msg;
 	struct mbuf *mb;
 	void *sock;
@@ -359,6 +358,7 @@ bool sip_dialog_cmp_half(const struct sip_dialog *dlg,
 
 /* msg */
 int sip_msg_decode(struct sip_msg **msgp, struct mbuf *mb);
+uint64_t sip_msg_tag(const struct sip_msg *msg);
 const struct sip_hdr *sip_msg_hdr(const struct sip_msg *msg,
 				  enum sip_hdrid id);
 const struct sip_hdr *sip_msg_hdr_apply(const struct sip_msg *msg,
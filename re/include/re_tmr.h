@@ -20,10 +20,35 @@ struct tmr {
 	uint64_t jfs;       /**< Jiffies for timeout */
 };
 
+/** Timer wheel geometry */
+enum {
+	TMR_WHEEL_BITS   = 6,                     /**< Bits per level   */
+	TMR_WHEEL_SIZE   = 1 << TMR_WHEEL_BITS,   /**< Slots per level  */
+	TMR_WHEEL_LEVELS = 4                      /**< Number of levels */
+};
+
+/**
+ * Defines a hierarchical timer wheel (one per thread). Each level has
+ * TMR_WHEEL_SIZE slots, so the wheel covers 2^24 ms (~4.6 hours) with
+ * O(1) insert and cancel. Timers beyond that range are parked in a
+ * separate list and re-inserted whenever the top level wraps.
+ */
+struct tmrl {
+	struct list wheel[TMR_WHEEL_LEVELS][TMR_WHEEL_SIZE]; /**< Slots    */
+	uint64_t bm[TMR_WHEEL_LEVELS]; /**< Bitmap of non-empty slots     */
+	struct list expired;           /**< Timers due for expiry         */
+	struct list far;               /**< Timers beyond the wheel range */
+	uint64_t jfs;                  /**< Current wheel time [ms]       */
+};
+
+/** Timer wheel Initializer */
+#define TMRL_INIT {{{LIST_INIT}}, {0}, LIST_INIT, LIST_INIT, 0}
+
 
-void     tmr_poll(struct list *tmrl);
+void     tmr_poll(struct tmrl *tmrl);
 uint64_t tmr_jiffies(void);
-uint64_t tmr_next_timeout(struct list *tmrl);
+uint64_t tmr_jiffies_unix(uint64_t jfs);
+uint64_t tmr_next_timeout(struct tmrl *tmrl);
 void     tmr_debug(void);
 int      tmr_status(struct re_printf *pf, void *unused);
 
@@ -24,12 +24,16 @@ int  udp_listen(struct udp_sock **usp, const struct sa *local,
 void udp_connect(struct udp_sock *us, bool conn);
 int  udp_send(struct udp_sock *us, const struct sa *dst, struct mbuf *mb);
 int  udp_send_anon(const struct sa *dst, struct mbuf *mb);
+int  udp_send_queue(struct udp_sock *us, const struct sa *dst,
+		    struct mbuf *mb);
+int  udp_send_flush(struct udp_sock *us);
 int  udp_local_get(const struct udp_sock *us, struct sa *local);
 int  udp_setsockopt(struct udp_sock *us, int level, int optname,
 		    const void *optval, uint32_t optlen);
 int  udp_sockbuf_set(struct udp_sock *us, int size);
 void udp_rxsz_set(struct udp_sock *us, size_t rxsz);
 void udp_rxbuf_presz_set(struct udp_sock *us, size_t rx_presz);
+void udp_rxpool_set(struct udp_sock *us, uint32_t n);
 void udp_handler_set(struct udp_sock *us, udp_recv_h *rh, void *arg);
 int  udp_thread_attach(struct udp_sock *us);
 void udp_thread_detach(struct udp_sock *us);
@@ -18,6 +18,10 @@ enum {
 	CONN_TIMEOUT = 10 * 1000,
 	IDLE_TIMEOUT = 30 * 1000,
 	SRVC_MAX = 32,
+	CACHE_HASH_SIZE = 32,
+	CACHE_MAX = 128,
+	CACHE_TTL_MAX = 24 * 3600,   /* [s]  */
+	CACHE_STALE = 60 * 1000,     /* [ms] */
 };
 
 
@@ -34,6 +38,20 @@ struct tcpconn {
 };
 
 
+struct dns_cache {
+	struct le he;          /* hash element */
+	struct le le;          /* LRU list element, most recent last */
+	struct dnshdr hdr;
+	struct mbuf *mb;       /* copy of reply message */
+	size_t rrpos;          /* start of resource records in mb */
+	char *name;
+	uint64_t expires;
+	struct dns_query *refq;
+	uint16_t type;
+	uint16_t dnsclass;
+};
+
+
 struct dns_query {
 	struct le le;
 	struct le le_tc;
@@ -43,6 +61,7 @@ struct dns_query {
 	char *name;
 	const struct sa *srvv;
 	const uint32_t *srvc;
+	struct dns_cache *ce;  /* cached reply being served */
 	struct tcpconn *tc;
 	struct dnsc *dnsc;     /* parent  */
 	struct dns_query **qp; /* app ref */
@@ -68,6 +87,11 @@ struct dnsc {
 	struct dnsc_conf conf;
 	struct hash *ht_query;
 	struct hash *ht_tcpconn;
+	struct hash *ht_cache;
+	struct list cachel;
+	struct dnsc_cache_stat cstat;
+	uint32_t cache_max;
+	bool refreshing;
 	struct udp_sock *us;
 	struct sa srvv[SRVC_MAX];
 	uint32_t srvc;
@@ -120,6 +144,7 @@ static void query_destructor(void *data)
 	query_abort(q);
 	mbuf_reset(&q->mb);
 	mem_deref(q->name);
+	mem_deref(q->ce);
 
 	for (i=0; i<ARRAY_SIZE(q->rrlv); i++)
 		(void)list_apply(&q->rrlv[i], true, rr_unlink_handler, NULL);
@@ -145,6 +170,14 @@ static void query_handler(struct dns_query *q, int err,
 }
 
 
+static uint32_t query_key(const struct le *le)
+{
+	const struct dns_query *q = le->data;
+
+	return hash_joaat_str_ci(q->name);
+}
+
+
 static bool query_close_handler(struct le *le, void *arg)
 {
 	struct dns_query *q = le->data;
@@ -181,11 +214,247 @@ static bool query_cmp_handler(struct le *le, void *arg)
 }
 
 
+static void cache_destructor(void *data)
+{
+	struct dns_cache *e = data;
+
+	hash_unlink(&e->he);
+	list_unlink(&e->le);
+	mem_deref(e->refq);
+	mem_deref(e->mb);
+	mem_deref(e->name);
+}
+
+
+/* Remove entry from the cache, pending queries may still reference it */
+static void cache_remove(struct dnsc *dnsc, struct dns_cache *e)
+{
+	hash_unlink(&e->he);
+	list_unlink(&e->le);
+	e->refq = mem_deref(e->refq);
+	mem_deref(e);
+
+	--dnsc->cstat.entries;
+}
+
+
+static bool cache_cmp_handler(struct le *le, void *arg)
+{
+	const struct dns_cache *e = le->data;
+	const struct dns_query *q = arg;
+
+	return e->type == q->type && e->dnsclass == q->dnsclass &&
+		!str_casecmp(e->name, q->name);
+}
+
+
+/*
+ * Lifetime of a reply in seconds, 0 if it must not be cached. Negative
+ * answers are cached according to the SOA record (RFC 2308).
+ */
+static int64_t cache_ttl(const struct dnshdr *hdr, struct list *rrlv)
+{
+	int64_t ttl = CACHE_TTL_MAX;
+	bool soa = false;
+	uint32_t i;
+	struct le *le;
+
+	if (hdr->tc)
+		return 0;
+
+	if (hdr->rcode != DNS_RCODE_OK && hdr->rcode != DNS_RCODE_NAME_ERR)
+		return 0;
+
+	for (i=0; i<3; i++) {
+
+		for (le = rrlv[i].head; le; le = le->next) {
+
+			const struct dnsrr *rr = le->data;
+
+			/* EDNS0 OPT pseudo-RR has no TTL */
+			if (rr->type == 41)
+				continue;
+
+			if (rr->type == DNS_TYPE_SOA && i == 1) {
+				soa = true;
+				ttl = min(ttl, (int64_t)rr->rdata.soa.ttlmin);
+			}
+
+			ttl = min(ttl, rr->ttl);
+		}
+	}
+
+	if ((hdr->rcode != DNS_RCODE_OK || !hdr->nans) && !soa)
+		return 0;
+
+	return max(ttl, (int64_t)0);
+}
+
+
+static void cache_store(struct dnsc *dnsc, struct dns_query *q,
+			const struct dnshdr *hdr, const struct mbuf *mb,
+			size_t rrpos)
+{
+	struct dns_cache *e;
+	struct mbuf *mbc;
+	int64_t ttl;
+
+	if (!dnsc->cache_max || q->opcode != DNS_OPCODE_QUERY ||
+	    q->type == DNS_QTYPE_AXFR || q->srvv != dnsc->srvv)
+		return;
+
+	ttl = cache_ttl(hdr, q->rrlv);
+	if (!ttl)
+		return;
+
+	mbc = mbuf_alloc(mb->end);
+	if (!mbc)
+		return;
+
+	(void)mbuf_write_mem(mbc, mb->buf, mb->end);
+
+	e = list_ledata(hash_lookup(dnsc->ht_cache,
+				    hash_joaat_str_ci(q->name),
+				    cache_cmp_handler, q));
+	if (!e) {
+		e = mem_zalloc(sizeof(*e), cache_destructor);
+		if (!e || str_dup(&e->name, q->name)) {
+			mem_deref(e);
+			mem_deref(mbc);
+			return;
+		}
+
+		e->type     = q->type;
+		e->dnsclass = q->dnsclass;
+
+		/* evict least recently used entry */
+		if (dnsc->cstat.entries >= dnsc->cache_max) {
+			cache_remove(dnsc, list_ledata(dnsc->cachel.head));
+			++dnsc->cstat.evictions;
+		}
+
+		hash_append(dnsc->ht_cache, hash_joaat_str_ci(e->name),
+			    &e->he, e);
+		++dnsc->cstat.entries;
+	}
+	else {
+		list_unlink(&e->le);
+	}
+
+	list_append(&dnsc->cachel, &e->le, e);
+
+	mem_deref(e->mb);
+	e->mb      = mbc;
+	e->rrpos   = rrpos;
+	e->hdr     = *hdr;
+	e->expires = tmr_jiffies() + ttl * 1000;
+}
+
+
+static struct dns_cache *cache_lookup(struct dnsc *dnsc,
+				      struct dns_query *q, bool rd)
+{
+	struct dns_cache *e;
+	uint64_t now;
+
+	if (!dnsc->cache_max || dnsc->refreshing ||
+	    q->opcode != DNS_OPCODE_QUERY || q->srvv != dnsc->srvv)
+		return NULL;
+
+	e = list_ledata(hash_lookup(dnsc->ht_cache,
+				    hash_joaat_str_ci(q->name),
+				    cache_cmp_handler, q));
+	if (!e)
+		goto miss;
+
+	now = tmr_jiffies();
+
+	if (now >= e->expires + CACHE_STALE) {
+		cache_remove(dnsc, e);
+		goto miss;
+	}
+
+	list_unlink(&e->le);
+	list_append(&dnsc->cachel, &e->le, e);
+
+	if (now < e->expires) {
+		++dnsc->cstat.hits;
+		return e;
+	}
+
+	/* serve stale entry while refreshing it in the background */
+	++dnsc->cstat.stale_hits;
+
+	if (!e->refq) {
+		dnsc->refreshing = true;
+		(void)dnsc_query(&e->refq, dnsc, e->name, e->type,
+				 e->dnsclass, rd, NULL, NULL);
+		dnsc->refreshing = false;
+	}
+
+	return e;
+
+ miss:
+	++dnsc->cstat.misses;
+	return NULL;
+}
+
+
+static int rr_decode_all(struct dns_query *q, struct mbuf *mb,
+			 const struct dnshdr *hdr)
+{
+	uint32_t i, j, nv[3];
+	int err;
+
+	nv[0] = hdr->nans;
+	nv[1] = hdr->nauth;
+	nv[2] = hdr->nadd;
+
+	for (i=0; i<ARRAY_SIZE(nv); i++) {
+
+		for (j=0; j<nv[i]; j++) {
+
+			struct dnsrr *rr = NULL;
+
+			err = dns_rr_decode(mb, &rr, 0);
+			if (err)
+				return err;
+
+			list_append(&q->rrlv[i], &rr->le_priv, rr);
+		}
+	}
+
+	return 0;
+}
+
+
+static void cache_reply_handler(void *arg)
+{
+	struct dns_query *q = arg;
+	struct dns_cache *e = q->ce;
+	struct dnshdr hdr = e->hdr;
+	struct mbuf mb = *e->mb;
+	int err;
+
+	hdr.id = q->id;
+	mb.pos = e->rrpos;
+
+	err = rr_decode_all(q, &mb, &hdr);
+	if (err)
+		query_handler(q, err, NULL, NULL, NULL, NULL);
+	else
+		query_handler(q, 0, &hdr, &q->rrlv[0], &q->rrlv[1],
+			      &q->rrlv[2]);
+
+	mem_deref(q);
+}
+
+
 static int reply_recv(struct dnsc *dnsc, struct mbuf *mb)
 {
 	struct dns_query *q = NULL;
-	uint32_t i, j, nv[3];
 	struct dnsquery dq;
+	size_t rrpos;
 	int err = 0;
 
 	if (!dnsc || !mb)
@@ -227,25 +496,13 @@ static int reply_recv(struct dnsc *dnsc, struct mbuf *mb)
 		goto out;
 	}
 
-	nv[0] = dq.hdr.nans;
-	nv[1] = dq.hdr.nauth;
-	nv[2] = dq.hdr.nadd;
-
-	for (i=0; i<ARRAY_SIZE(nv); i++) {
-
-		for (j=0; j<nv[i]; j++) {
-
-			struct dnsrr *rr = NULL;
-
-			err = dns_rr_decode(mb, &rr, 0);
-			if (err) {
-				query_handler(q, err, NULL, NULL, NULL, NULL);
-				mem_deref(q);
-				goto out;
-			}
+	rrpos = mb->pos;
 
-			list_append(&q->rrlv[i], &rr->le_priv, rr);
-		}
+	err = rr_decode_all(q, mb, &dq.hdr);
+	if (err) {
+		query_handler(q, err, NULL, NULL, NULL, NULL);
+		mem_deref(q);
+		goto out;
 	}
 
 	if (q->type == DNS_QTYPE_AXFR) {
@@ -263,6 +520,8 @@ static int reply_recv(struct dnsc *dnsc, struct mbuf *mb)
 		}
 	}
 
+	cache_store(dnsc, q, &dq.hdr, mb, rrpos);
+
 	query_handler(q, 0, &dq.hdr, &q->rrlv[0], &q->rrlv[1], &q->rrlv[2]);
 	mem_deref(q);
 
@@ -678,6 +937,12 @@ static int query(struct dns_query **qp, struct dnsc *dnsc, uint8_t opcode,
 	q->qh  = qh;
 	q->arg = arg;
 
+	q->ce = mem_ref(cache_lookup(dnsc, q, rd));
+	if (q->ce) {
+		tmr_start(&q->tmr, 0, cache_reply_handler, q);
+		goto out;
+	}
+
 	switch (proto) {
 
 	case IPPROTO_TCP:
@@ -704,6 +969,7 @@ static int query(struct dns_query **qp, struct dnsc *dnsc, uint8_t opcode,
 		goto error;
 	}
 
+ out:
 	if (qp) {
 		q->qp = qp;
 		*qp = q;
@@ -806,9 +1072,11 @@ static void dnsc_destructor(void *data)
 
 	(void)hash_apply(dnsc->ht_query, query_close_handler, NULL);
 	hash_flush(dnsc->ht_tcpconn);
+	dnsc_cache_flush(dnsc);
 
 	mem_deref(dnsc->ht_tcpconn);
 	mem_deref(dnsc->ht_query);
+	mem_deref(dnsc->ht_cache);
 	mem_deref(dnsc->us);
 }
 
@@ -861,10 +1129,18 @@ int dnsc_alloc(struct dnsc **dcpp, const struct dnsc_conf *conf,
 	if (err)
 		goto out;
 
+	(void)hash_autosize(dnsc->ht_query, query_key);
+
 	err = hash_alloc(&dnsc->ht_tcpconn, dnsc->conf.tcp_hash_size);
 	if (err)
 		goto out;
 
+	err = hash_alloc(&dnsc->ht_cache, CACHE_HASH_SIZE);
+	if (err)
+		goto out;
+
+	dnsc->cache_max = CACHE_MAX;
+
  out:
 	if (err)
 		mem_deref(dnsc);
@@ -898,5 +1174,92 @@ int dnsc_srv_set(struct dnsc *dnsc, const struct sa *srvv, uint32_t srvc)
 			dnsc->srvv[i] = srvv[i];
 	}
 
+	/* answers from the old servers are no longer valid */
+	dnsc_cache_flush(dnsc);
+
 	return 0;
 }
+
+
+/**
+ * Set the maximum number of cached DNS answers. Positive and negative
+ * answers are cached according to their TTL, and expired entries are
+ * served for a short while longer while being refreshed.
+ *
+ * @param dnsc DNS Client
+ * @param max  Maximum number of entries, 0 to disable the cache
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int dnsc_cache_max(struct dnsc *dnsc, uint32_t max)
+{
+	if (!dnsc)
+		return EINVAL;
+
+	dnsc->cache_max = max;
+
+	while (dnsc->cstat.entries > max) {
+		cache_remove(dnsc, list_ledata(dnsc->cachel.head));
+		++dnsc->cstat.evictions;
+	}
+
+	return 0;
+}
+
+
+/**
+ * Flush all cached DNS answers
+ *
+ * @param dnsc DNS Client
+ */
+void dnsc_cache_flush(struct dnsc *dnsc)
+{
+	if (!dnsc)
+		return;
+
+	while (dnsc->cachel.head)
+		cache_remove(dnsc, list_ledata(dnsc->cachel.head));
+}
+
+
+/**
+ * Get the DNS cache statistics
+ *
+ * @param dnsc DNS Client
+ * @param stat Returned cache statistics
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int dnsc_cache_stat_get(const struct dnsc *dnsc, struct dnsc_cache_stat *stat)
+{
+	if (!dnsc || !stat)
+		return EINVAL;
+
+	*stat = dnsc->cstat;
+
+	return 0;
+}
+
+
+/**
+ * Print the DNS cache statistics
+ *
+ * @param pf   Print function
+ * @param dnsc DNS Client
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int dnsc_cache_debug(struct re_printf *pf, const struct dnsc *dnsc)
+{
+	const struct dnsc_cache_stat *st;
+
+	if (!dnsc)
+		return 0;
+
+	st = &dnsc->cstat;
+
+	return re_hprintf(pf, "DNS cache: %u/%u entries, hits=%u stale=%u"
+			  " misses=%u evictions=%u\n",
+			  st->entries, dnsc->cache_max, st->hits,
+			  st->stale_hits, st->misses, st->evictions);
+}
@@ -3,17 +3,38 @@
  *
  * Copyright (C) 2010 Creytiv.com
  */
+#include <string.h>
 #include <re_types.h>
 #include <re_mem.h>
 #include <re_mbuf.h>
 #include <re_list.h>
+#include <re_fmt.h>
 #include <re_hash.h>
 
 
+enum {
+	HASH_LOAD_MAX   = 2,        /**< Grow above 2 elements per bucket */
+	HASH_LOAD_MIN   = 8,        /**< Shrink below 1/8 element/bucket  */
+	HASH_BSIZE_MAX  = 1 << 20,  /**< Largest automatic bucket size    */
+	HASH_REHASH_STEP = 4        /**< Old buckets moved per operation  */
+};
+
+
 /** Defines a hashmap table */
 struct hash {
 	struct list *bucket;  /**< Bucket with linked lists */
 	uint32_t bsize;       /**< Bucket size              */
+
+	/* automatic resizing */
+	hash_key_h *keyh;     /**< Element key handler      */
+	struct list *old;     /**< Buckets being rehashed   */
+	uint32_t osize;       /**< Old bucket size          */
+	uint32_t opos;        /**< Next old bucket to move  */
+	uint32_t bsize_min;   /**< Initial bucket size      */
+	uint32_t nappend;     /**< Appends since last count */
+	uint32_t nelem;       /**< Element count at last count */
+	uint32_t resizes;     /**< Number of resizes        */
+	uint32_t iter;        /**< Traversal nesting depth  */
 };
 
 
@@ -21,10 +42,125 @@ static void hash_destructor(void *data)
 {
 	struct hash *h = data;
 
+	mem_deref(h->old);
 	mem_deref(h->bucket);
 }
 
 
+static void rehash_bucket(struct hash *h, uint32_t i)
+{
+	struct le *le;
+
+	while ((le = h->old[i].head)) {
+
+		const uint32_t key = h->keyh(le);
+
+		list_unlink(le);
+		list_append(&h->bucket[key & (h->bsize-1)], le, le->data);
+	}
+}
+
+
+static void rehash_done(struct hash *h)
+{
+	h->old   = mem_deref(h->old);
+	h->osize = 0;
+	h->opos  = 0;
+	++h->resizes;
+}
+
+
+/*
+ * Move the elements of a few old buckets to the new buckets. Nothing is
+ * moved while the table is traversed, to keep list iteration valid.
+ */
+static void rehash_step(struct hash *h, uint32_t n)
+{
+	if (!h->old || h->iter)
+		return;
+
+	while (n-- && h->opos < h->osize)
+		rehash_bucket(h, h->opos++);
+
+	if (h->opos >= h->osize)
+		rehash_done(h);
+}
+
+
+/*
+ * Move all old buckets that map to the same new bucket as key, so that
+ * elements with equal keys keep their order.
+ */
+static void rehash_key(struct hash *h, uint32_t key)
+{
+	const uint32_t m = min(h->osize, h->bsize);
+	uint32_t i;
+
+	if (!h->old || h->iter)
+		return;
+
+	for (i = key & (m-1); i < h->osize; i += m)
+		rehash_bucket(h, i);
+}
+
+
+static void rehash_all(struct hash *h)
+{
+	rehash_step(h, h->old ? h->osize : 0);
+}
+
+
+static uint32_t hash_count(const struct hash *h)
+{
+	uint32_t i, n = 0;
+
+	for (i=0; i<h->bsize; i++)
+		n += list_count(&h->bucket[i]);
+
+	for (i=h->opos; h->old && i<h->osize; i++)
+		n += list_count(&h->old[i]);
+
+	return n;
+}
+
+
+static void hash_resize(struct hash *h, uint32_t bsize)
+{
+	struct list *bucket;
+
+	bucket = mem_zalloc(bsize*sizeof(*bucket), NULL);
+	if (!bucket)
+		return;
+
+	h->old    = h->bucket;
+	h->osize  = h->bsize;
+	h->opos   = 0;
+	h->bucket = bucket;
+	h->bsize  = bsize;
+}
+
+
+/*
+ * The element count is refreshed once per bsize appends, which keeps the
+ * amortized cost per append proportional to the load factor. The bucket
+ * array is not replaced while the table is traversed.
+ */
+static void check_load(struct hash *h)
+{
+	if (h->old || h->iter || ++h->nappend < h->bsize)
+		return;
+
+	h->nappend = 0;
+	h->nelem   = hash_count(h);
+
+	if (h->nelem > h->bsize * HASH_LOAD_MAX && h->bsize < HASH_BSIZE_MAX)
+		hash_resize(h, h->bsize * 2);
+	else if (h->nelem < h->bsize / HASH_LOAD_MIN &&
+		 h->bsize > h->bsize_min)
+		hash_resize(h, h->bsize / 2);
+}
+
+
 /**
  * Allocate a new hashmap table
  *
@@ -80,6 +216,12 @@ void hash_append(struct hash *h, uint32_t key, struct le *le, void *data)
 	if (!h || !le)
 		return;
 
+	if (h->keyh) {
+		rehash_key(h, key);
+		rehash_step(h, HASH_REHASH_STEP);
+		check_load(h);
+	}
+
 	list_append(&h->bucket[key & (h->bsize-1)], le, data);
 }
 
@@ -108,10 +250,32 @@ void hash_unlink(struct le *le)
 struct le *hash_lookup(const struct hash *h, uint32_t key, list_apply_h *ah,
 		       void *arg)
 {
+	struct hash *hm = (struct hash *)h;
+	struct le *le = NULL;
+
 	if (!h || !ah)
 		return NULL;
 
-	return list_apply(&h->bucket[key & (h->bsize-1)], true, ah, arg);
+	if (!h->old) {
+		++hm->iter;
+		le = list_apply(&h->bucket[key & (h->bsize-1)], true, ah, arg);
+		--hm->iter;
+
+		return le;
+	}
+
+	rehash_step(hm, HASH_REHASH_STEP);
+
+	++hm->iter;
+
+	if (h->old)
+		le = list_apply(&h->old[key & (h->osize-1)], true, ah, arg);
+	if (!le)
+		le = list_apply(&h->bucket[key & (h->bsize-1)], true, ah, arg);
+
+	--hm->iter;
+
+	return le;
 }
 
 
@@ -126,15 +290,23 @@ struct le *hash_lookup(const struct hash *h, uint32_t key, list_apply_h *ah,
  */
 struct le *hash_apply(const struct hash *h, list_apply_h *ah, void *arg)
 {
+	struct hash *hm = (struct hash *)h;
 	struct le *le = NULL;
 	uint32_t i;
 
 	if (!h || !ah)
 		return NULL;
 
+	++hm->iter;
+
+	for (i=h->opos; h->old && (i<h->osize) && !le; i++)
+		le = list_apply(&h->old[i], true, ah, arg);
+
 	for (i=0; (i<h->bsize) && !le; i++)
 		le = list_apply(&h->bucket[i], true, ah, arg);
 
+	--hm->iter;
+
 	return le;
 }
 
@@ -146,10 +318,18 @@ struct le *hash_apply(const struct hash *h, list_apply_h *ah, void *arg)
  * @param key Hash key
  *
  * @return Bucket list if valid input, otherwise NULL
+ *
+ * @note On a table with automatic resizing, any pending rehash is
+ *       completed first
  */
 struct list *hash_list(const struct hash *h, uint32_t key)
 {
-	return h ? &h->bucket[key & (h->bsize - 1)] : NULL;
+	if (!h)
+		return NULL;
+
+	rehash_all((struct hash *)h);
+
+	return &h->bucket[key & (h->bsize - 1)];
 }
 
 
@@ -178,6 +358,9 @@ void hash_flush(struct hash *h)
 	if (!h)
 		return;
 
+	for (i=h->opos; h->old && i<h->osize; i++)
+		list_flush(&h->old[i]);
+
 	for (i=0; i<h->bsize; i++)
 		list_flush(&h->bucket[i]);
 }
@@ -195,6 +378,9 @@ void hash_clear(struct hash *h)
 	if (!h)
 		return;
 
+	for (i=h->opos; h->old && i<h->osize; i++)
+		list_clear(&h->old[i]);
+
 	for (i=0; i<h->bsize; i++)
 		list_clear(&h->bucket[i]);
 }
@@ -216,3 +402,94 @@ uint32_t hash_valid_size(uint32_t size)
 
 	return 1<<x;
 }
+
+
+/**
+ * Enable automatic resizing of a hashmap table. The bucket size is
+ * doubled when the load factor exceeds 2, and halved (down to the
+ * initial size) when it falls below 1/8. Elements are moved to the new
+ * buckets incrementally by subsequent appends and lookups.
+ *
+ * @param h    Hashmap table
+ * @param keyh Handler returning the hash key of an element
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int hash_autosize(struct hash *h, hash_key_h *keyh)
+{
+	if (!h || !keyh)
+		return EINVAL;
+
+	h->keyh      = keyh;
+	h->bsize_min = h->bsize;
+
+	return 0;
+}
+
+
+/**
+ * Get hashmap table statistics
+ *
+ * @param h    Hashmap table
+ * @param stat Returned statistics
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int hash_stat_get(const struct hash *h, struct hash_stat *stat)
+{
+	uint32_t i;
+
+	if (!h || !stat)
+		return EINVAL;
+
+	memset(stat, 0, sizeof(*stat));
+
+	for (i=0; i<h->bsize; i++) {
+
+		const uint32_t n = list_count(&h->bucket[i]);
+
+		stat->nelem += n;
+		stat->chain_max = max(stat->chain_max, n);
+		if (n)
+			++stat->nused;
+	}
+
+	for (i=h->opos; h->old && i<h->osize; i++) {
+
+		const uint32_t n = list_count(&h->old[i]);
+
+		stat->nelem += n;
+		stat->chain_max = max(stat->chain_max, n);
+	}
+
+	stat->bsize     = h->bsize;
+	stat->load      = (uint32_t)((uint64_t)stat->nelem * 100 / h->bsize);
+	stat->resizes   = h->resizes;
+	stat->rehashing = h->old != NULL;
+
+	return 0;
+}
+
+
+/**
+ * Print hashmap table statistics
+ *
+ * @param pf Print function
+ * @param h  Hashmap table
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int hash_debug(struct re_printf *pf, const struct hash *h)
+{
+	struct hash_stat st;
+	int err;
+
+	err = hash_stat_get(h, &st);
+	if (err)
+		return err;
+
+	return re_hprintf(pf, "hash: bsize=%u elements=%u used=%u"
+			  " chain_max=%u load=%u%% resizes=%u%s\n",
+			  st.bsize, st.nelem, st.nused, st.chain_max,
+			  st.load, st.resizes, st.rehashing ? " (rehashing)" : "");
+}
@@ -8,7 +8,9 @@
 #include <re_list.h>
 #include <re_mbuf.h>
 #include <re_mem.h>
+#include <re_lock.h>
 #include <re_rtp.h>
+#include <re_tmr.h>
 #include <re_jbuf.h>
 
 
@@ -31,6 +33,15 @@
 #endif
 
 
+/** Adaptive mode parameters */
+enum {
+	JBUF_JITTER_WIN = 128,  /**< [packets] Delay variation history    */
+	JBUF_ADAPT_INT  = 16,   /**< [packets] Target update interval     */
+	JBUF_SHRINK_HOLD = 100, /**< [frames] Min. frames between shrinks */
+	JBUF_PERCENTILE = 95,   /**< Delay variation percentile covered   */
+};
+
+
 /** Defines a packet frame */
 struct frame {
 	struct le le;           /**< Linked list element       */
@@ -53,6 +64,26 @@ struct jbuf {
 	uint32_t max;        /**< [# frames] Maximum # of frames to buffer  */
 	uint16_t seq_put;    /**< Sequence number for last jbuf_put()       */
 	bool running;        /**< Jitter buffer is running                  */
+	enum jbuf_type jbtype; /**< Fixed or adaptive delay                 */
+
+	/* adaptive mode */
+	uint32_t wish;       /**< [# frames] Current target delay           */
+	uint32_t srate;      /**< RTP clock rate in [Hz]                    */
+	uint32_t transit;    /**< Relative transit time of last packet      */
+	bool transit_valid;  /**< Transit time has been set                 */
+	uint32_t jitter;     /**< Interarrival jitter, RTP units, Q4        */
+	uint32_t ts_prev;    /**< RTP timestamp of last packet              */
+	uint16_t seq_prev;   /**< Sequence number of last packet            */
+	uint32_t ptime_ts;   /**< Frame duration in RTP units               */
+	uint16_t dv[JBUF_JITTER_WIN]; /**< |D| history in [ms]             */
+	uint32_t dvc;        /**< Number of entries in dv                   */
+	uint32_t dvpos;      /**< Next write position in dv                 */
+	uint32_t p95;        /**< Delay variation percentile in [ms]        */
+	uint32_t nadapt;     /**< Packets since last target update          */
+	uint32_t nhold;      /**< Frames since last shrink                  */
+	struct lock *lock;   /**< Put and get may run on separate threads   */
+	bool pull;           /**< Frames are taken on the playout clock     */
+	bool playing;        /**< Pull mode: prebuffering done              */
 
 #if JBUF_STAT
 	uint16_t seq_get;      /**< Timestamp of last played frame */
@@ -115,10 +146,116 @@ static void jbuf_destructor(void *data)
 {
 	struct jbuf *jb = data;
 
-	jbuf_flush(jb);
+	if (jb->lock)
+		jbuf_flush(jb);
 
 	/* Free all frames in the pool list */
 	list_flush(&jb->pooll);
+
+	mem_deref(jb->lock);
+}
+
+
+static uint32_t percentile(const struct jbuf *jb, uint32_t pct)
+{
+	uint16_t v[JBUF_JITTER_WIN];
+	uint32_t i, j;
+
+	if (!jb->dvc)
+		return 0;
+
+	/* insertion sort, the window is small */
+	for (i=0; i<jb->dvc; i++) {
+
+		const uint16_t x = jb->dv[i];
+
+		for (j=i; j>0 && v[j-1] > x; j--)
+			v[j] = v[j-1];
+
+		v[j] = x;
+	}
+
+	return v[(jb->dvc - 1) * pct / 100];
+}
+
+
+/*
+ * Recompute the target delay from the measured delay variation. The
+ * target covers the larger of the 95th percentile of |D| and twice the
+ * RFC 3550 jitter, plus one frame. It grows at once and shrinks by at
+ * most one frame per update.
+ */
+static void wish_update(struct jbuf *jb)
+{
+	uint32_t frame_ms, jit_ms, delay_ms, target;
+
+	if (!jb->ptime_ts)
+		return;
+
+	frame_ms = max(jb->ptime_ts * 1000 / jb->srate, 1u);
+	jit_ms   = (jb->jitter >> 4) * 1000 / jb->srate;
+
+	jb->p95  = percentile(jb, JBUF_PERCENTILE);
+	delay_ms = max(jb->p95, 2 * jit_ms);
+
+	target = (delay_ms + frame_ms - 1) / frame_ms + 1;
+	target = min(target, jb->max - 1);
+	target = max(target, jb->min);
+
+	if (target > jb->wish) {
+		DEBUG_INFO("grow: wish=%u -> %u (jitter=%ums p95=%ums)\n",
+			   jb->wish, target, jit_ms, jb->p95);
+		jb->wish = target;
+	}
+	else if (target < jb->wish && jb->nhold >= JBUF_SHRINK_HOLD) {
+		--jb->wish;
+		jb->nhold = 0;
+	}
+}
+
+
+/*
+ * RFC 3550 section 6.4.1 interarrival jitter, with the absolute delay
+ * variation of each packet also kept for percentile tracking.
+ */
+static void jitter_update(struct jbuf *jb, const struct rtp_header *hdr)
+{
+	const uint32_t arrival = (uint32_t)(tmr_jiffies() * jb->srate / 1000);
+	const uint32_t transit = arrival - hdr->ts;
+
+	if (jb->transit_valid) {
+
+		int32_t d = (int32_t)(transit - jb->transit);
+
+		if (d < 0)
+			d = -d;
+
+		/* a timestamp jump is not network jitter */
+		if ((uint32_t)d > jb->srate)
+			d = jb->srate;
+
+		jb->jitter += d - ((jb->jitter + 8) >> 4);
+
+		jb->dv[jb->dvpos] = (uint16_t)((uint64_t)d * 1000 /
+					       jb->srate);
+		jb->dvpos = (jb->dvpos + 1) % JBUF_JITTER_WIN;
+		jb->dvc   = min(jb->dvc + 1, (uint32_t)JBUF_JITTER_WIN);
+
+		if ((uint16_t)(jb->seq_prev + 1) == hdr->seq &&
+		    hdr->ts != jb->ts_prev &&
+		    hdr->ts - jb->ts_prev <= jb->srate)
+			jb->ptime_ts = hdr->ts - jb->ts_prev;
+	}
+
+	jb->transit       = transit;
+	jb->transit_valid = true;
+	jb->ts_prev       = hdr->ts;
+	jb->seq_prev      = hdr->seq;
+
+	if (++jb->nadapt >= JBUF_ADAPT_INT) {
+		jb->nadapt = 0;
+		wish_update(jb);
+	}
 }
 
 
@@ -159,8 +296,13 @@ int jbuf_alloc(struct jbuf **jbp, uint32_t min, uint32_t max)
 	list_init(&jb->pooll);
 	list_init(&jb->framel);
 
+	err = lock_alloc(&jb->lock);
+	if (err)
+		goto out;
+
 	jb->min  = min;
 	jb->max  = max;
+	jb->wish = min;
 
 	/* Allocate all frames now */
 	for (i=0; i<jb->max; i++) {
@@ -174,6 +316,7 @@ int jbuf_alloc(struct jbuf **jbp, uint32_t min, uint32_t max)
 		DEBUG_INFO("alloc: adding to pool list %u\n", i);
 	}
 
+ out:
 	if (err)
 		mem_deref(jb);
 	else
@@ -204,8 +347,13 @@ int jbuf_put(struct jbuf *jb, const struct rtp_header *hdr, void *mem)
 
 	seq = hdr->seq;
 
+	lock_write_get(jb->lock);
+
 	STAT_INC(n_put);
 
+	if (jb->jbtype == JBUF_ADAPTIVE && jb->srate)
+		jitter_update(jb, hdr);
+
 	if (jb->running) {
 
 		/* Packet arrived too late to be put into buffer */
@@ -213,7 +361,8 @@ int jbuf_put(struct jbuf *jb, const struct rtp_header *hdr, void *mem)
 			STAT_INC(n_late);
 			DEBUG_INFO("packet too late: seq=%u (seq_put=%u)\n",
 				   seq, jb->seq_put);
-			return ETIMEDOUT;
+			err = ETIMEDOUT;
+			goto unlock;
 		}
 	}
 
@@ -246,7 +395,8 @@ int jbuf_put(struct jbuf *jb, const struct rtp_header *hdr, void *mem)
 			STAT_INC(n_dups);
 			list_insert_after(&jb->framel, le, &f->le, f);
 			frame_deref(jb, f);
-			return EALREADY;
+			err = EALREADY;
+			goto unlock;
 		}
 
 		/* sequence number less than current seq, continue */
@@ -270,6 +420,9 @@ int jbuf_put(struct jbuf *jb, const struct rtp_header *hdr, void *mem)
 	f->hdr = *hdr;
 	f->mem = mem_ref(mem);
 
+ unlock:
+	lock_rel(jb->lock);
+
 	return err;
 }
 
@@ -286,17 +439,42 @@ int jbuf_put(struct jbuf *jb, const struct rtp_header *hdr, void *mem)
 int jbuf_get(struct jbuf *jb, struct rtp_header *hdr, void **mem)
 {
 	struct frame *f;
+	int err = 0;
 
 	if (!jb || !hdr || !mem)
 		return EINVAL;
 
+	lock_write_get(jb->lock);
+
 	STAT_INC(n_get);
 
-	if (jb->n <= jb->min || !jb->framel.head) {
-		DEBUG_INFO("not enough buffer frames - wait.. (n=%u min=%u)\n",
-			   jb->n, jb->min);
+	if (jb->pull) {
+		/* prebuffer to the target delay, then play until empty */
+		if (jb->n > jb->wish)
+			jb->playing = true;
+		else if (!jb->n)
+			jb->playing = false;
+	}
+
+	if (!(jb->pull ? jb->playing : jb->n > jb->wish) ||
+	    !jb->framel.head) {
+		DEBUG_INFO("not enough buffer frames - wait.. (n=%u wish=%u)\n",
+			   jb->n, jb->wish);
 		STAT_INC(n_underflow);
-		return ENOENT;
+		err = ENOENT;
+		goto out;
+	}
+
+	++jb->nhold;
+
+	/* target was lowered, drop the oldest frame to cut the delay */
+	if (jb->jbtype == JBUF_ADAPTIVE && jb->n > jb->wish + 1 &&
+	    jb->nhold == 1) {
+		f = jb->framel.head->data;
+		DEBUG_INFO("shrink: drop seq=%u (n=%u wish=%u)\n",
+			   f->hdr.seq, jb->n, jb->wish);
+		STAT_INC(n_skip);
+		frame_deref(jb, f);
 	}
 
 	/* When we get one frame F[i], check that the next frame F[i+1]
@@ -328,7 +506,10 @@ int jbuf_get(struct jbuf *jb, struct rtp_header *hdr, void **mem)
 
 	frame_deref(jb, f);
 
-	return 0;
+ out:
+	lock_rel(jb->lock);
+
+	return err;
 }
 
 
@@ -344,6 +525,8 @@ void jbuf_flush(struct jbuf *jb)
 	if (!jb)
 		return;
 
+	lock_write_get(jb->lock);
+
 	if (jb->framel.head) {
 		DEBUG_INFO("flush: %u frames\n", jb->n);
 	}
@@ -358,8 +541,80 @@ void jbuf_flush(struct jbuf *jb)
 
 	jb->n       = 0;
 	jb->running = false;
+	jb->playing = false;
+
+	/* keep the target delay, restart the jitter estimate */
+	jb->transit_valid = false;
+	jb->nadapt        = 0;
 
 	STAT_INC(n_flush);
+
+	lock_rel(jb->lock);
+}
+
+
+/**
+ * Set the jitter buffer type
+ *
+ * @param jb     Jitter buffer
+ * @param jbtype JBUF_FIXED to always hold the minimum delay, or
+ *               JBUF_ADAPTIVE to follow the measured network jitter
+ *
+ * @return 0 if success, otherwise errorcode
+ *
+ * @note Adaptive mode needs the RTP clock rate, see jbuf_set_srate()
+ */
+int jbuf_set_type(struct jbuf *jb, enum jbuf_type jbtype)
+{
+	if (!jb)
+		return EINVAL;
+
+	jb->jbtype = jbtype;
+	jb->wish   = jb->min;
+
+	return 0;
+}
+
+
+/**
+ * Select how frames are taken out of the jitter buffer
+ *
+ * @param jb   Jitter buffer
+ * @param pull False if jbuf_get() is called once per jbuf_put(), true if
+ *             it is called on the playout clock
+ *
+ * @note In pull mode the buffer is filled to the target delay once and
+ *       then drained, it only prebuffers again after running empty
+ */
+void jbuf_set_pull(struct jbuf *jb, bool pull)
+{
+	if (!jb)
+		return;
+
+	lock_write_get(jb->lock);
+	jb->pull    = pull;
+	jb->playing = false;
+	lock_rel(jb->lock);
+}
+
+
+/**
+ * Set the RTP clock rate used for jitter estimation
+ *
+ * @param jb    Jitter buffer
+ * @param srate RTP clock rate in [Hz]
+ */
+void jbuf_set_srate(struct jbuf *jb, uint32_t srate)
+{
+	if (!jb || srate == jb->srate)
+		return;
+
+	jb->srate         = srate;
+	jb->transit_valid = false;
+	jb->ptime_ts      = 0;
+	jb->jitter        = 0;
+	jb->dvc           = 0;
+	jb->dvpos         = 0;
 }
 
 
@@ -379,6 +634,11 @@ int jbuf_stats(const struct jbuf *jb, struct jbuf_stat *jstat)
 #if JBUF_STAT
 	*jstat = jb->stat;
 
+	jstat->wish       = jb->wish;
+	jstat->jitter     = jb->srate ?
+		(jb->jitter >> 4) * 1000 / jb->srate : 0;
+	jstat->jitter_p95 = jb->p95;
+
 	return 0;
 #else
 	return ENOSYS;
@@ -406,6 +666,12 @@ int jbuf_debug(struct re_printf *pf, const struct jbuf *jb)
 	err |= re_hprintf(pf, " running=%d", jb->running);
 	err |= re_hprintf(pf, " min=%u cur=%u max=%u [frames]\n",
 			  jb->min, jb->n, jb->max);
+	if (jb->jbtype == JBUF_ADAPTIVE) {
+		err |= re_hprintf(pf, " adaptive: wish=%u [frames]"
+				  " jitter=%ums p95=%ums\n", jb->wish,
+				  jb->srate ? (jb->jitter >> 4) * 1000 /
+				  jb->srate : 0, jb->p95);
+	}
 	err |= re_hprintf(pf, " seq_put=%u\n", jb->seq_put);
 
 #if JBUF_STAT
@@ -417,6 +683,7 @@ int jbuf_debug(struct re_printf *pf, const struct jbuf *jb)
 	err |= re_hprintf(pf, " or=%u", jb->stat.n_overflow);
 	err |= re_hprintf(pf, " ur=%u", jb->stat.n_underflow);
 	err |= re_hprintf(pf, " flush=%u", jb->stat.n_flush);
+	err |= re_hprintf(pf, " skip=%u", jb->stat.n_skip);
 	err |= re_hprintf(pf, "       put/get_ratio=%u%%", jb->stat.n_get ?
 			  100*jb->stat.n_put/jb->stat.n_get : 0);
 	err |= re_hprintf(pf, " lost=%u (%u.%02u%%)\n",
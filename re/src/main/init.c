@@ -9,6 +9,7 @@
 #include <re_net.h>
 #include <re_sys.h>
 #include <re_main.h>
+#include <re_mem.h>
 #include "main.h"
 
 
@@ -34,4 +35,5 @@ int libre_init(void)
 void libre_close(void)
 {
 	(void)fd_setsize(0);
+	mem_pool_flush();
 }
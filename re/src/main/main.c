@@ -30,6 +30,9 @@
 #ifdef HAVE_EPOLL
 #include <sys/epoll.h>
 #endif
+#ifdef HAVE_EVENTFD
+#include <sys/eventfd.h>
+#endif
 #include <re_fmt.h>
 #include <re_mem.h>
 #include <re_mbuf.h>
@@ -37,6 +40,7 @@
 #include <re_tmr.h>
 #include <re_main.h>
 #include "main.h"
+#include "../mqueue/mqueue.h"
 #ifdef HAVE_PTHREAD
 #define __USE_GNU 1
 #include <stdlib.h>
@@ -92,7 +96,9 @@ struct re {
 	bool update;                 /**< File descriptor set need updating */
 	bool polling;                /**< Is polling flag                   */
 	int sig;                     /**< Last caught signal                */
-	struct list tmrl;            /**< List of timers                    */
+	struct tmrl tmrl;            /**< Timer wheel                       */
+	int wfd[2];                  /**< Wakeup pipe (read and write end)  */
+	volatile bool wpending;      /**< Wakeup written but not yet read   */
 
 #ifdef HAVE_POLL
 	struct pollfd *fds;          /**< Event set for poll()              */
@@ -117,7 +123,9 @@ static struct re global_re = {
 	false,
 	false,
 	0,
-	LIST_INIT,
+	TMRL_INIT,
+	{-1, -1},
+	false,
 #ifdef HAVE_POLL
 	NULL,
 #endif
@@ -405,11 +413,95 @@ static int poll_init(struct re *re)
 }
 
 
+static void wakeup_handler(int flags, void *arg)
+{
+	struct re *re = arg;
+#ifdef HAVE_EVENTFD
+	uint64_t val;
+#else
+	uint8_t buf[16];
+#endif
+
+	if (!(flags & FD_READ))
+		return;
+
+#ifdef HAVE_EVENTFD
+	(void)read(re->wfd[0], &val, sizeof(val));
+#else
+	(void)pipe_read(re->wfd[0], buf, sizeof(buf));
+#endif
+
+	/* cleared only after draining, so that a wakeup written in between
+	   is not consumed while the flag keeps suppressing later ones. A
+	   wakeup skipped while the flag is still set is covered by the
+	   control handler, which runs after this handler. */
+	re->wpending = false;
+}
+
+
+static void wakeup_close(struct re *re)
+{
+	int i;
+
+	for (i=0; i<2; i++) {
+
+		if (re->wfd[i] < 0)
+			continue;
+
+		if (i == 0 || re->wfd[1] != re->wfd[0]) {
+#ifdef WIN32
+			(void)closesocket(re->wfd[i]);
+#else
+			(void)close(re->wfd[i]);
+#endif
+		}
+
+		re->wfd[i] = -1;
+	}
+
+	re->wpending = false;
+}
+
+
+/**
+ * Set up the wakeup file descriptor, so that re_wakeup() from another
+ * thread interrupts the polling immediately
+ */
+static int wakeup_init(struct re *re)
+{
+	int err;
+
+	if (re->wfd[0] >= 0)
+		return 0;
+
+#ifdef HAVE_EVENTFD
+	re->wfd[0] = eventfd(0, EFD_NONBLOCK);
+	if (re->wfd[0] < 0)
+		return errno;
+	re->wfd[1] = re->wfd[0];
+#else
+	if (pipe(re->wfd) < 0) {
+		err = errno ? errno : ENOSYS;
+		re->wfd[0] = re->wfd[1] = -1;
+		return err;
+	}
+#endif
+
+	err = fd_listen(re->wfd[0], FD_READ, wakeup_handler, re);
+	if (err)
+		wakeup_close(re);
+
+	return err;
+}
+
+
 /** Free all resources */
 static void poll_close(struct re *re)
 {
 	DEBUG_INFO("poll close\n");
 
+	wakeup_close(re);
+
 	re->fhs = mem_deref(re->fhs);
 	re->maxfds = 0;
 
@@ -561,9 +653,10 @@ static int fd_poll(struct re *re)
 
 	DEBUG_INFO("next timer: %llu ms\n", to);
 
-	// limiting poll timeout to call control queue handler in a timely manner
-	if (to > 100) {
-    	to = 100;
+	// without wakeup fd limiting poll timeout to call control queue handler
+	// in a timely manner
+	if (re->wfd[0] < 0 && to > 100) {
+		to = 100;
 	}
 
 	/* Wait for I/O */
@@ -806,6 +899,15 @@ int re_main(re_signal_h *signalh, control_poll_callback_h *controlh)
 	if (err)
 		goto out;
 
+	if (controlh) {
+		err = wakeup_init(re);
+		if (err) {
+			DEBUG_WARNING("wakeup fd not available,"
+				      " polling control handler (%m)\n", err);
+			err = 0;
+		}
+	}
+
 	DEBUG_INFO("Using async I/O polling method: `%s'\n",
 		   poll_method_name(re->method));
 
@@ -879,6 +981,31 @@ void re_cancel(void)
 }
 
 
+/**
+ * Wake up the main polling loop, so that the control handler passed to
+ * re_main() runs without waiting for the next timer. This function can be
+ * called from any thread.
+ */
+void re_wakeup(void)
+{
+	struct re *re = re_get();
+
+	if (re->wfd[1] < 0 || re->wpending)
+		return;
+
+	re->wpending = true;
+
+#ifdef HAVE_EVENTFD
+	{
+		const uint64_t val = 1;
+		(void)write(re->wfd[1], &val, sizeof(val));
+	}
+#else
+	(void)pipe_write(re->wfd[1], "", 1);
+#endif
+}
+
+
 /**
  * Debug the main polling loop
  *
@@ -992,6 +1119,7 @@ int re_thread_init(void)
 #ifdef HAVE_EPOLL
 	re->epfd = -1;
 #endif
+	re->wfd[0] = re->wfd[1] = -1;
 
 	pthread_setspecific(pt_key, re);
 	return 0;
@@ -1060,14 +1188,14 @@ void re_set_mutex(void *mutexp)
 
 
 /**
- * Get the timer-list for this thread
+ * Get the timer wheel for this thread
  *
- * @return Timer list
+ * @return Timer wheel
  *
  * @note only used by tmr module
  */
-struct list *tmrl_get(void);
-struct list *tmrl_get(void)
+struct tmrl *tmrl_get(void);
+struct tmrl *tmrl_get(void)
 {
 	return &re_get()->tmrl;
 }
@@ -10,6 +10,9 @@
 #ifdef HAVE_PTHREAD
 #include <pthread.h>
 #endif
+#ifdef WIN32
+#include <windows.h>
+#endif
 #include <re_list.h>
 #include <re_fmt.h>
 #include <re_mbuf.h>
@@ -25,11 +28,27 @@
 #define MEM_DEBUG 0  /**< Enable memory debugging */
 #endif
 
+#ifndef MEM_POOL
+#define MEM_POOL 1   /**< Recycle small objects via size-class free lists */
+#endif
+
+
+/*
+ * The pool size class takes the padding after nrefs on LP64 targets; on
+ * 32-bit targets the header is padded to 16 bytes. Either way user data
+ * keeps the alignment of malloc().
+ */
 
 /** Defines a reference-counting memory object */
 struct mem {
 	uint32_t nrefs;     /**< Number of references  */
+#if MEM_POOL
+	uint32_t cls;       /**< Size class, MEM_POOL_NONE for malloc */
+#endif
 	mem_destroy_h *dh;  /**< Destroy handler       */
+#if MEM_POOL && !defined (__LP64__) && !defined (_WIN64)
+	uint32_t pad;       /**< Pad header to 16 bytes */
+#endif
 #if MEM_DEBUG
 	struct le le;       /**< Linked list element   */
 	uint32_t magic;     /**< Magic number          */
@@ -115,6 +134,335 @@ static inline void mem_unlock(void)
 #endif
 
 
+#if MEM_POOL
+/*
+ * Pooled backend
+ *
+ * Blocks of up to MEM_POOL_MAXSIZE bytes are rounded up to a power-of-two
+ * size class. Freed blocks are kept on a per-class free list and handed
+ * out again by the next allocation of the same class, so that the SIP and
+ * media hot paths do not hit the system allocator in steady state.
+ *
+ * Objects are routinely allocated on one thread and freed on another
+ * (e.g. mbufs passed from audio device threads to the re thread), so the
+ * free lists are process-wide with a lock per size class.
+ */
+
+enum {
+	MEM_POOL_MINSHIFT = 4,     /* 16 bytes           */
+	MEM_POOL_MAXSHIFT = 13,    /* 8192 bytes         */
+	MEM_POOL_CLASSES  = MEM_POOL_MAXSHIFT - MEM_POOL_MINSHIFT + 1,
+	MEM_POOL_MAXSIZE  = 1 << MEM_POOL_MAXSHIFT,
+	MEM_POOL_MAXBYTES = 256 * 1024,  /* cached bytes per class */
+	MEM_POOL_NONE     = 0xff
+};
+
+/** Free list of one size class */
+struct mem_pool {
+#ifdef WIN32
+	CRITICAL_SECTION cs;
+#elif defined (HAVE_PTHREAD)
+	pthread_mutex_t mutex;
+#endif
+	struct mem *freel;  /**< Free blocks, linked via the data area */
+	uint32_t nfree;     /**< Number of blocks on the free list     */
+	uint32_t maxfree;   /**< Free list limit                       */
+	uint64_t hits;      /**< Allocations served from free list     */
+	uint64_t misses;    /**< Allocations served by malloc          */
+};
+
+#ifdef WIN32
+#define POOL_INIT {{0}, NULL, 0, 0, 0, 0}
+#elif defined (HAVE_PTHREAD)
+#define POOL_INIT {PTHREAD_MUTEX_INITIALIZER, NULL, 0, 0, 0, 0}
+#else
+#define POOL_INIT {NULL, 0, 0, 0, 0}
+#endif
+
+static struct mem_pool mem_poolv[MEM_POOL_CLASSES] = {
+	POOL_INIT, POOL_INIT, POOL_INIT, POOL_INIT, POOL_INIT,
+	POOL_INIT, POOL_INIT, POOL_INIT, POOL_INIT, POOL_INIT
+};
+/** Allocations above the largest class, counted in misses */
+static struct mem_pool mem_pool_large = POOL_INIT;
+
+
+#ifdef WIN32
+static volatile LONG pool_once;  /* 0: none, 1: initialising, 2: done */
+
+
+/*
+ * CRITICAL_SECTION has no static initialiser; the first allocation sets
+ * up all pool locks. Threads racing it wait once, at startup only.
+ */
+static void pool_init(void)
+{
+	int i;
+
+	if (pool_once == 2)
+		return;
+
+	if (InterlockedCompareExchange(&pool_once, 1, 0) != 0) {
+		while (pool_once != 2)
+			Sleep(1);
+		return;
+	}
+
+	for (i=0; i<MEM_POOL_CLASSES; i++)
+		InitializeCriticalSection(&mem_poolv[i].cs);
+	InitializeCriticalSection(&mem_pool_large.cs);
+
+	InterlockedExchange(&pool_once, 2);
+}
+#endif
+
+
+static inline void pool_lock(struct mem_pool *pool)
+{
+#ifdef WIN32
+	pool_init();
+	EnterCriticalSection(&pool->cs);
+#elif defined (HAVE_PTHREAD)
+	pthread_mutex_lock(&pool->mutex);
+#else
+	(void)pool;
+#endif
+}
+
+
+static inline void pool_unlock(struct mem_pool *pool)
+{
+#ifdef WIN32
+	LeaveCriticalSection(&pool->cs);
+#elif defined (HAVE_PTHREAD)
+	pthread_mutex_unlock(&pool->mutex);
+#else
+	(void)pool;
+#endif
+}
+
+
+static inline uint32_t pool_class(size_t size)
+{
+	uint32_t cls = 0;
+
+	if (size > MEM_POOL_MAXSIZE)
+		return MEM_POOL_NONE;
+
+	while (((size_t)1 << (cls + MEM_POOL_MINSHIFT)) < size)
+		++cls;
+
+	return cls;
+}
+
+
+static inline size_t pool_cap(uint32_t cls)
+{
+	return (size_t)1 << (cls + MEM_POOL_MINSHIFT);
+}
+
+
+static struct mem *block_alloc(size_t size)
+{
+	const uint32_t cls = pool_class(size);
+	struct mem_pool *pool;
+	struct mem *m;
+	size_t cap;
+
+	if (cls == MEM_POOL_NONE) {
+
+		m = malloc(sizeof(*m) + size);
+		if (!m)
+			return NULL;
+
+		pool_lock(&mem_pool_large);
+		++mem_pool_large.misses;
+		pool_unlock(&mem_pool_large);
+
+		m->cls = MEM_POOL_NONE;
+
+		return m;
+	}
+
+	pool = &mem_poolv[cls];
+	cap  = pool_cap(cls);
+
+	pool_lock(pool);
+
+	m = pool->freel;
+	if (m) {
+		pool->freel = *(struct mem **)(void *)(m + 1);
+		--pool->nfree;
+		++pool->hits;
+	}
+	else {
+		++pool->misses;
+	}
+
+	pool_unlock(pool);
+
+	if (!m) {
+		m = malloc(sizeof(*m) + cap);
+		if (!m)
+			return NULL;
+	}
+
+	m->cls = cls;
+
+	return m;
+}
+
+
+static void block_free(struct mem *m)
+{
+	struct mem_pool *pool;
+
+	if (m->cls == MEM_POOL_NONE) {
+		free(m);
+		return;
+	}
+
+	pool = &mem_poolv[m->cls];
+
+	pool_lock(pool);
+
+	if (!pool->maxfree)
+		pool->maxfree = (uint32_t)(MEM_POOL_MAXBYTES / pool_cap(m->cls));
+
+	if (pool->nfree < pool->maxfree) {
+		*(struct mem **)(void *)(m + 1) = pool->freel;
+		pool->freel = m;
+		++pool->nfree;
+		m = NULL;
+	}
+
+	pool_unlock(pool);
+
+	free(m);
+}
+
+
+static struct mem *block_realloc(struct mem *m, size_t size)
+{
+	struct mem *m2;
+	size_t len = size;
+	uint32_t cls;
+
+	if (m->cls == MEM_POOL_NONE) {
+
+		if (size > MEM_POOL_MAXSIZE)
+			return realloc(m, sizeof(*m2) + size);
+	}
+	else {
+		const size_t cap = pool_cap(m->cls);
+
+		if (size <= cap)
+			return m;
+
+		len = cap;
+	}
+
+	/* malloc'ed blocks are always larger than MEM_POOL_MAXSIZE, so
+	   shrinking one into a size class copies the new size only */
+	m2 = block_alloc(size);
+	if (!m2)
+		return NULL;
+
+	cls = m2->cls;
+
+	memcpy(m2, m, sizeof(*m) + len);
+
+	m2->cls = cls;
+
+	block_free(m);
+
+	return m2;
+}
+
+
+/**
+ * Release all memory blocks cached by the pooled allocator
+ */
+void mem_pool_flush(void)
+{
+	int i;
+
+	for (i=0; i<MEM_POOL_CLASSES; i++) {
+
+		struct mem_pool *pool = &mem_poolv[i];
+		struct mem *m;
+
+		pool_lock(pool);
+		m = pool->freel;
+		pool->freel = NULL;
+		pool->nfree = 0;
+		pool_unlock(pool);
+
+		while (m) {
+			struct mem *next = *(struct mem **)(void *)(m + 1);
+			free(m);
+			m = next;
+		}
+	}
+}
+
+
+static int pool_status(struct re_printf *pf)
+{
+	uint64_t large;
+	int err = 0;
+	int i;
+
+	err |= re_hprintf(pf, "Memory pool: (%u size classes, max %u bytes)\n",
+			  MEM_POOL_CLASSES, MEM_POOL_MAXSIZE);
+
+	for (i=0; i<MEM_POOL_CLASSES; i++) {
+
+		struct mem_pool *pool = &mem_poolv[i];
+		uint64_t hits, misses;
+		uint32_t nfree;
+
+		pool_lock(pool);
+		hits   = pool->hits;
+		misses = pool->misses;
+		nfree  = pool->nfree;
+		pool_unlock(pool);
+
+		if (!hits && !misses)
+			continue;
+
+		err |= re_hprintf(pf, " %5u bytes: hits=%llu misses=%llu"
+				  " free=%u\n",
+				  1u << (i + MEM_POOL_MINSHIFT),
+				  hits, misses, nfree);
+	}
+
+	pool_lock(&mem_pool_large);
+	large = mem_pool_large.misses;
+	pool_unlock(&mem_pool_large);
+
+	err |= re_hprintf(pf, " Large: %llu allocations\n", large);
+
+	return err;
+}
+
+#else
+
+#define block_alloc(size)       malloc(sizeof(struct mem) + (size))
+#define block_realloc(m, size)  realloc((m), sizeof(struct mem) + (size))
+#define block_free(m)           free(m)
+
+
+/**
+ * Release all memory blocks cached by the pooled allocator
+ */
+void mem_pool_flush(void)
+{
+}
+
+#endif
+
+
 /**
  * Allocate a new reference-counted memory object
  *
@@ -136,7 +484,7 @@ void *mem_alloc(size_t size, mem_destroy_h *dh)
 	mem_unlock();
 #endif
 
-	m = malloc(sizeof(*m) + size);
+	m = block_alloc(size);
 	if (!m)
 		return NULL;
 
@@ -214,7 +562,7 @@ void *mem_realloc(void *data, size_t size)
 	mem_unlock();
 #endif
 
-	m2 = realloc(m, sizeof(*m2) + size);
+	m2 = block_realloc(m, size);
 
 #if MEM_DEBUG
 	mem_lock();
@@ -293,7 +641,7 @@ void *mem_deref(void *data)
 
 	STAT_DEREF(m);
 
-	free(m);
+	block_free(m);
 
 	return NULL;
 }
@@ -423,6 +771,10 @@ int mem_status(struct re_printf *pf, void *unused)
 
 	(void)unused;
 
+#if MEM_POOL
+	err |= pool_status(pf);
+#endif
+
 	mem_lock();
 	memcpy(&stat, &memstat, sizeof(stat));
 	c = list_count(&meml);
@@ -443,6 +795,9 @@ int mem_status(struct re_printf *pf, void *unused)
 	err |= re_hprintf(pf, " Total %u blocks allocated\n", c);
 
 	return err;
+#elif MEM_POOL
+	(void)unused;
+	return pool_status(pf);
 #else
 	(void)pf;
 	(void)unused;
@@ -409,20 +409,9 @@ int rtp_decode(struct rtp_sock *rs, struct mbuf *mb,
 }
 
 
-/**
- * Send an RTP packet to a peer
- *
- * @param rs     RTP Socket
- * @param dst    Destination address
- * @param marker Marker bit
- * @param pt     Payload type
- * @param ts     Timestamp
- * @param mb     Payload buffer
- *
- * @return 0 for success, otherwise errorcode
- */
-int rtp_send(struct rtp_sock *rs, const struct sa *dst,
-	     bool marker, uint8_t pt, uint32_t ts, struct mbuf *mb)
+static int rtp_send_internal(struct rtp_sock *rs, const struct sa *dst,
+			     bool marker, uint8_t pt, uint32_t ts,
+			     struct mbuf *mb, bool queue)
 {
 	size_t pos;
 	int err;
@@ -450,7 +439,49 @@ int rtp_send(struct rtp_sock *rs, const struct sa *dst,
 
 	mb->pos = pos;
 
-	return udp_send(rs->sock_rtp, dst, mb);
+	if (queue)
+		return udp_send_queue(rs->sock_rtp, dst, mb);
+	else
+		return udp_send(rs->sock_rtp, dst, mb);
+}
+
+
+/**
+ * Send an RTP packet to a peer
+ *
+ * @param rs     RTP Socket
+ * @param dst    Destination address
+ * @param marker Marker bit
+ * @param pt     Payload type
+ * @param ts     Timestamp
+ * @param mb     Payload buffer
+ *
+ * @return 0 for success, otherwise errorcode
+ */
+int rtp_send(struct rtp_sock *rs, const struct sa *dst,
+	     bool marker, uint8_t pt, uint32_t ts, struct mbuf *mb)
+{
+	return rtp_send_internal(rs, dst, marker, pt, ts, mb, false);
+}
+
+
+/**
+ * Queue an RTP packet on the send queue of the RTP transport socket.
+ * The queued packets are sent by udp_send_flush() on rtp_sock()
+ *
+ * @param rs     RTP Socket
+ * @param dst    Destination address
+ * @param marker Marker bit
+ * @param pt     Payload type
+ * @param ts     Timestamp
+ * @param mb     Payload buffer
+ *
+ * @return 0 for success, otherwise errorcode
+ */
+int rtp_send_queue(struct rtp_sock *rs, const struct sa *dst,
+		   bool marker, uint8_t pt, uint32_t ts, struct mbuf *mb)
+{
+	return rtp_send_internal(rs, dst, marker, pt, ts, mb, true);
 }
 
 
@@ -118,6 +118,14 @@ static void destructor(void *arg)
 }
 
 
+static uint32_t ctrans_key(const struct le *le)
+{
+	const struct sip_ctrans *ct = le->data;
+
+	return hash_joaat_str(ct->branch);
+}
+
+
 static bool cmp_handler(struct le *le, void *arg)
 {
 	struct sip_ctrans *ct = le->data;
@@ -405,7 +413,11 @@ int sip_ctrans_init(struct sip *sip, uint32_t sz)
 	if (err)
 		return err;
 
-	return hash_alloc(&sip->ht_ctrans, sz);
+	err = hash_alloc(&sip->ht_ctrans, sz);
+	if (err)
+		return err;
+
+	return hash_autosize(sip->ht_ctrans, ctrans_key);
 }
 
 
@@ -443,6 +455,7 @@ int sip_ctrans_debug(struct re_printf *pf, const struct sip *sip)
 
 	err = re_hprintf(pf, "client transactions:\n");
 	hash_apply(sip->ht_ctrans, debug_handler, pf);
+	err |= hash_debug(pf, sip->ht_ctrans);
 
 	return err;
 }
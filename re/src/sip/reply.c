@@ -77,7 +77,7 @@ static int vreplyf(struct sip_strans **stp, struct mbuf **mbp, bool trans,
 					   &hdr->val);
 			if (!pl_isset(&msg->to.tag) && scode > 100)
 				err |= mbuf_printf(mb, ";tag=%016llx",
-						   msg->tag);
+						   sip_msg_tag(msg));
 			err |= mbuf_write_str(mb, "\r\n");
 			break;
 
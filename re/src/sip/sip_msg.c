@@ -4,6 +4,8 @@
  * Copyright (C) 2010 Creytiv.com
  */
 #include <re_types.h>
+#include <stddef.h>
+#include <string.h>
 #include <ctype.h>
 #include <re_mem.h>
 #include <re_sys.h>
@@ -20,28 +22,78 @@
 
 enum {
 	HDR_HASH_SIZE = 32,
+	HDR_BLOCK     = 32,
 	STARTLINE_MAX = 8192,
 };
 
 
-static void hdr_destructor(void *arg)
+/** A block of SIP Headers */
+struct hdr_blk {
+	struct hdr_blk *next;
+	uint32_t n;
+	struct sip_hdr hdrv[HDR_BLOCK];
+};
+
+/**
+ * SIP Message and its headers, allocated as one object. The headers
+ * are kept in the inline block; only large messages spill into extra
+ * blocks. Headers live as long as the message and are never unlinked.
+ */
+struct msg_store {
+	struct sip_msg msg;                /* must be first */
+	struct list hdrht[HDR_HASH_SIZE];  /**< Atomic headers by ID    */
+	struct hdr_blk *blk;               /**< Block being filled      */
+	struct hdr_blk blk0;               /**< Inline block, not zeroed */
+};
+
+
+static void destructor(void *arg)
 {
-	struct sip_hdr *hdr = arg;
+	struct msg_store *ms = arg;
+	struct hdr_blk *blk = ms->blk0.next;
+
+	while (blk) {
+		struct hdr_blk *next = blk->next;
+
+		mem_deref(blk);
+		blk = next;
+	}
 
-	list_unlink(&hdr->le);
-	hash_unlink(&hdr->he);
+	mem_deref(ms->msg.sock);
+	mem_deref(ms->msg.mb);
 }
 
 
-static void destructor(void *arg)
+static inline struct list *hdr_list(const struct sip_msg *msg,
+				    enum sip_hdrid id)
 {
-	struct sip_msg *msg = arg;
+	struct msg_store *ms = (struct msg_store *)msg;
 
-	list_flush(&msg->hdrl);
-	hash_flush(msg->hdrht);
-	mem_deref(msg->hdrht);
-	mem_deref(msg->sock);
-	mem_deref(msg->mb);
+	return &ms->hdrht[id & (HDR_HASH_SIZE - 1)];
+}
+
+
+static struct sip_hdr *hdr_get(struct sip_msg *msg)
+{
+	struct msg_store *ms = (struct msg_store *)msg;
+	struct sip_hdr *hdr;
+
+	if (ms->blk->n == HDR_BLOCK) {
+
+		struct hdr_blk *blk = mem_alloc(sizeof(*blk), NULL);
+		if (!blk)
+			return NULL;
+
+		blk->next = NULL;
+		blk->n = 0;
+		ms->blk->next = blk;
+		ms->blk = blk;
+	}
+
+	hdr = &ms->blk->hdrv[ms->blk->n++];
+	memset(hdr, 0, sizeof(*hdr));
+
+	return hdr;
 }
 
 
@@ -152,37 +204,41 @@ static inline int hdr_add(struct sip_msg *msg, const struct pl *name,
 			  enum sip_hdrid id, const char *p, ssize_t l,
 			  bool atomic, bool line)
 {
-	struct sip_hdr *hdr;
+	struct sip_hdr *hdr, tmp;
 	int err = 0;
 
-	hdr = mem_zalloc(sizeof(*hdr), hdr_destructor);
-	if (!hdr)
-		return ENOMEM;
-
-	hdr->name  = *name;
-	hdr->val.p = p;
-	hdr->val.l = MAX(l, 0);
-	hdr->id    = id;
-
 	switch (id) {
 
 	case SIP_HDR_VIA:
 	case SIP_HDR_ROUTE:
-		if (!atomic)
-			break;
-
-		hash_append(msg->hdrht, id, &hdr->he, mem_ref(hdr));
-		list_append(&msg->hdrl, &hdr->le, mem_ref(hdr));
+		line = atomic;
 		break;
 
 	default:
-		if (atomic)
-			hash_append(msg->hdrht, id, &hdr->he, mem_ref(hdr));
-		if (line)
-			list_append(&msg->hdrl, &hdr->le, mem_ref(hdr));
 		break;
 	}
 
+	/* a header that is not stored is only needed for parsing */
+	if (atomic || line) {
+		hdr = hdr_get(msg);
+		if (!hdr)
+			return ENOMEM;
+	}
+	else {
+		hdr = &tmp;
+		memset(hdr, 0, sizeof(*hdr));
+	}
+
+	hdr->name  = *name;
+	hdr->val.p = p;
+	hdr->val.l = MAX(l, 0);
+	hdr->id    = id;
+
+	if (atomic)
+		list_append(hdr_list(msg, id), &hdr->he, hdr);
+	if (line)
+		list_append(&msg->hdrl, &hdr->le, hdr);
+
 	/* parse common headers */
 	switch (id) {
 
@@ -254,8 +310,6 @@ static inline int hdr_add(struct sip_msg *msg, const struct pl *name,
 		break;
 	}
 
-	mem_deref(hdr);
-
 	if (err == ENOENT) {
 		/* this would look better than ENOENT returned by regexp search */
 		err = EBADMSG;
@@ -264,6 +318,53 @@ static inline int hdr_add(struct sip_msg *msg, const struct pl *name,
 }
 
 
+static inline bool is_lws(char c)
+{
+	return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+
+/*
+ * Split the start line into its three fields, same as the regex
+ * "[^ \t\r\n]+ [^ \t\r\n]+ [^\r\n]*[\r]*[\n]1" anchored at p.
+ * On success eol points past the line feed.
+ */
+static bool startline_decode(const char *p, size_t l, struct pl *x,
+			     struct pl *y, struct pl *z, const char **eol)
+{
+	const char *end = p + l;
+	const char *q = p;
+
+	x->p = q;
+	while (q < end && !is_lws(*q))
+		++q;
+	x->l = q - x->p;
+	if (!x->l || q == end || *q++ != ' ')
+		return false;
+
+	y->p = q;
+	while (q < end && !is_lws(*q))
+		++q;
+	y->l = q - y->p;
+	if (!y->l || q == end || *q++ != ' ')
+		return false;
+
+	z->p = q;
+	while (q < end && *q != '\r' && *q != '\n')
+		++q;
+	z->l = q - z->p;
+
+	while (q < end && *q == '\r')
+		++q;
+	if (q == end || *q++ != '\n')
+		return false;
+
+	*eol = q;
+
+	return true;
+}
+
+
 /**
  * Decode a SIP message
  *
@@ -274,8 +375,9 @@ static inline int hdr_add(struct sip_msg *msg, const struct pl *name,
  */
 int sip_msg_decode(struct sip_msg **msgp, struct mbuf *mb)
 {
-	struct pl x, y, z, e, name;
-	const char *p, *v, *cv;
+	struct pl x, y, z, name;
+	const char *p, *v, *cv, *eol;
+	struct msg_store *ms;
 	struct sip_msg *msg;
 	bool comsep, quote;
 	enum sip_hdrid id = SIP_HDR_NONE;
@@ -289,21 +391,21 @@ int sip_msg_decode(struct sip_msg **msgp, struct mbuf *mb)
 	p = (const char *)mbuf_buf(mb);
 	l = mbuf_get_left(mb);
 
-	if (re_regex(p, l, "[^ \t\r\n]+ [^ \t\r\n]+ [^\r\n]*[\r]*[\n]1",
-		     &x, &y, &z, NULL, &e) || x.p != (char *)mbuf_buf(mb))
+	if (!startline_decode(p, l, &x, &y, &z, &eol))
 		return (l > STARTLINE_MAX) ? EBADMSG : ENODATA;
 
-	msg = mem_zalloc(sizeof(*msg), destructor);
-	if (!msg)
+	/* the header storage is set up by hdr_get() */
+	ms = mem_alloc(sizeof(*ms), destructor);
+	if (!ms)
 		return ENOMEM;
 
-	msg->mb_msg = *mb;
-
-	err = hash_alloc(&msg->hdrht, HDR_HASH_SIZE);
-	if (err)
-		goto out;
+	memset(ms, 0, offsetof(struct msg_store, blk0));
+	ms->blk0.next = NULL;
+	ms->blk0.n = 0;
+	ms->blk = &ms->blk0;
+	msg = &ms->msg;
 
-	msg->tag = rand_u64();
+	msg->mb_msg = *mb;
 	msg->mb  = mem_ref(mb);
 	msg->req = (0 == pl_strcmp(&z, "SIP/2.0"));
 	msg->call_info.answer_after = -1;
@@ -330,8 +432,8 @@ int sip_msg_decode(struct sip_msg **msgp, struct mbuf *mb)
 		}
 	}
 
-	l -= e.p + e.l - p;
-	p = e.p + e.l;
+	l -= eol - p;
+	p = eol;
 
 	name.p = v = cv = NULL;
 	name.l = ws = lf = 0;
@@ -456,6 +558,26 @@ int sip_msg_decode(struct sip_msg **msgp, struct mbuf *mb)
 }
 
 
+/**
+ * Get the local tag of a SIP Message, used as To-tag in the replies.
+ * It is generated on first use, most messages never need one.
+ *
+ * @param msg SIP Message
+ *
+ * @return Local tag
+ */
+uint64_t sip_msg_tag(const struct sip_msg *msg)
+{
+	if (!msg)
+		return 0;
+
+	if (!msg->tag)
+		((struct sip_msg *)msg)->tag = rand_u64();
+
+	return msg->tag;
+}
+
+
 /**
  * Get a SIP Header from a SIP Message
  *
@@ -491,7 +613,7 @@ const struct sip_hdr *sip_msg_hdr_apply(const struct sip_msg *msg,
 	if (!msg)
 		return NULL;
 
-	lst = hash_list(msg->hdrht, id);
+	lst = hdr_list(msg, id);
 
 	le = fwd ? list_head(lst) : list_tail(lst);
 
@@ -549,7 +671,7 @@ const struct sip_hdr *sip_msg_xhdr_apply(const struct sip_msg *msg,
 
 	pl_set_str(&pl, name);
 
-	lst = hash_list(msg->hdrht, hdr_hash(&pl));
+	lst = hdr_list(msg, hdr_hash(&pl));
 
 	le = fwd ? list_head(lst) : list_tail(lst);
 
@@ -676,7 +798,7 @@ void sip_msg_dump(const struct sip_msg *msg)
 
 	for (i=0; i<HDR_HASH_SIZE; i++) {
 
-		le = list_head(hash_list(msg->hdrht, i));
+		le = list_head(hdr_list(msg, (enum sip_hdrid)i));
 
 		while (le) {
 			const struct sip_hdr *hdr = le->data;
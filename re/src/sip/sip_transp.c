@@ -52,6 +52,8 @@ struct sip_conn {
 	struct tcp_conn *tc;
 	struct mbuf *mb;
 	struct sip *sip;
+	size_t scan;      /**< Header end search resumes here      */
+	size_t msglen;    /**< Length of pending message, if known */
 	uint32_t ka_interval;
 	bool established;
 };
@@ -325,17 +327,80 @@ static void udp_recv_handler(const struct sa *src, struct mbuf *mb, void *arg)
 }
 
 
+/*
+ * Search the buffered data for the empty line that ends the header,
+ * continuing where the previous search stopped. A line feed at the very
+ * end is searched again when more data has arrived.
+ */
+static bool conn_hdr_end(struct sip_conn *conn)
+{
+	const uint8_t *buf = mbuf_buf(conn->mb);
+	const size_t left = mbuf_get_left(conn->mb);
+	size_t i = conn->scan;
+
+	while (i < left) {
+
+		const uint8_t *lf = memchr(&buf[i], '\n', left - i);
+		size_t j;
+
+		if (!lf) {
+			i = left;
+			break;
+		}
+
+		i = lf - buf;
+		j = i + 1;
+
+		while (j < left && buf[j] == '\r')
+			++j;
+
+		if (j == left)
+			break;
+
+		if (buf[j] == '\n') {
+			conn->scan = j;
+			return true;
+		}
+
+		i = j;
+	}
+
+	conn->scan = i;
+
+	return false;
+}
+
+
 static void tcp_recv_handler(struct mbuf *mb, void *arg)
 {
 	struct sip_conn *conn = arg;
-	size_t pos;
 	int err = 0;
 
 	if (conn->tmr.th)
 		tmr_cancel(&conn->tmr);
 
 	if (conn->mb) {
-		pos = conn->mb->pos;
+		const size_t left = mbuf_get_left(conn->mb);
+
+		/* received messages share the buffer, so the unparsed data
+		   is moved to a new one before appending can reallocate it */
+		if (mem_nrefs(conn->mb->buf) > 1) {
+
+			struct mbuf *mbn = mbuf_alloc(left + mbuf_get_left(mb));
+			if (!mbn) {
+				err = ENOMEM;
+				goto out;
+			}
+
+			(void)mbuf_write_mem(mbn, mbuf_buf(conn->mb), left);
+
+			mem_deref(conn->mb);
+			conn->mb = mbn;
+		}
+		else if (conn->mb->pos) {
+			memmove(conn->mb->buf, mbuf_buf(conn->mb), left);
+			conn->mb->end = left;
+		}
 
 		conn->mb->pos = conn->mb->end;
 
@@ -343,7 +408,7 @@ static void tcp_recv_handler(struct mbuf *mb, void *arg)
 		if (err)
 			goto out;
 
-		conn->mb->pos = pos;
+		conn->mb->pos = 0;
 
 		if (mbuf_get_left(conn->mb) > TCP_BUFSIZE_MAX) {
 			err = EOVERFLOW;
@@ -356,8 +421,8 @@ static void tcp_recv_handler(struct mbuf *mb, void *arg)
 
 	for (;;) {
 		struct sip_msg *msg;
+		struct mbuf *mbm;
 		uint32_t clen;
-		size_t end;
 
 		if (mbuf_get_left(conn->mb) < 2)
 			break;
@@ -390,9 +455,25 @@ static void tcp_recv_handler(struct mbuf *mb, void *arg)
 			break;
 		}
 
-		pos = conn->mb->pos;
+		/* decode only once the header, or the whole message when
+		   its length is known, has been received */
+		if (conn->msglen) {
+			if (mbuf_get_left(conn->mb) < conn->msglen)
+				break;
+		}
+		else if (!conn_hdr_end(conn)) {
+			break;
+		}
+
+		/* the message gets its own view of the receive buffer */
+		mbm = mbuf_alloc_ref(conn->mb);
+		if (!mbm) {
+			err = ENOMEM;
+			break;
+		}
 
-		err = sip_msg_decode(&msg, conn->mb);
+		err = sip_msg_decode(&msg, mbm);
+		mem_deref(mbm);
 		if (err) {
 			if (err == ENODATA)
 				err = 0;
@@ -407,41 +488,29 @@ static void tcp_recv_handler(struct mbuf *mb, void *arg)
 
 		clen = pl_u32(&msg->clen);
 
-		if (mbuf_get_left(conn->mb) < clen) {
-			conn->mb->pos = pos;
+		if (mbuf_get_left(msg->mb) < clen) {
+			conn->msglen = msg->mb->pos - conn->mb->pos + clen;
 			mem_deref(msg);
 			break;
 		}
 
-		end = conn->mb->end;
-
 		msg->mb->end = msg->mb->pos + clen;
 		msg->sock = mem_ref(conn);
 		msg->src = conn->paddr;
 		msg->dst = conn->laddr;
 		msg->tp = conn->sc ? SIP_TRANSP_TLS : SIP_TRANSP_TCP;
 
+		conn->mb->pos = msg->mb->end;
+		conn->scan = 0;
+		conn->msglen = 0;
+
 		sip_recv(conn->sip, msg);
 		mem_deref(msg);
 
-		if (end <= conn->mb->end) {
+		if (!mbuf_get_left(conn->mb)) {
 			conn->mb = mem_deref(conn->mb);
 			break;
 		}
-
-		mb = mbuf_alloc(end - conn->mb->end);
-		if (!mb) {
-			err = ENOMEM;
-			goto out;
-		}
-
-		(void)mbuf_write_mem(mb, &conn->mb->buf[conn->mb->end],
-				     end - conn->mb->end);
-
-		mb->pos = 0;
-
-		mem_deref(conn->mb);
-		conn->mb = mb;
 	}
 
  out:
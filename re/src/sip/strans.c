@@ -138,6 +138,22 @@ static bool cmp_merge_handler(struct le *le, void *arg)
 }
 
 
+static uint32_t strans_key(const struct le *le)
+{
+	const struct sip_strans *st = le->data;
+
+	return hash_joaat_pl(&st->msg->via.branch);
+}
+
+
+static uint32_t strans_mrg_key(const struct le *le)
+{
+	const struct sip_strans *st = le->data;
+
+	return hash_joaat_pl(&st->msg->callid);
+}
+
+
 static void dummy_handler(void *arg)
 {
 	(void)arg;
@@ -210,7 +226,7 @@ static bool cancel_handler(struct sip *sip, const struct sip_msg *msg)
 	if (!st)
 		return false;
 
-	((struct sip_msg *)msg)->tag = st->msg->tag;
+	((struct sip_msg *)msg)->tag = sip_msg_tag(st->msg);
 
 	(void)sip_reply(sip, msg, 200, "OK");
 
@@ -410,7 +426,14 @@ int sip_strans_init(struct sip *sip, uint32_t sz)
 	if (err)
 		return err;
 
-	return hash_alloc(&sip->ht_strans, sz);
+	err = hash_alloc(&sip->ht_strans, sz);
+	if (err)
+		return err;
+
+	(void)hash_autosize(sip->ht_strans_mrg, strans_mrg_key);
+	(void)hash_autosize(sip->ht_strans, strans_key);
+
+	return 0;
 }
 
 
@@ -449,6 +472,7 @@ int sip_strans_debug(struct re_printf *pf, const struct sip *sip)
 
 	err = re_hprintf(pf, "server transactions:\n");
 	hash_apply(sip->ht_strans, debug_handler, pf);
+	err |= hash_debug(pf, sip->ht_strans);
 
 	return err;
 }
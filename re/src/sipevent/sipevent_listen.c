@@ -35,6 +35,22 @@ static void destructor(void *arg)
 }
 
 
+static uint32_t not_key(const struct le *le)
+{
+	const struct sipnot *not = le->data;
+
+	return hash_joaat_str(sip_dialog_callid(not->dlg));
+}
+
+
+static uint32_t sub_key(const struct le *le)
+{
+	const struct sipsub *sub = le->data;
+
+	return hash_joaat_str(sip_dialog_callid(sub->dlg));
+}
+
+
 static bool event_cmp(const struct sipevent_event *evt,
 		      const char *event, const char *id,
 		      int32_t refer_cseq)
@@ -394,6 +410,9 @@ int sipevent_listen(struct sipevent_sock **sockp, struct sip *sip,
 	if (err)
 		goto out;
 
+	(void)hash_autosize(sock->ht_not, not_key);
+	(void)hash_autosize(sock->ht_sub, sub_key);
+
 	sock->sip  = sip;
 	sock->subh = subh;
 	sock->arg  = arg;
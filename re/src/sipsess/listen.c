@@ -38,6 +38,14 @@ static void internal_connect_handler(const struct sip_msg *msg, void *arg)
 }
 
 
+static uint32_t sess_key(const struct le *le)
+{
+	const struct sipsess *sess = le->data;
+
+	return hash_joaat_str(sip_dialog_callid(sess->dlg));
+}
+
+
 static bool cmp_handler(struct le *le, void *arg)
 {
 	struct sipsess *sess = le->data;
@@ -330,6 +338,10 @@ int sipsess_listen(struct sipsess_sock **sockp, struct sip *sip,
 	if (err)
 		goto out;
 
+	err = hash_autosize(sock->ht_sess, sess_key);
+	if (err)
+		goto out;
+
 	err = hash_alloc(&sock->ht_ack, htsize);
 	if (err)
 		goto out;
@@ -37,24 +37,192 @@ enum {
 	MAX_BLOCKING = 100   /**< Maximum time spent in handler [ms] */
 };
 
-extern struct list *tmrl_get(void);
+extern struct tmrl *tmrl_get(void);
 
 
-static bool inspos_handler(struct le *le, void *arg)
+/** Range of the whole wheel [ms] */
+#define WHEEL_SPAN  ((uint64_t)1 << (TMR_WHEEL_BITS * TMR_WHEEL_LEVELS))
+
+
+/* Index of the lowest set bit, v must be non-zero */
+static unsigned bit_lowest(uint64_t v)
+{
+	unsigned n = 0;
+
+	if (!(v & 0xffffffffu)) { v >>= 32; n += 32; }
+	if (!(v & 0xffffu))     { v >>= 16; n += 16; }
+	if (!(v & 0xffu))       { v >>= 8;  n += 8;  }
+	if (!(v & 0xfu))        { v >>= 4;  n += 4;  }
+	if (!(v & 0x3u))        { v >>= 2;  n += 2;  }
+	if (!(v & 0x1u))        {           n += 1;  }
+
+	return n;
+}
+
+
+/* Level of a timer, i.e. the highest digit where it differs from now */
+static int wheel_level(uint64_t jfs, uint64_t now)
+{
+	uint64_t x = jfs ^ now;
+	int lvl = 0;
+
+	if (x >= WHEEL_SPAN)
+		return -1;
+
+	while (x >>= TMR_WHEEL_BITS)
+		++lvl;
+
+	return lvl;
+}
+
+
+static void wheel_insert(struct tmrl *tl, struct tmr *tmr)
+{
+	unsigned slot;
+	int lvl;
+
+	if (tmr->jfs <= tl->jfs) {
+		list_append(&tl->expired, &tmr->le, tmr);
+		return;
+	}
+
+	lvl = wheel_level(tmr->jfs, tl->jfs);
+	if (lvl < 0) {
+		list_append(&tl->far, &tmr->le, tmr);
+		return;
+	}
+
+	slot = (unsigned)(tmr->jfs >> (lvl * TMR_WHEEL_BITS))
+		& (TMR_WHEEL_SIZE - 1);
+
+	list_append(&tl->wheel[lvl][slot], &tmr->le, tmr);
+	tl->bm[lvl] |= (uint64_t)1 << slot;
+}
+
+
+static void wheel_unlink(struct tmrl *tl, struct tmr *tmr)
 {
-	struct tmr *tmr = le->data;
-	const uint64_t now = *(uint64_t *)arg;
+	struct list *l = tmr->le.list;
+	const struct list *first = &tl->wheel[0][0];
+	size_t idx;
+
+	list_unlink(&tmr->le);
+
+	if (l < first || l >= first + TMR_WHEEL_LEVELS * TMR_WHEEL_SIZE)
+		return;
+
+	if (!list_isempty(l))
+		return;
+
+	idx = l - first;
+	tl->bm[idx / TMR_WHEEL_SIZE] &=
+		~((uint64_t)1 << (idx % TMR_WHEEL_SIZE));
+}
+
+
+/* Re-insert all timers of a list relative to the current wheel time */
+static void wheel_cascade(struct tmrl *tl, struct list *l)
+{
+	struct le *le = l->head, *last = l->tail;
+
+	/* timers may be appended to the same list again (far list) */
+	while (le) {
+		struct tmr *tmr = le->data;
+		const bool done = (le == last);
+
+		le = le->next;
+
+		list_unlink(&tmr->le);
+		wheel_insert(tl, tmr);
+
+		if (done)
+			break;
+	}
+}
+
+
+static bool wheel_isempty(const struct tmrl *tl)
+{
+	int lvl;
+
+	for (lvl=0; lvl<TMR_WHEEL_LEVELS; lvl++) {
+		if (tl->bm[lvl])
+			return false;
+	}
+
+	return list_isempty(&tl->expired) && list_isempty(&tl->far);
+}
+
+
+/*
+ * Get the next wheel time at which a slot must be processed, either
+ * because timers expire or because a higher level slot must be cascaded.
+ * Returns 0 if no slot needs processing.
+ */
+static uint64_t wheel_next(const struct tmrl *tl)
+{
+	int lvl;
+
+	for (lvl=0; lvl<TMR_WHEEL_LEVELS; lvl++) {
+
+		const unsigned shift = lvl * TMR_WHEEL_BITS;
+		const unsigned digit = (unsigned)(tl->jfs >> shift)
+			& (TMR_WHEEL_SIZE - 1);
+		uint64_t pend;
+
+		/* slots after the current one on this level */
+		pend = tl->bm[lvl] & ~(((uint64_t)2 << digit) - 1);
+		if (!pend)
+			continue;
+
+		return (tl->jfs >> (shift + TMR_WHEEL_BITS)
+			<< (shift + TMR_WHEEL_BITS))
+			| ((uint64_t)bit_lowest(pend) << shift);
+	}
+
+	if (!list_isempty(&tl->far))
+		return (tl->jfs / WHEEL_SPAN + 1) * WHEEL_SPAN;
 
-	return tmr->jfs <= now;
+	return 0;
 }
 
 
-static bool inspos_handler_0(struct le *le, void *arg)
+/* Advance the wheel to now, moving expired slots to the expired list */
+static void wheel_advance(struct tmrl *tl, uint64_t now)
 {
-	struct tmr *tmr = le->data;
-	const uint64_t now = *(uint64_t *)arg;
+	while (tl->jfs < now) {
 
-	return tmr->jfs > now;
+		const uint64_t next = wheel_next(tl);
+		int lvl;
+
+		if (!next || next > now) {
+			tl->jfs = now;
+			break;
+		}
+
+		tl->jfs = next;
+
+		if (!(next % WHEEL_SPAN))
+			wheel_cascade(tl, &tl->far);
+
+		for (lvl=TMR_WHEEL_LEVELS-1; lvl>=0; lvl--) {
+
+			const unsigned shift = lvl * TMR_WHEEL_BITS;
+			const unsigned slot = (unsigned)(next >> shift)
+				& (TMR_WHEEL_SIZE - 1);
+			struct list *l = &tl->wheel[lvl][slot];
+
+			/* only slots whose lower digits are all zero */
+			if (next & (((uint64_t)1 << shift) - 1))
+				continue;
+
+			if (!(tl->bm[lvl] & ((uint64_t)1 << slot)))
+				continue;
+
+			tl->bm[lvl] &= ~((uint64_t)1 << slot);
+			wheel_cascade(tl, l);
+		}
+	}
 }
 
 
@@ -80,18 +248,21 @@ static void call_handler(tmr_h *th, void *arg)
 /**
  * Poll all timers in the current thread
  *
- * @param tmrl Timer list
+ * @param tmrl Timer wheel
  */
-void tmr_poll(struct list *tmrl)
+void tmr_poll(struct tmrl *tmrl)
 {
-	const uint64_t jfs = tmr_jiffies();
+	uint64_t jfs;
+
+	wheel_advance(tmrl, tmr_jiffies());
+	jfs = tmrl->jfs;
 
 	for (;;) {
 		struct tmr *tmr;
 		tmr_h *th;
 		void *th_arg;
 
-		tmr = list_ledata(tmrl->head);
+		tmr = list_ledata(tmrl->expired.head);
 
 		if (!tmr || (tmr->jfs > jfs)) {
 			break;
@@ -148,51 +319,96 @@ uint64_t tmr_jiffies(void)
 }
 
 
+/**
+ * Convert timer jiffies to milliseconds since the Unix epoch, e.g. for
+ * the absolute timeout of pthread_cond_timedwait()
+ *
+ * @param jfs Jiffies in [ms], as from tmr_jiffies()
+ *
+ * @return Milliseconds since 1970-01-01 UTC
+ */
+uint64_t tmr_jiffies_unix(uint64_t jfs)
+{
+#if defined(WIN32)
+	/* jiffies count from the FILETIME epoch (1601) */
+	jfs -= (uint64_t)11644473600 * 1000;
+#endif
+
+	return jfs;
+}
+
+
 /**
  * Get number of milliseconds until the next timer expires
  *
- * @param tmrl Timer-list
+ * @param tmrl Timer wheel
  *
  * @return Number of [ms], or 0 if no active timers
+ *
+ * @note The returned value may be shorter than the actual expiry when a
+ *       higher wheel level has to be cascaded first
  */
-uint64_t tmr_next_timeout(struct list *tmrl)
+uint64_t tmr_next_timeout(struct tmrl *tmrl)
 {
 	const uint64_t jif = tmr_jiffies();
-	const struct tmr *tmr;
+	uint64_t next;
 
-	tmr = list_ledata(tmrl->head);
-	if (!tmr)
+	if (!list_isempty(&tmrl->expired))
+		return 1;
+
+	next = wheel_next(tmrl);
+	if (!next)
 		return 0;
 
-	if (tmr->jfs <= jif)
+	if (next <= jif)
 		return 1;
 	else
-		return tmr->jfs - jif;
+		return next - jif;
 }
 
 
-int tmr_status(struct re_printf *pf, void *unused)
+static int status_list(struct re_printf *pf, const struct list *l)
 {
-	struct list *tmrl = tmrl_get();
 	struct le *le;
+	int err = 0;
+
+	for (le = l->head; le; le = le->next) {
+		const struct tmr *tmr = le->data;
+
+		err |= re_hprintf(pf, "  %p: th=%p expire=%llums\n",
+				  tmr, tmr->th,
+				  (unsigned long long)tmr_get_expire(tmr));
+	}
+
+	return err;
+}
+
+
+int tmr_status(struct re_printf *pf, void *unused)
+{
+	struct tmrl *tmrl = tmrl_get();
 	uint32_t n;
+	int lvl, slot;
 	int err;
 
 	(void)unused;
 
-	n = list_count(tmrl);
+	n = list_count(&tmrl->expired) + list_count(&tmrl->far);
+	for (lvl=0; lvl<TMR_WHEEL_LEVELS; lvl++) {
+		for (slot=0; slot<TMR_WHEEL_SIZE; slot++)
+			n += list_count(&tmrl->wheel[lvl][slot]);
+	}
 	if (!n)
 		return 0;
 
 	err = re_hprintf(pf, "Timers (%u):\n", n);
 
-	for (le = tmrl->head; le; le = le->next) {
-		const struct tmr *tmr = le->data;
-
-		err |= re_hprintf(pf, "  %p: th=%p expire=%llums\n",
-				  tmr, tmr->th,
-				  (unsigned long long)tmr_get_expire(tmr));
+	err |= status_list(pf, &tmrl->expired);
+	for (lvl=0; lvl<TMR_WHEEL_LEVELS; lvl++) {
+		for (slot=0; slot<TMR_WHEEL_SIZE; slot++)
+			err |= status_list(pf, &tmrl->wheel[lvl][slot]);
 	}
+	err |= status_list(pf, &tmrl->far);
 
 	if (n > 100)
 		err |= re_hprintf(pf, "    (Dumped Timers: %u)\n", n);
@@ -206,7 +422,7 @@ int tmr_status(struct re_printf *pf, void *unused)
  */
 void tmr_debug(void)
 {
-	if (!list_isempty(tmrl_get()))
+	if (!wheel_isempty(tmrl_get()))
 		(void)re_printf("%H", tmr_status, NULL);
 }
 
@@ -235,14 +451,14 @@ void tmr_init(struct tmr *tmr)
  */
 void tmr_start(struct tmr *tmr, uint64_t delay, tmr_h *th, void *arg)
 {
-	struct list *tmrl = tmrl_get();
-	struct le *le;
+	struct tmrl *tmrl = tmrl_get();
+	uint64_t jfs;
 
 	if (!tmr)
 		return;
 
 	if (tmr->th) {
-		list_unlink(&tmr->le);
+		wheel_unlink(tmrl, tmr);
 	}
 
 	tmr->th  = th;
@@ -251,26 +467,16 @@ void tmr_start(struct tmr *tmr, uint64_t delay, tmr_h *th, void *arg)
 	if (!th)
 		return;
 
-	tmr->jfs = delay + tmr_jiffies();
+	jfs = tmr_jiffies();
 
-	if (delay == 0) {
-		le = list_apply(tmrl, true, inspos_handler_0, &tmr->jfs);
-		if (le) {
-			list_insert_before(tmrl, le, &tmr->le, tmr);
-		}
-		else {
-			list_append(tmrl, &tmr->le, tmr);
-		}
-	}
-	else {
-		le = list_apply(tmrl, false, inspos_handler, &tmr->jfs);
-		if (le) {
-			list_insert_after(tmrl, le, &tmr->le, tmr);
-		}
-		else {
-			list_prepend(tmrl, &tmr->le, tmr);
-		}
-	}
+	/* an idle wheel may lag behind, resync it */
+	if (tmrl->jfs < jfs && wheel_isempty(tmrl))
+		tmrl->jfs = jfs;
+
+	/* never schedule behind the wheel (e.g. system clock stepped back) */
+	tmr->jfs = delay + max(jfs, tmrl->jfs);
+
+	wheel_insert(tmrl, tmr);
 
 #ifdef HAVE_ACTSCHED
 	/* TODO: this is a hack. when a new timer is started we must reset
@@ -388,6 +388,19 @@ int udp_send(struct udp_sock *us, const struct sa *dst, struct mbuf *mb)
 }
 
 
+int udp_send_queue(struct udp_sock *us, const struct sa *dst,
+		   struct mbuf *mb)
+{
+	return udp_send(us, dst, mb);
+}
+
+
+int udp_send_flush(struct udp_sock *us)
+{
+	return us ? 0 : EINVAL;
+}
+
+
 int udp_local_get(const struct udp_sock *us, struct sa *local)
 {
 	if (!us || !local)
@@ -436,6 +449,13 @@ void udp_rxsz_set(struct udp_sock *us, size_t rxsz)
 }
 
 
+void udp_rxpool_set(struct udp_sock *us, uint32_t n)
+{
+	(void)us;
+	(void)n;
+}
+
+
 /**
  * Set preallocated space on receive buffer.
  *
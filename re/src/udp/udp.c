@@ -22,10 +22,15 @@
 #ifdef __APPLE__
 #include "TargetConditionals.h"
 #endif
+#if defined (HAVE_RECVMMSG) || defined (HAVE_SENDMMSG)
+#include <sys/socket.h>
+#include <sys/uio.h>
+#endif
 #include <re_fmt.h>
 #include <re_mem.h>
 #include <re_mbuf.h>
 #include <re_list.h>
+#include <re_lock.h>
 #include <re_main.h>
 #include <re_sa.h>
 #include <re_net.h>
@@ -55,7 +60,47 @@
 
 
 enum {
-	UDP_RXSZ_DEFAULT = 8192
+	UDP_RXSZ_DEFAULT = 8192,
+	UDP_RXPOOL_MAX   = 16,   /**< Maximum buffers in receive pool   */
+	UDP_RXBATCH      = 8,    /**< Maximum datagrams per read event  */
+	UDP_TXBATCH      = 16,   /**< Maximum queued datagrams          */
+	UDP_TXSLOT_SIZE  = 2048  /**< Maximum size of a queued datagram */
+};
+
+
+/** Defines a queued outgoing datagram */
+struct udp_txent {
+	struct sa dst;                  /**< Destination address     */
+	size_t len;                     /**< Length of datagram      */
+	uint8_t buf[UDP_TXSLOT_SIZE];   /**< Datagram payload        */
+};
+
+/** Defines the send queue of a UDP socket */
+struct udp_txq {
+	struct udp_txent entv[UDP_TXBATCH];
+	uint32_t n;                     /**< Number of queued entries */
+};
+
+
+/**
+ * Defines a pool of receive buffers. The mbufs handed to the receive
+ * handler give their buffer back when the last reference is dropped,
+ * possibly from another thread, and may outlive the socket.
+ */
+struct udp_rxpool {
+	struct lock *lock;              /**< Protects the fields below  */
+	uint8_t *bufv[UDP_RXPOOL_MAX];  /**< Free buffers               */
+	uint32_t n;                     /**< Number of free buffers     */
+	uint32_t max;                   /**< Maximum free buffers       */
+	uint32_t users;                 /**< Number of pooled mbufs     */
+	bool closed;                    /**< Socket released the pool   */
+	size_t sz;                      /**< Size of each buffer        */
+};
+
+/** Defines a receive mbuf with a buffer from the pool */
+struct udp_rxbuf {
+	struct mbuf mb;                 /**< Must be first              */
+	struct udp_rxpool *pool;        /**< Pool owning the buffer     */
 };
 
 
@@ -70,6 +115,8 @@ struct udp_sock {
 	size_t rxsz;         /**< Maximum receive chunk size  */
 	size_t rx_presz;     /**< Preallocated rx buffer size */
 	int err;             /**< Cached error code           */
+	struct udp_rxpool *rxpool; /**< Receive buffer pool or NULL */
+	struct udp_txq *txq; /**< Send queue, allocated on use */
 };
 
 /** Defines a UDP helper */
@@ -112,11 +159,125 @@ static bool helper_recv_handler(struct sa *src,
 }
 
 
+static void rxpool_destructor(void *data)
+{
+	struct udp_rxpool *pool = data;
+
+	while (pool->n > 0)
+		mem_deref(pool->bufv[--pool->n]);
+
+	mem_deref(pool->lock);
+}
+
+
+static int rxpool_alloc(struct udp_rxpool **poolp, size_t sz, uint32_t max)
+{
+	struct udp_rxpool *pool;
+	int err;
+
+	pool = mem_zalloc(sizeof(*pool), rxpool_destructor);
+	if (!pool)
+		return ENOMEM;
+
+	err = lock_alloc(&pool->lock);
+	if (err) {
+		mem_deref(pool);
+		return err;
+	}
+
+	pool->max = min(max, UDP_RXPOOL_MAX);
+	pool->sz  = sz;
+
+	*poolp = pool;
+
+	return 0;
+}
+
+
+/* The pool is freed by the socket or by the last pooled mbuf */
+static void rxpool_close(struct udp_rxpool *pool)
+{
+	bool last;
+
+	if (!pool)
+		return;
+
+	lock_write_get(pool->lock);
+	pool->closed = true;
+	last = (pool->users == 0);
+	lock_rel(pool->lock);
+
+	if (last)
+		mem_deref(pool);
+}
+
+
+/* Recycle the buffer, unless it was resized or is still shared */
+static void rxbuf_destructor(void *data)
+{
+	struct udp_rxbuf *rb = data;
+	struct udp_rxpool *pool = rb->pool;
+	uint8_t *buf = rb->mb.buf;
+	bool last;
+
+	lock_write_get(pool->lock);
+
+	if (buf && !pool->closed && pool->n < pool->max &&
+	    rb->mb.size == pool->sz && mem_nrefs(buf) == 1) {
+		pool->bufv[pool->n++] = buf;
+		buf = NULL;
+	}
+
+	last = (--pool->users == 0 && pool->closed);
+
+	lock_rel(pool->lock);
+
+	mem_deref(buf);
+
+	if (last)
+		mem_deref(pool);
+}
+
+
+static struct mbuf *rxbuf_get(struct udp_rxpool *pool)
+{
+	struct udp_rxbuf *rb;
+	uint8_t *buf = NULL;
+
+	rb = mem_zalloc(sizeof(*rb), rxbuf_destructor);
+	if (!rb)
+		return NULL;
+
+	rb->pool = pool;
+
+	lock_write_get(pool->lock);
+	if (pool->n > 0)
+		buf = pool->bufv[--pool->n];
+	++pool->users;
+	lock_rel(pool->lock);
+
+	if (!buf) {
+		buf = mem_alloc(pool->sz, NULL);
+		if (!buf)
+			return mem_deref(rb);
+	}
+
+	rb->mb.buf  = buf;
+	rb->mb.size = pool->sz;
+
+	return &rb->mb;
+}
+
+
 static void udp_destructor(void *data)
 {
 	struct udp_sock *us = data;
 
 	list_flush(&us->helpers);
+	rxpool_close(us->rxpool);
+
+	(void)udp_send_flush(us);
+	mem_deref(us->txq);
 
 	if (-1 != us->fd) {
 		fd_close(us->fd);
@@ -130,12 +291,87 @@ static void udp_destructor(void *data)
 }
 
 
+static void udp_recv_dispatch(struct udp_sock *us, struct sa *src,
+			      struct mbuf *mb)
+{
+	struct le *le;
+
+	/* call helpers */
+	le = us->helpers.head;
+	while (le) {
+		struct udp_helper *uh = le->data;
+		bool hdld;
+
+		le = le->next;
+
+		hdld = uh->recvh(src, mb, uh->arg);
+		if (hdld)
+			return;
+	}
+
+	us->rh(src, mb, us->arg);
+}
+
+
+static void udp_read_error(struct udp_sock *us, int err)
+{
+	if (EAGAIN == err)
+		return;
+
+#ifdef EWOULDBLOCK
+	if (EWOULDBLOCK == err)
+		return;
+#endif
+
+#if TARGET_OS_IPHONE
+	if (ENOTCONN == err) {
+
+		struct udp_sock *us_new;
+		struct sa laddr;
+
+		err = udp_local_get(us, &laddr);
+		if (err)
+			return;
+
+		if (-1 != us->fd) {
+			fd_close(us->fd);
+			(void)close(us->fd);
+			us->fd = -1;
+		}
+
+		if (-1 != us->fd6) {
+			fd_close(us->fd6);
+			(void)close(us->fd6);
+			us->fd6 = -1;
+		}
+
+		err = udp_listen(&us_new, &laddr, NULL, NULL);
+		if (err)
+			return;
+
+		us->fd  = us_new->fd;
+		us->fd6 = us_new->fd6;
+
+		us_new->fd  = -1;
+		us_new->fd6 = -1;
+
+		mem_deref(us_new);
+
+		udp_thread_attach(us);
+
+		return;
+	}
+#endif
+
+	/* cache error code */
+	us->err = err;
+}
+
+
 static void udp_read(struct udp_sock *us, int fd)
 {
 	struct mbuf *mb = mbuf_alloc(us->rxsz);
 	struct sa src;
-	struct le *le;
-	int err = 0;
 	ssize_t n;
 
 	if (!mb)
@@ -146,84 +382,139 @@ static void udp_read(struct udp_sock *us, int fd)
 		     mb->size - us->rx_presz, 0,
 		     &src.u.sa, &src.len);
 	if (n < 0) {
-		err = errno;
+		udp_read_error(us, errno);
+		goto out;
+	}
 
-		if (EAGAIN == err)
-			goto out;
+	mb->pos = us->rx_presz;
+	mb->end = n + us->rx_presz;
 
-#ifdef EWOULDBLOCK
-		if (EWOULDBLOCK == err)
-			goto out;
-#endif
+	(void)mbuf_resize(mb, mb->end);
 
-#if TARGET_OS_IPHONE
-		if (ENOTCONN == err) {
+	udp_recv_dispatch(us, &src, mb);
 
-			struct udp_sock *us_new;
-			struct sa laddr;
+ out:
+	mem_deref(mb);
+}
 
-			err = udp_local_get(us, &laddr);
-			if (err)
-				goto out;
 
-			if (-1 != us->fd) {
-				fd_close(us->fd);
-				(void)close(us->fd);
-				us->fd = -1;
-			}
+#ifdef HAVE_RECVMMSG
+static int udp_recv_batch(struct udp_sock *us, int fd,
+			  struct mbuf **mbv, struct sa *srcv)
+{
+	struct mmsghdr msgv[UDP_RXBATCH];
+	struct iovec iov[UDP_RXBATCH];
+	int i, cnt, n;
 
-			if (-1 != us->fd6) {
-				fd_close(us->fd6);
-				(void)close(us->fd6);
-				us->fd6 = -1;
-			}
+	for (cnt=0; cnt<UDP_RXBATCH; cnt++) {
 
-			err = udp_listen(&us_new, &laddr, NULL, NULL);
-			if (err)
-				goto out;
+		struct mbuf *mb = rxbuf_get(us->rxpool);
+		if (!mb)
+			break;
 
-			us->fd  = us_new->fd;
-			us->fd6 = us_new->fd6;
+		mbv[cnt] = mb;
 
-			us_new->fd  = -1;
-			us_new->fd6 = -1;
+		iov[cnt].iov_base = mb->buf + us->rx_presz;
+		iov[cnt].iov_len  = mb->size - us->rx_presz;
 
-			mem_deref(us_new);
+		memset(&msgv[cnt], 0, sizeof(msgv[cnt]));
+		msgv[cnt].msg_hdr.msg_name    = &srcv[cnt].u.sa;
+		msgv[cnt].msg_hdr.msg_namelen = sizeof(srcv[cnt].u);
+		msgv[cnt].msg_hdr.msg_iov     = &iov[cnt];
+		msgv[cnt].msg_hdr.msg_iovlen  = 1;
+	}
 
-			udp_thread_attach(us);
+	n = cnt ? recvmmsg(fd, msgv, cnt, MSG_DONTWAIT, NULL) : 0;
+	if (n < 0) {
+		if (errno != EAGAIN && errno != EWOULDBLOCK)
+			udp_read_error(us, errno);
+		n = 0;
+	}
 
-			goto out;
+	for (i=0; i<n; i++) {
+		srcv[i].len  = msgv[i].msg_hdr.msg_namelen;
+		mbv[i]->pos = us->rx_presz;
+		mbv[i]->end = us->rx_presz + msgv[i].msg_len;
+	}
+
+	for (i=n; i<cnt; i++)
+		mem_deref(mbv[i]);
+
+	return n;
+}
+#else
+static int udp_recv_batch(struct udp_sock *us, int fd,
+			  struct mbuf **mbv, struct sa *srcv)
+{
+	int n;
+
+	for (n=0; n<UDP_RXBATCH; n++) {
+
+		struct mbuf *mb = rxbuf_get(us->rxpool);
+		ssize_t len;
+
+		if (!mb)
+			break;
+
+		srcv[n].len = sizeof(srcv[n].u);
+		len = recvfrom(fd, BUF_CAST mb->buf + us->rx_presz,
+			       mb->size - us->rx_presz, 0,
+			       &srcv[n].u.sa, &srcv[n].len);
+		if (len < 0) {
+			/* the batch normally ends on an empty socket */
+#ifdef WIN32
+			const int err = WSAGetLastError();
+
+			if (err != WSAEWOULDBLOCK)
+				udp_read_error(us, err);
+#else
+			const int err = errno;
+
+			if (err != EAGAIN && err != EWOULDBLOCK)
+				udp_read_error(us, err);
+#endif
+			mem_deref(mb);
+			break;
 		}
+
+		mb->pos = us->rx_presz;
+		mb->end = len + us->rx_presz;
+		mbv[n] = mb;
+	}
+
+	return n;
+}
 #endif
 
-		/* cache error code */
-		us->err = err;
 
-		goto out;
-	}
+/*
+ * Pooled receive: drain up to UDP_RXBATCH datagrams per read event into
+ * mbufs with recycled buffers. The buffers are not trimmed, so that they
+ * can be reused for the next datagram once all handlers, e.g. a jitter
+ * buffer, have released them.
+ */
+static void udp_read_pooled(struct udp_sock *us, int fd)
+{
+	struct mbuf *mbv[UDP_RXBATCH];
+	struct sa srcv[UDP_RXBATCH];
+	int i, n;
 
-	mb->pos = us->rx_presz;
-	mb->end = n + us->rx_presz;
+	n = udp_recv_batch(us, fd, mbv, srcv);
+	if (n <= 0)
+		return;
 
-	(void)mbuf_resize(mb, mb->end);
+	/* a handler may destroy the socket while we are dispatching */
+	mem_ref(us);
 
-	/* call helpers */
-	le = us->helpers.head;
-	while (le) {
-		struct udp_helper *uh = le->data;
-		bool hdld;
+	for (i=0; i<n; i++) {
 
-		le = le->next;
+		if (mem_nrefs(us) > 1)
+			udp_recv_dispatch(us, &srcv[i], mbv[i]);
 
-		hdld = uh->recvh(&src, mb, uh->arg);
-		if (hdld)
-			goto out;
+		mem_deref(mbv[i]);
 	}
 
-	us->rh(&src, mb, us->arg);
-
- out:
-	mem_deref(mb);
+	mem_deref(us);
 }
 
 
@@ -233,7 +524,10 @@ static void udp_read_handler(int flags, void *arg)
 
 	(void)flags;
 
-	udp_read(us, us->fd);
+	if (us->rxpool)
+		udp_read_pooled(us, us->fd);
+	else
+		udp_read(us, us->fd);
 }
 
 
@@ -243,7 +537,10 @@ static void udp_read_handler6(int flags, void *arg)
 
 	(void)flags;
 
-	udp_read(us, us->fd6);
+	if (us->rxpool)
+		udp_read_pooled(us, us->fd6);
+	else
+		udp_read(us, us->fd6);
 }
 
 
@@ -411,8 +708,96 @@ void udp_connect(struct udp_sock *us, bool conn)
 }
 
 
+static inline int udp_fd(const struct udp_sock *us, const struct sa *dst)
+{
+	if (AF_INET6 == sa_af(dst) && -1 != us->fd6)
+		return us->fd6;
+	else
+		return us->fd;
+}
+
+
+static int udp_txq_append(struct udp_sock *us, const struct sa *dst,
+			  struct mbuf *mb)
+{
+	const size_t len = mbuf_get_left(mb);
+	struct udp_txent *ent;
+	int err = 0;
+
+	if (len > UDP_TXSLOT_SIZE) {
+
+		err = udp_send_flush(us);
+
+		if (sendto(udp_fd(us, dst), BUF_CAST mbuf_buf(mb), len,
+			   0, &dst->u.sa, dst->len) < 0)
+			err = errno;
+
+		return err;
+	}
+
+	if (!us->txq) {
+		us->txq = mem_alloc(sizeof(*us->txq), NULL);
+		if (!us->txq)
+			return ENOMEM;
+
+		us->txq->n = 0;
+	}
+	else if (us->txq->n >= UDP_TXBATCH) {
+		err = udp_send_flush(us);
+	}
+
+	ent = &us->txq->entv[us->txq->n++];
+
+	sa_cpy(&ent->dst, dst);
+	ent->len = len;
+	memcpy(ent->buf, mbuf_buf(mb), len);
+
+	return err;
+}
+
+
+#ifdef HAVE_SENDMMSG
+static int udp_txq_sendmmsg(struct udp_txq *txq, const struct udp_sock *us,
+			    int fd)
+{
+	struct mmsghdr msgv[UDP_TXBATCH];
+	struct iovec iov[UDP_TXBATCH];
+	int i, cnt = 0, n = 0;
+
+	for (i=0; i<(int)txq->n; i++) {
+
+		struct udp_txent *ent = &txq->entv[i];
+
+		if (udp_fd(us, &ent->dst) != fd)
+			continue;
+
+		iov[cnt].iov_base = ent->buf;
+		iov[cnt].iov_len  = ent->len;
+
+		memset(&msgv[cnt], 0, sizeof(msgv[cnt]));
+		msgv[cnt].msg_hdr.msg_name    = &ent->dst.u.sa;
+		msgv[cnt].msg_hdr.msg_namelen = ent->dst.len;
+		msgv[cnt].msg_hdr.msg_iov     = &iov[cnt];
+		msgv[cnt].msg_hdr.msg_iovlen  = 1;
+		++cnt;
+	}
+
+	while (n < cnt) {
+
+		int ret = sendmmsg(fd, &msgv[n], cnt - n, 0);
+		if (ret < 0)
+			return errno;
+
+		n += ret;
+	}
+
+	return 0;
+}
+#endif
+
+
 static int udp_send_internal(struct udp_sock *us, const struct sa *dst,
-			     struct mbuf *mb, struct le *le)
+			     struct mbuf *mb, struct le *le, bool queue)
 {
 	struct sa hdst;
 	int err = 0, fd;
@@ -425,10 +810,7 @@ static int udp_send_internal(struct udp_sock *us, const struct sa *dst,
 	}
 
 	/* choose a socket */
-	if (AF_INET6 == sa_af(dst) && -1 != us->fd6)
-		fd = us->fd6;
-	else
-		fd = us->fd;
+	fd = udp_fd(us, dst);
 
 	/* call helpers in reverse order */
 	while (le) {
@@ -445,6 +827,9 @@ static int udp_send_internal(struct udp_sock *us, const struct sa *dst,
 			return err;
 	}
 
+	if (queue && !us->conn)
+		return udp_txq_append(us, dst, mb);
+
 	/* Connected socket? */
 	if (us->conn) {
 		if (0 != connect(fd, &dst->u.sa, dst->len)) {
@@ -480,7 +865,78 @@ int udp_send(struct udp_sock *us, const struct sa *dst, struct mbuf *mb)
 	if (!us || !dst || !mb)
 		return EINVAL;
 
-	return udp_send_internal(us, dst, mb, us->helpers.tail);
+	return udp_send_internal(us, dst, mb, us->helpers.tail, false);
+}
+
+
+/**
+ * Queue a UDP Datagram for sending to a peer. The UDP helpers are applied
+ * immediately and the resulting datagram is copied to the send queue of
+ * the socket, which is sent in one batch by udp_send_flush(), or when
+ * the queue is full.
+ *
+ * @param us  UDP Socket
+ * @param dst Destination network address
+ * @param mb  Buffer to send
+ *
+ * @return 0 if success, otherwise errorcode
+ *
+ * @note The send queue is not locked, udp_send_queue() and
+ *       udp_send_flush() must be called from the same thread
+ */
+int udp_send_queue(struct udp_sock *us, const struct sa *dst,
+		   struct mbuf *mb)
+{
+	if (!us || !dst || !mb)
+		return EINVAL;
+
+	return udp_send_internal(us, dst, mb, us->helpers.tail, true);
+}
+
+
+/**
+ * Send all queued UDP Datagrams on a UDP Socket
+ *
+ * @param us UDP Socket
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int udp_send_flush(struct udp_sock *us)
+{
+	struct udp_txq *txq;
+	int err = 0;
+
+	if (!us)
+		return EINVAL;
+
+	txq = us->txq;
+	if (!txq || !txq->n)
+		return 0;
+
+#ifdef HAVE_SENDMMSG
+	if (-1 != us->fd)
+		err = udp_txq_sendmmsg(txq, us, us->fd);
+	if (-1 != us->fd6)
+		err |= udp_txq_sendmmsg(txq, us, us->fd6);
+#else
+	{
+		uint32_t i;
+
+		for (i=0; i<txq->n; i++) {
+
+			const struct udp_txent *ent = &txq->entv[i];
+
+			if (sendto(udp_fd(us, &ent->dst), BUF_CAST ent->buf,
+				   SIZ_CAST ent->len, 0,
+				   &ent->dst.u.sa, ent->dst.len) < 0)
+				err = errno;
+		}
+	}
+#endif
+
+	txq->n = 0;
+
+	return err;
 }
 
 
@@ -504,7 +960,7 @@ int udp_send_anon(const struct sa *dst, struct mbuf *mb)
 	if (err)
 		return err;
 
-	err = udp_send_internal(us, dst, mb, NULL);
+	err = udp_send_internal(us, dst, mb, NULL, false);
 	mem_deref(us);
 
 	return err;
@@ -607,6 +1063,38 @@ void udp_rxsz_set(struct udp_sock *us, size_t rxsz)
 		return;
 
 	us->rxsz = rxsz;
+
+	if (us->rxpool)
+		udp_rxpool_set(us, us->rxpool->max);
+}
+
+
+/**
+ * Enable pooled receive on a UDP Socket. Receive buffers of the maximum
+ * receive chunk size are recycled instead of being allocated for each
+ * datagram, and several datagrams are read per read event. A buffer goes
+ * back to the pool when the last reference to its mbuf is dropped, so
+ * the receive handler may keep the mbuf, also in another thread.
+ *
+ * @param us UDP Socket
+ * @param n  Number of receive buffers to keep, 0 to disable
+ */
+void udp_rxpool_set(struct udp_sock *us, uint32_t n)
+{
+	int err;
+
+	if (!us)
+		return;
+
+	rxpool_close(us->rxpool);
+	us->rxpool = NULL;
+
+	if (!n)
+		return;
+
+	err = rxpool_alloc(&us->rxpool, us->rxsz, n);
+	if (err)
+		DEBUG_WARNING("rxpool: %m\n", err);
 }
 
 
@@ -792,5 +1280,5 @@ int udp_send_helper(struct udp_sock *us, const struct sa *dst,
 	if (!us || !dst || !mb || !uh)
 		return EINVAL;
 
-	return udp_send_internal(us, dst, mb, uh->le.prev);
+	return udp_send_internal(us, dst, mb, uh->le.prev, false);
 }
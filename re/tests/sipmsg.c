@@ -0,0 +1,378 @@
+/**
+ * @file tests/sipmsg.c  SIP message decoder benchmark and fuzz driver
+ *
+ * Usage:
+ *
+ *   sipmsg bench [rounds]     Decode time per message, for a few
+ *                             typical requests and responses
+ *   sipmsg fuzz <seed> <n>    Decode n mutated messages and print every
+ *                             decoded field, header and lookup result
+ *
+ * The fuzz output depends only on the seed and the decoder, so two
+ * decoders are compared by building this file against each tree and
+ * diffing the output, e.g. from re/ of this tree:
+ *
+ *   make tests/sipmsg && tests/sipmsg fuzz 1 180000 > new.txt
+ *   git worktree add /tmp/re-old <old-rev>
+ *   make -C /tmp/re-old/re libre.a
+ *   cc $CFLAGS -I/tmp/re-old/re/include tests/sipmsg.c \
+ *      /tmp/re-old/re/libre.a -lpthread -o sipmsg-old
+ *   ./sipmsg-old fuzz 1 180000 > old.txt
+ *   diff old.txt new.txt
+ *
+ * where $CFLAGS holds the defines the library was built with. Add
+ * -fsanitize=address,undefined to the library and program to check for
+ * memory errors.
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+#include <re.h>
+
+
+enum {
+	MSG_MAX = 4096
+};
+
+
+static const char *msgv[] = {
+
+	"INVITE sip:bob@example.com SIP/2.0\r\n"
+	"Via: SIP/2.0/UDP 10.0.0.1:5060;branch=z9hG4bK776asdhds;rport,"
+	" SIP/2.0/TCP 10.0.0.2;branch=z9hG4bKxx\r\n"
+	"v: SIP/2.0/UDP h;branch=z9hG4bKc\r\n"
+	"Max-Forwards: 70\r\n"
+	"To: Bob <sip:bob@example.com>\r\n"
+	"From: \"Alice, A\" <sip:alice@example.com>;tag=1928301774\r\n"
+	"Call-ID: a84b4c76e66710@pc33.example.com\r\n"
+	"CSeq: 314159 INVITE\r\n"
+	"Contact: <sip:alice@pc33.example.com>, \"x,y\" <sip:b@c>\r\n"
+	"Allow: INVITE, ACK, CANCEL, OPTIONS, BYE, REFER, NOTIFY\r\n"
+	"k: replaces, 100rel\r\n"
+	"Call-Info: <http://x>;answer-after=3\r\n"
+	"Alert-Info: <http://y/ring>\r\n"
+	"Route: <sip:p1;lr>,<sip:p2;lr>\r\n"
+	"Route: <sip:p3;lr>\r\n"
+	"X-Custom: hello\r\n"
+	"Subject: folded\r\n"
+	"  line two\r\n"
+	"c: application/sdp\r\n"
+	"l: 4\r\n"
+	"\r\n"
+	"v=0\n",
+
+	"SIP/2.0 200 OK\r\n"
+	"Via: SIP/2.0/UDP server10.biloxi.com;branch=z9hG4bKnashds8"
+	";received=192.0.2.3\r\n"
+	"To: Bob <sip:bob@biloxi.com>;tag=a6c85cf\r\n"
+	"From: Alice <sip:alice@atlanta.com>;tag=1928301774\r\n"
+	"Call-ID: a84b4c76e66710\r\n"
+	"CSeq: 314159 INVITE\r\n"
+	"Contact: <sip:bob@192.0.2.4>\r\n"
+	"Record-Route: <sip:a;lr>, <sip:b;lr>\r\n"
+	"Content-Type: application/sdp\r\n"
+	"Content-Length: 0\r\n"
+	"\r\n",
+
+	"NOTIFY sip:a@b SIP/2.0\r\n"
+	"v: SIP/2.0/TCP x;branch=z9hG4bK1\r\n"
+	"t: <sip:a@b>;tag=1\r\n"
+	"f: <sip:c@d>;tag=2\r\n"
+	"i: abc\r\n"
+	"CSeq: 2 NOTIFY\r\n"
+	"o: dialog\r\n"
+	"Subscription-State: active;expires=3600\r\n"
+	"m: <sip:c@d>\r\n"
+	"l: 0\r\n"
+	"\r\n",
+
+	"REGISTER sip:registrar.biloxi.com SIP/2.0\r\n"
+	"Via: SIP/2.0/UDP bobspc.biloxi.com:5060;branch=z9hG4bKnashds7\r\n"
+	"Max-Forwards: 70\r\n"
+	"To: Bob <sip:bob@biloxi.com>\r\n"
+	"From: Bob <sip:bob@biloxi.com>;tag=456248\r\n"
+	"Call-ID: 843817637684230@998sdasdh09\r\n"
+	"CSeq: 1826 REGISTER\r\n"
+	"Contact: <sip:bob@192.0.2.4>\r\n"
+	"Expires: 7200\r\n"
+	"Authorization: Digest username=\"bob\", realm=\"x\","
+	" nonce=\"a,b\"\r\n"
+	"Content-Length: 0\r\n"
+	"\r\n",
+
+	"SIP/2.0 180 Ringing\n"
+	"Via: SIP/2.0/UDP a;branch=z9hG4bK2\n"
+	"To: <sip:x@y>\n"
+	"From: <sip:x@y>;tag=3\n"
+	"Call-ID: q\n"
+	"CSeq: 1 INVITE\n"
+	"Access-URL: <http://u>;mode=active\n"
+	"\n",
+};
+
+
+static uint32_t rnd_state;
+
+
+/* Portable PRNG, so that every build sees the same messages */
+static uint32_t rnd(uint32_t n)
+{
+	rnd_state ^= rnd_state << 13;
+	rnd_state ^= rnd_state >> 17;
+	rnd_state ^= rnd_state << 5;
+
+	return n ? rnd_state % n : 0;
+}
+
+
+static size_t insert(uint8_t *p, size_t len, size_t pos,
+		     const char *s, size_t n)
+{
+	if (len + n > MSG_MAX)
+		return len;
+
+	memmove(p + pos + n, p + pos, len - pos);
+	memcpy(p + pos, s, n);
+
+	return len + n;
+}
+
+
+/* Truncate the message, or apply 1-6 random edits to it */
+static size_t mutate(uint8_t *p, size_t len)
+{
+	static const char alpha[] = " \t\r\n,:\";<>=aZ0";
+	static const char *tokv[] = {
+		"\r\n", "\r\n ", ",", "\"", "\r\n\r\n", ":", "\n\t"
+	};
+	const uint32_t r = rnd(100);
+	uint32_t i, k;
+
+	if (r < 15)
+		return rnd((uint32_t)len + 1);
+
+	if (r >= 90)
+		return len;
+
+	for (i = 1 + rnd(6); i > 0; i--) {
+
+		const size_t pos = rnd((uint32_t)len + 1);
+
+		switch (rnd(4)) {
+
+		case 0:
+			if (len)
+				p[min(pos, len - 1)] = alpha[rnd(sizeof(alpha)-1)];
+			break;
+
+		case 1:
+			len = insert(p, len, pos, &alpha[rnd(sizeof(alpha)-1)],
+				     1);
+			break;
+
+		case 2:
+			k = 1 + rnd(4);
+			k = min(k, (uint32_t)(len - pos));
+			memmove(p + pos, p + pos + k, len - pos - k);
+			len -= k;
+			break;
+
+		default:
+			k = rnd(ARRAY_SIZE(tokv));
+			len = insert(p, len, pos, tokv[k], strlen(tokv[k]));
+			break;
+		}
+	}
+
+	return len;
+}
+
+
+static bool hdr_print_handler(const struct sip_hdr *hdr,
+			      const struct sip_msg *msg, void *arg)
+{
+	(void)msg;
+	(void)arg;
+
+	(void)re_fprintf(stdout, "  a %u '%r'='%r'\n",
+			 hdr->id, &hdr->name, &hdr->val);
+
+	return false;
+}
+
+
+static void msg_print(const struct sip_msg *msg)
+{
+	struct le *le;
+
+	(void)re_fprintf(stdout, " pos=%u req=%d '%r' '%r' '%r' %u '%r'\n",
+			 (unsigned)msg->mb->pos, msg->req, &msg->met,
+			 &msg->ruri, &msg->ver, msg->scode, &msg->reason);
+	(void)re_fprintf(stdout, " via '%r' '%r' to '%r' '%r'"
+			 " from '%r' '%r' cid '%r' cseq %u '%r'\n",
+			 &msg->via.sentby, &msg->via.branch,
+			 &msg->to.val, &msg->to.tag,
+			 &msg->from.val, &msg->from.tag, &msg->callid,
+			 msg->cseq.num, &msg->cseq.met);
+	(void)re_fprintf(stdout, " mf '%r' ct '%r' cl '%r' ex '%r'"
+			 " aa %d ai '%r' au '%r'\n",
+			 &msg->maxfwd, &msg->ctype, &msg->clen, &msg->expires,
+			 msg->call_info.answer_after,
+			 &msg->alert_info.info, &msg->access_url.url);
+
+	for (le = msg->hdrl.head; le; le = le->next) {
+
+		const struct sip_hdr *hdr = le->data;
+		char name[256];
+
+		(void)re_fprintf(stdout, " l %u '%r'='%r' n=%u\n",
+				 hdr->id, &hdr->name, &hdr->val,
+				 sip_msg_hdr_count(msg, hdr->id));
+
+		(void)sip_msg_hdr_apply(msg, false, hdr->id,
+					hdr_print_handler, NULL);
+
+		if (hdr->name.l < sizeof(name)) {
+			(void)pl_strcpy(&hdr->name, name, sizeof(name));
+			(void)re_fprintf(stdout, "  x %u\n",
+					 sip_msg_xhdr_count(msg, name));
+		}
+	}
+}
+
+
+static int fuzz(uint32_t seed, uint32_t n)
+{
+	static uint8_t buf[MSG_MAX];
+	struct mbuf *mb;
+	uint32_t i;
+
+	mb = mbuf_alloc(MSG_MAX);
+	if (!mb)
+		return ENOMEM;
+
+	rnd_state = seed ? seed : 1;
+
+	for (i=0; i<n; i++) {
+
+		const char *s = msgv[rnd(ARRAY_SIZE(msgv))];
+		struct sip_msg *msg = NULL;
+		size_t len = strlen(s);
+		int err;
+
+		memcpy(buf, s, len);
+		len = mutate(buf, len);
+
+		/* a fresh buffer of the exact size catches overreads */
+		mb = mem_deref(mb);
+		mb = mbuf_alloc(len ? len : 1);
+		if (!mb)
+			return ENOMEM;
+
+		(void)mbuf_write_mem(mb, buf, len);
+		mb->pos = 0;
+
+		err = sip_msg_decode(&msg, mb);
+
+		(void)re_fprintf(stdout, "#%u err=%d\n", i, err);
+
+		if (!err)
+			msg_print(msg);
+
+		mem_deref(msg);
+	}
+
+	mem_deref(mb);
+
+	return 0;
+}
+
+
+static int bench(uint32_t rounds)
+{
+	size_t i;
+
+	for (i=0; i<ARRAY_SIZE(msgv); i++) {
+
+		struct mbuf *mb;
+		struct pl name;
+		clock_t t;
+		uint32_t k;
+
+		mb = mbuf_alloc(strlen(msgv[i]));
+		if (!mb)
+			return ENOMEM;
+
+		(void)mbuf_write_str(mb, msgv[i]);
+
+		t = clock();
+
+		for (k=0; k<rounds; k++) {
+
+			struct sip_msg *msg;
+			int err;
+
+			mb->pos = 0;
+
+			err = sip_msg_decode(&msg, mb);
+			if (err) {
+				mem_deref(mb);
+				return err;
+			}
+
+			mem_deref(msg);
+		}
+
+		t = clock() - t;
+
+		name.p = msgv[i];
+		name.l = strcspn(msgv[i], " ");
+
+		(void)re_fprintf(stdout, "%-10r %6u ns/msg\n", &name,
+				 (unsigned)((double)t * 1e9 / CLOCKS_PER_SEC
+					    / rounds));
+
+		mem_deref(mb);
+	}
+
+	return 0;
+}
+
+
+int main(int argc, char *argv[])
+{
+	int err;
+
+	if (argc < 2) {
+		(void)re_fprintf(stderr, "usage: sipmsg bench [rounds]\n"
+				 "       sipmsg fuzz <seed> <count>\n");
+		return 2;
+	}
+
+	err = libre_init();
+	if (err)
+		return 1;
+
+	if (!strcmp(argv[1], "bench")) {
+		err = bench(argc > 2 ? atoi(argv[2]) : 200000);
+	}
+	else if (!strcmp(argv[1], "fuzz") && argc > 3) {
+		err = fuzz(atoi(argv[2]), atoi(argv[3]));
+	}
+	else {
+		err = EINVAL;
+	}
+
+	if (err)
+		(void)re_fprintf(stderr, "sipmsg: %m\n", err);
+
+	libre_close();
+
+	tmr_debug();
+	mem_debug();
+
+	return err ? 1 : 0;
+}
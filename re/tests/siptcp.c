@@ -0,0 +1,197 @@
+/**
+ * @file tests/siptcp.c  SIP over TCP receive framing test
+ *
+ * Usage:
+ *
+ *   siptcp [count] [maxseg]
+ *
+ * Feeds count pipelined NOTIFY requests (default 10000), with bodies of
+ * varying length and a CRLF keep-alive before every 11th, to the SIP
+ * TCP receive handler in random segments of 1..maxseg bytes (default 1).
+ * Every request must arrive once, in order and with its body intact.
+ * Some requests are kept referenced for a while, as transactions do,
+ * so that the connection buffer is shared. Prints the time spent.
+ *
+ * The receive handler is static, so sip_transp.c is compiled into this
+ * program and replaces the one in libre.a. To time another tree, copy
+ * this file to re/tests/ there and link it with that tree's libre.a.
+ * Add -fsanitize=address to the library and program to check for
+ * memory errors.
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+#include "../src/sip/sip_transp.c"
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+#include <re_main.h>
+
+
+enum {
+	KEEP_SIZE = 64
+};
+
+static const char body[] = "abcabcabcabcabcabcabc";
+
+static struct sip_msg *keepv[KEEP_SIZE];
+static int count;
+static int bad;
+
+
+static size_t body_len(int i)
+{
+	return (size_t)(i % 7) * 3;
+}
+
+
+static bool recv_handler(const struct sip_msg *msg, void *arg)
+{
+	const size_t len = body_len(count);
+	char callid[32];
+	(void)arg;
+
+	(void)re_snprintf(callid, sizeof(callid), "n%d", count);
+
+	if (pl_strcmp(&msg->callid, callid)) {
+		(void)re_fprintf(stderr, "#%d: unexpected Call-ID '%r'\n",
+				 count, &msg->callid);
+		++bad;
+	}
+	else if (mbuf_get_left(msg->mb) != len ||
+		 memcmp(mbuf_buf(msg->mb), body, len)) {
+		(void)re_fprintf(stderr, "#%d: bad body\n", count);
+		++bad;
+	}
+
+	if (rand() % 5 == 0) {
+		const int k = rand() % KEEP_SIZE;
+
+		mem_deref(keepv[k]);
+		keepv[k] = mem_ref((void *)msg);
+	}
+
+	++count;
+
+	return true;
+}
+
+
+int main(int argc, char *argv[])
+{
+	const int n      = argc > 1 ? atoi(argv[1]) : 10000;
+	const int maxseg = argc > 2 ? atoi(argv[2]) : 1;
+	struct sip_lsnr *lsnr = NULL;
+	struct sip_conn *conn = NULL;
+	struct sip *sip = NULL;
+	struct mbuf *all;
+	size_t off = 0;
+	clock_t t;
+	int i, err;
+
+	if (n < 1 || maxseg < 1)
+		return 2;
+
+	err = libre_init();
+	if (err)
+		return 1;
+
+	srand(3);
+
+	all = mbuf_alloc(1 << 20);
+	if (!all) {
+		err = ENOMEM;
+		goto out;
+	}
+
+	for (i=0; i<n; i++) {
+
+		if (i % 11 == 0)
+			err |= mbuf_write_str(all, "\r\n");
+
+		err |= mbuf_printf(all,
+				   "NOTIFY sip:a@b SIP/2.0\r\n"
+				   "Via: SIP/2.0/TCP x;branch=z9hG4bK%d\r\n"
+				   "To: <sip:a@b>;tag=1\r\n"
+				   "From: <sip:c@d>;tag=2\r\n"
+				   "Call-ID: n%d\r\n"
+				   "CSeq: %d NOTIFY\r\n"
+				   "Event: dialog\r\n"
+				   "Subscription-State: active\r\n"
+				   "Content-Length: %u\r\n"
+				   "\r\n"
+				   "%b",
+				   i, i, i + 1, (unsigned)body_len(i),
+				   body, body_len(i));
+	}
+	if (err)
+		goto out;
+
+	err = sip_alloc(&sip, NULL, 16, 16, 16, "siptcp", false,
+			NULL, NULL);
+	if (err)
+		goto out;
+
+	err = sip_listen(&lsnr, sip, true, recv_handler, NULL);
+	if (err)
+		goto out;
+
+	conn = mem_zalloc(sizeof(*conn), conn_destructor);
+	if (!conn) {
+		err = ENOMEM;
+		goto out;
+	}
+
+	conn->sip = sip;
+
+	t = clock();
+
+	while (off < all->end) {
+
+		size_t seg = 1 + rand() % maxseg;
+		struct mbuf *mb;
+
+		seg = min(seg, all->end - off);
+
+		mb = mbuf_alloc(seg);
+		if (!mb) {
+			err = ENOMEM;
+			goto out;
+		}
+
+		(void)mbuf_write_mem(mb, all->buf + off, seg);
+		mb->pos = 0;
+
+		tcp_recv_handler(mb, conn);
+
+		mem_deref(mb);
+		off += seg;
+	}
+
+	t = clock() - t;
+
+	if (count != n)
+		++bad;
+
+	(void)re_fprintf(stderr, "siptcp: %d of %d requests, %d bad,"
+			 " %u ms\n", count, n, bad,
+			 (unsigned)((double)t * 1000 / CLOCKS_PER_SEC));
+
+ out:
+	for (i=0; i<KEEP_SIZE; i++)
+		mem_deref(keepv[i]);
+
+	mem_deref(conn);
+	mem_deref(lsnr);
+	mem_deref(sip);
+	mem_deref(all);
+
+	if (err)
+		(void)re_fprintf(stderr, "siptcp: %m\n", err);
+
+	libre_close();
+
+	tmr_debug();
+	mem_debug();
+
+	return (err || bad) ? 1 : 0;
+}
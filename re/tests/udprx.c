@@ -0,0 +1,185 @@
+/**
+ * @file tests/udprx.c  Pooled UDP receive test
+ *
+ * Usage:
+ *
+ *   udprx [count] [delay]
+ *
+ * Sends count RTP packets (default 2000) over loopback to a socket with
+ * pooled receive, one every millisecond. As in a call, the receiver puts
+ * each packet into a jitter buffer of delay..2*delay frames (default 5)
+ * and a playout timer takes one frame every millisecond, so that the
+ * mbufs stay referenced for a while after the receive handler returns.
+ * Prints how many receive buffers came from the pool and fails if none
+ * did. The frames left in the jitter buffer are released after the
+ * socket is destroyed.
+ *
+ * The buffer allocations are counted by compiling udp.c into this
+ * program, which replaces the one in libre.a.
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+#define mem_alloc counted_mem_alloc
+#include "../src/udp/udp.c"
+#undef mem_alloc
+#include <re_tmr.h>
+#include <re_rtp.h>
+#include <re_jbuf.h>
+
+
+void *mem_alloc(size_t size, mem_destroy_h *dh);
+
+
+enum {
+	RXSZ     = 2048,
+	POOLSZ   = 8,
+	PAYLOAD  = 160
+};
+
+static struct udp_sock *us_tx;
+static struct jbuf *jb;
+static struct tmr tmr_tx, tmr_play;
+static struct sa dst;
+static int count, sent, recvd;
+static uint32_t nalloc;
+
+
+void *counted_mem_alloc(size_t size, mem_destroy_h *dh)
+{
+	if (size == RXSZ)
+		++nalloc;
+
+	return mem_alloc(size, dh);
+}
+
+
+static void recv_handler(const struct sa *src, struct mbuf *mb, void *arg)
+{
+	struct rtp_header hdr;
+	(void)src;
+	(void)arg;
+
+	if (!rtp_hdr_decode(&hdr, mb))
+		(void)jbuf_put(jb, &hdr, mb);
+
+	if (++recvd >= count)
+		re_cancel();
+}
+
+
+static void play_handler(void *arg)
+{
+	struct rtp_header hdr;
+	void *mem = NULL;
+	(void)arg;
+
+	(void)jbuf_get(jb, &hdr, &mem);
+	mem_deref(mem);
+
+	tmr_start(&tmr_play, 1, play_handler, NULL);
+}
+
+
+static void timeout_handler(void *arg)
+{
+	(void)arg;
+
+	re_cancel();
+}
+
+
+static void send_handler(void *arg)
+{
+	struct rtp_header hdr;
+	struct mbuf *mb = mbuf_alloc(RTP_HEADER_SIZE + PAYLOAD);
+	(void)arg;
+
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.ver  = RTP_VERSION;
+	hdr.seq  = (uint16_t)sent;
+	hdr.ts   = (uint32_t)sent * PAYLOAD;
+	hdr.ssrc = 1;
+
+	if (mb && !rtp_hdr_encode(mb, &hdr) &&
+	    !mbuf_fill(mb, (uint8_t)sent, PAYLOAD)) {
+		mb->pos = 0;
+		(void)udp_send(us_tx, &dst, mb);
+	}
+	mem_deref(mb);
+
+	/* stop also if some packets were lost */
+	if (++sent < count)
+		tmr_start(&tmr_tx, 1, send_handler, NULL);
+	else
+		tmr_start(&tmr_tx, 500, timeout_handler, NULL);
+}
+
+
+int main(int argc, char *argv[])
+{
+	struct udp_sock *us = NULL;
+	struct sa laddr;
+	int delay, err;
+
+	count = argc > 1 ? atoi(argv[1]) : 2000;
+	delay = argc > 2 ? atoi(argv[2]) : 5;
+
+	if (count < 1 || delay < 1)
+		return 2;
+
+	err = libre_init();
+	if (err)
+		return 1;
+
+	err = re_thread_init();
+	if (err)
+		goto out;
+
+	err = jbuf_alloc(&jb, delay, 2 * delay);
+	if (err)
+		goto out;
+
+	(void)sa_set_str(&laddr, "127.0.0.1", 0);
+
+	err  = udp_listen(&us, &laddr, recv_handler, NULL);
+	err |= udp_listen(&us_tx, &laddr, NULL, NULL);
+	if (err)
+		goto out;
+
+	udp_rxsz_set(us, RXSZ);
+	udp_rxpool_set(us, POOLSZ);
+
+	err = udp_local_get(us, &dst);
+	if (err)
+		goto out;
+
+	tmr_init(&tmr_tx);
+	tmr_init(&tmr_play);
+	tmr_start(&tmr_tx, 1, send_handler, NULL);
+	tmr_start(&tmr_play, 1, play_handler, NULL);
+
+	err = re_main(NULL, NULL);
+
+	(void)re_fprintf(stderr, "udprx: %d received, %u allocated,"
+			 " %u%% from pool\n", recvd, nalloc,
+			 recvd > (int)nalloc ?
+			 (recvd - nalloc) * 100 / recvd : 0);
+
+	if (recvd && nalloc >= (uint32_t)recvd)
+		err = EINVAL;
+
+ out:
+	tmr_cancel(&tmr_tx);
+	tmr_cancel(&tmr_play);
+
+	/* the frames in the jitter buffer outlive the socket */
+	mem_deref(us);
+	mem_deref(us_tx);
+	mem_deref(jb);
+
+	(void)fd_setsize(0);
+	re_thread_close();
+	libre_close();
+
+	return err ? 1 : 0;
+}
@@ -7,6 +7,7 @@
 struct aubuf;
 
 int  aubuf_alloc(struct aubuf **abp, size_t min_sz, size_t max_sz);
+int  aubuf_alloc_ring(struct aubuf **abp, size_t min_sz, size_t max_sz);
 int  aubuf_append(struct aubuf *ab, struct mbuf *mb);
 int  aubuf_write(struct aubuf *ab, const uint8_t *p, size_t sz);
 void aubuf_read(struct aubuf *ab, uint8_t *p, size_t sz);
@@ -0,0 +1,14 @@
+/**
+ * @file rem_aucng.h Comfort Noise (RFC 3389)
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+
+struct aucng;
+
+int  aucng_alloc(struct aucng **cngp, uint32_t srate, uint8_t ch);
+void aucng_analyse(struct aucng *cng, const int16_t *sampv, size_t sampc);
+uint8_t aucng_level(const struct aucng *cng);
+int  aucng_sid_encode(struct aucng *cng, uint8_t *buf, size_t *len);
+int  aucng_sid_decode(struct aucng *cng, const uint8_t *buf, size_t len);
+void aucng_generate(struct aucng *cng, int16_t *sampv, size_t sampc);
@@ -11,4 +11,6 @@
 #include <rem_autone.h>
 #include <rem_aumix.h>
 #include <rem_auresamp.h>
+#include <rem_auplc.h>
+#include <rem_aucng.h>
 #include <rem_g711.h>
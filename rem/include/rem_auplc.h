@@ -0,0 +1,11 @@
+/**
+ * @file rem_auplc.h Audio Packet Loss Concealment
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+
+struct auplc;
+
+int auplc_alloc(struct auplc **plcp, uint32_t srate, uint8_t ch);
+void auplc_update(struct auplc *plc, int16_t *sampv, size_t sampc);
+int auplc_conceal(struct auplc *plc, int16_t *sampv, size_t *sampc);
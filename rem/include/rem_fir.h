@@ -5,14 +5,17 @@
  */
 
 
-/** Maximum number of inputs that can be handled in one function call */
+/** Number of inputs per call used by callers that process in chunks */
 #define FIR_MAX_INPUT_LEN   160
 
 /** Maximum length of filter than can be handled */
 #define FIR_MAX_FLT_LEN     63
 
-/** Buffer to hold all of the input samples */
-#define FIR_BUFFER_LEN      (FIR_MAX_FLT_LEN - 1 + FIR_MAX_INPUT_LEN)
+/** Size of the circular history, power of two >= FIR_MAX_FLT_LEN */
+#define FIR_RING_LEN        64
+
+/** Buffer to hold the history, mirrored so that it is always contiguous */
+#define FIR_BUFFER_LEN      (2 * FIR_RING_LEN)
 
 /** Maximum number of audio channels */
 #define FIR_MAX_CHANNELS    2
@@ -21,6 +24,7 @@
 /** FIR filter state */
 struct fir {
 	int16_t insamp[FIR_MAX_CHANNELS][FIR_BUFFER_LEN];  /**< Samples */
+	unsigned pos;                      /**< Position of newest sample */
 };
 
 
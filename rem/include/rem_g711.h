@@ -11,6 +11,12 @@ extern const int16_t g711_u2l[256];
 extern const int16_t g711_A2l[256];
 
 
+void g711_pcm2ulaw_v(uint8_t *dst, const int16_t *src, size_t n);
+void g711_pcm2alaw_v(uint8_t *dst, const int16_t *src, size_t n);
+void g711_ulaw2pcm_v(int16_t *dst, const uint8_t *src, size_t n);
+void g711_alaw2pcm_v(int16_t *dst, const uint8_t *src, size_t n);
+
+
 /**
  * Encode one 16-bit PCM sample to U-law format
  *
@@ -5,13 +5,33 @@
  */
 #include <re.h> 
 #include <string.h>
+#ifdef WIN32
+#include <windows.h>
+#endif
 #include <rem_aubuf.h>
 
 
 #define AUBUF_DEBUG 0
 
 
-/** Locked audio-buffer with almost zero-copy */
+/*
+ * Two backends are available per instance:
+ *
+ * - List (aubuf_alloc): a locked list of frames with almost zero-copy.
+ *   Any number of threads may read and write.
+ *
+ * - Ring (aubuf_alloc_ring): one preallocated contiguous buffer with
+ *   lock-free single-producer/single-consumer indices. Nothing is
+ *   allocated and no lock is taken after allocation. Exactly one thread
+ *   may write and one thread may read at a time.
+ *
+ * The ring keeps the overrun semantics of the list: when more than
+ * max_sz bytes are buffered, the reader drops the oldest data. The ring
+ * is twice max_sz, so the writer normally never has to drop.
+ */
+
+
+/** Audio buffer, locked list or lock-free ring */
 struct aubuf {
 	struct list afl;
 	struct lock *lock;
@@ -21,15 +41,34 @@ struct aubuf {
 	bool filling;
 	uint64_t ts;
 
-#if AUBUF_DEBUG
+	/* ring backend */
+	uint8_t *ring;              /**< Ring storage, power of two size  */
+	uint32_t ring_sz;           /**< Size of the ring in bytes        */
+	volatile uint32_t wr;       /**< Bytes written, owned by writer   */
+	volatile uint32_t rd;       /**< Bytes read, owned by reader      */
+	volatile bool flush;        /**< Flush requested, done by reader  */
+	volatile uint32_t flush_wr; /**< Write index at flush request     */
+
 	struct {
-		size_t or;
-		size_t ur;
+		size_t or;          /**< Overruns, oldest data dropped    */
+		size_t ur;          /**< Underruns                        */
+		size_t drop;        /**< Writes dropped on a full ring    */
 	} stats;
-#endif
 };
 
 
+/* Full memory barrier ordering ring data against the ring indices */
+static inline void ring_barrier(void)
+{
+#if defined(WIN32)
+	LONG b = 0;
+	(void)InterlockedExchange(&b, 1);
+#elif defined(__GNUC__)
+	__sync_synchronize();
+#endif
+}
+
+
 struct auframe {
 	struct le le;
 	struct mbuf *mb;
@@ -51,6 +90,93 @@ static void aubuf_destructor(void *arg)
 
 	list_flush(&ab->afl);
 	mem_deref(ab->lock);
+	mem_deref(ab->ring);
+}
+
+
+static void ring_write(struct aubuf *ab, const uint8_t *p, size_t sz)
+{
+	const uint32_t wr = ab->wr;
+	uint32_t rd, pos, space, n;
+
+	rd = ab->rd;
+	ring_barrier();
+
+	space = ab->ring_sz - (wr - rd);
+	if (sz > space) {
+		++ab->stats.drop;
+		sz = space;
+	}
+
+	pos = wr & (ab->ring_sz - 1);
+	n   = min((uint32_t)sz, ab->ring_sz - pos);
+
+	memcpy(&ab->ring[pos], p, n);
+	memcpy(ab->ring, p + n, sz - n);
+
+	/* publish the data before the index */
+	ring_barrier();
+	ab->wr = wr + (uint32_t)sz;
+}
+
+
+static void ring_read(struct aubuf *ab, uint8_t *p, size_t sz)
+{
+	uint32_t rd = ab->rd;
+	uint32_t wr, cur, pos, n;
+
+	wr = ab->wr;
+	ring_barrier();
+
+	if (ab->flush) {
+		const uint32_t base = ab->flush_wr;
+
+		ab->flush   = false;
+		ab->filling = true;
+
+		/* keep data written after the flush request */
+		if ((int32_t)(base - rd) > 0)
+			rd = base;
+	}
+
+	cur = wr - rd;
+
+	if (ab->max_sz && cur > ab->max_sz) {
+#if AUBUF_DEBUG
+		(void)re_printf("aubuf: %p overrun (cur=%u)\n", ab, cur);
+#endif
+		++ab->stats.or;
+		rd += cur - (uint32_t)ab->max_sz;
+		cur = (uint32_t)ab->max_sz;
+	}
+
+	if (cur < (ab->filling ? ab->wish_sz : sz)) {
+		if (!ab->filling) {
+			++ab->stats.ur;
+#if AUBUF_DEBUG
+			(void)re_printf("aubuf: %p underrun (cur=%u)\n",
+					ab, cur);
+#endif
+		}
+		ab->filling = true;
+		memset(p, 0, sz);
+		goto out;
+	}
+
+	ab->filling = false;
+
+	pos = rd & (ab->ring_sz - 1);
+	n   = min((uint32_t)sz, ab->ring_sz - pos);
+
+	memcpy(p, &ab->ring[pos], n);
+	memcpy(p + n, ab->ring, sz - n);
+
+	rd += (uint32_t)sz;
+
+ out:
+	/* done with the data before handing the space back */
+	ring_barrier();
+	ab->rd = rd;
 }
 
 
@@ -93,6 +219,49 @@ int aubuf_alloc(struct aubuf **abp, size_t min_sz, size_t max_sz)
 }
 
 
+/**
+ * Allocate a new lock-free ring audio buffer
+ *
+ * @param abp    Pointer to allocated audio buffer
+ * @param min_sz Minimum buffer size
+ * @param max_sz Maximum buffer size
+ *
+ * @return 0 for success, otherwise error code
+ *
+ * @note Only one writer thread and one reader thread may use the buffer
+ *       at a time. aubuf_flush() drops the data written so far; the
+ *       next read carries it out.
+ */
+int aubuf_alloc_ring(struct aubuf **abp, size_t min_sz, size_t max_sz)
+{
+	struct aubuf *ab;
+	uint32_t sz = 256;
+	int err;
+
+	if (!max_sz || max_sz < min_sz || max_sz > 0x10000000)
+		return EINVAL;
+
+	err = aubuf_alloc(&ab, min_sz, max_sz);
+	if (err)
+		return err;
+
+	while (sz < 2 * max_sz)
+		sz <<= 1;
+
+	ab->ring = mem_alloc(sz, NULL);
+	if (!ab->ring) {
+		mem_deref(ab);
+		return ENOMEM;
+	}
+
+	ab->ring_sz = sz;
+
+	*abp = ab;
+
+	return 0;
+}
+
+
 /**
  * Append a PCM-buffer to the end of the audio buffer
  *
@@ -108,6 +277,11 @@ int aubuf_append(struct aubuf *ab, struct mbuf *mb)
 	if (!ab || !mb)
 		return EINVAL;
 
+	if (ab->ring) {
+		ring_write(ab, mbuf_buf(mb), mbuf_get_left(mb));
+		return 0;
+	}
+
 	af = mem_zalloc(sizeof(*af), auframe_destructor);
 	if (!af)
 		return ENOMEM;
@@ -120,8 +294,8 @@ int aubuf_append(struct aubuf *ab, struct mbuf *mb)
 	ab->cur_sz += mbuf_get_left(mb);
 
 	if (ab->max_sz && ab->cur_sz > ab->max_sz) {
-#if AUBUF_DEBUG
 		++ab->stats.or;
+#if AUBUF_DEBUG
 		(void)re_printf("aubuf: %p overrun (cur=%zu)\n",
 				ab, ab->cur_sz);
 #endif
@@ -149,9 +323,18 @@ int aubuf_append(struct aubuf *ab, struct mbuf *mb)
  */
 int aubuf_write(struct aubuf *ab, const uint8_t *p, size_t sz)
 {
-	struct mbuf *mb = mbuf_alloc(sz);
+	struct mbuf *mb;
 	int err;
 
+	if (ab && ab->ring) {
+		if (!p)
+			return EINVAL;
+
+		ring_write(ab, p, sz);
+		return 0;
+	}
+
+	mb = mbuf_alloc(sz);
 	if (!mb)
 		return ENOMEM;
 
@@ -181,16 +364,21 @@ void aubuf_read(struct aubuf *ab, uint8_t *p, size_t sz)
 	if (!ab || !p || !sz)
 		return;
 
+	if (ab->ring) {
+		ring_read(ab, p, sz);
+		return;
+	}
+
 	lock_write_get(ab->lock);
 
 	if (ab->cur_sz < (ab->filling ? ab->wish_sz : sz)) {
-#if AUBUF_DEBUG
 		if (!ab->filling) {
 			++ab->stats.ur;
+#if AUBUF_DEBUG
 			(void)re_printf("aubuf: %p underrun (cur=%zu)\n",
 					ab, ab->cur_sz);
-		}
 #endif
+		}
 		ab->filling = true;
 		memset(p, 0, sz);
 		goto out;
@@ -248,6 +436,22 @@ int aubuf_get(struct aubuf *ab, uint32_t ptime, uint8_t *p, size_t sz)
 	if (!ab || !ptime)
 		return EINVAL;
 
+	if (ab->ring) {
+
+		/* the timestamp is owned by the reader thread */
+		now = tmr_jiffies();
+		if (!ab->ts || ab->flush)
+			ab->ts = now;
+
+		if (now < ab->ts)
+			return ETIMEDOUT;
+
+		ab->ts += ptime;
+		ring_read(ab, p, sz);
+
+		return 0;
+	}
+
 	lock_write_get(ab->lock);
 
 	now = tmr_jiffies();
@@ -281,6 +485,15 @@ void aubuf_flush(struct aubuf *ab)
 	if (!ab)
 		return;
 
+	if (ab->ring) {
+		/* data up to the current write index is discarded on the
+		   next read; publish the index before the request */
+		ab->flush_wr = ab->wr;
+		ring_barrier();
+		ab->flush = true;
+		return;
+	}
+
 	lock_write_get(ab->lock);
 
 	list_flush(&ab->afl);
@@ -307,14 +520,21 @@ int aubuf_debug(struct re_printf *pf, const struct aubuf *ab)
 	if (!ab)
 		return 0;
 
+	if (ab->ring) {
+		return re_hprintf(pf, "ring=%u wish_sz=%zu cur_sz=%zu"
+				  " filling=%d [overrun=%zu underrun=%zu]",
+				  ab->ring_sz, ab->wish_sz,
+				  aubuf_cur_size(ab), ab->filling,
+				  ab->stats.or + ab->stats.drop,
+				  ab->stats.ur);
+	}
+
 	lock_read_get(ab->lock);
 	err = re_hprintf(pf, "wish_sz=%zu cur_sz=%zu filling=%d",
 			 ab->wish_sz, ab->cur_sz, ab->filling);
 
-#if AUBUF_DEBUG
 	err |= re_hprintf(pf, " [overrun=%zu underrun=%zu]",
 			  ab->stats.or, ab->stats.ur);
-#endif
 
 	lock_rel(ab->lock);
 
@@ -336,6 +556,17 @@ size_t aubuf_cur_size(const struct aubuf *ab)
 	if (!ab)
 		return 0;
 
+	if (ab->ring) {
+		uint32_t rd = ab->rd;
+
+		/* count only what the pending flush will keep */
+		if (ab->flush && (int32_t)(ab->flush_wr - rd) > 0)
+			rd = ab->flush_wr;
+
+		sz = min((uint32_t)(ab->wr - rd), ab->max_sz);
+		return sz;
+	}
+
 	lock_read_get(ab->lock);
 	sz = ab->cur_sz;
 	lock_rel(ab->lock);
@@ -0,0 +1,337 @@
+/**
+ * @file cng.c Comfort Noise (RFC 3389)
+ *
+ * The sender averages the autocorrelation of silent frames and sends it
+ * as a noise level and reflection coefficients in a SID frame. The
+ * receiver drives an all-pole filter built from those coefficients with
+ * white noise. Both sides model the signal at 8000 Hz, the clock rate of
+ * the static CN payload type; other rates that are a multiple of 8000 Hz
+ * are decimated for analysis and interpolated after synthesis.
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+#include <re.h>
+#include <string.h>
+#include <math.h>
+#include <rem_aucng.h>
+
+
+enum {
+	CNG_ORDER     = 10,   /**< Number of reflection coefficients   */
+	CNG_LEVEL_MAX = 127,  /**< Lowest noise level in [-dBov]       */
+	CNG_AVG_SHIFT = 2     /**< Analysis averaging, 1/4 per frame   */
+};
+
+
+/** Defines a Comfort noise analyser and generator */
+struct aucng {
+	/* analysis */
+	double r[CNG_ORDER + 1];  /**< Averaged autocorrelation         */
+	bool r_valid;             /**< At least one frame analysed      */
+
+	/* synthesis */
+	float k_tgt[CNG_ORDER];   /**< Reflection coeff. from last SID  */
+	float k[CNG_ORDER];       /**< Reflection coeff. in use         */
+	float a[CNG_ORDER];       /**< Direct form filter from k        */
+	float y[CNG_ORDER];       /**< Filter memory, newest first      */
+	float gain_tgt;           /**< Excitation gain from last SID    */
+	float gain;               /**< Excitation gain in use           */
+	float last;               /**< Last output, for interpolation   */
+	uint32_t order;           /**< Coefficients in last SID         */
+	uint32_t seed;            /**< Noise generator state            */
+	bool running;             /**< Synthesis has started            */
+
+	uint32_t m;               /**< Ratio to 8000 Hz, 1 if no multiple */
+	uint8_t ch;
+};
+
+
+/* Uniform noise with unit variance */
+static inline float noise(struct aucng *cng)
+{
+	cng->seed = cng->seed * 1664525 + 1013904223;
+
+	return ((int32_t)cng->seed / 2147483648.0f) * 1.7320508f;
+}
+
+
+/* Step-up recursion, reflection to direct form coefficients */
+static void k2a(struct aucng *cng)
+{
+	float tmp[CNG_ORDER];
+	uint32_t i, j;
+
+	for (i=0; i<cng->order; i++) {
+
+		for (j=0; j<i; j++)
+			tmp[j] = cng->a[j] + cng->k[i] * cng->a[i - 1 - j];
+
+		memcpy(cng->a, tmp, i * sizeof(float));
+		cng->a[i] = cng->k[i];
+	}
+}
+
+
+/**
+ * Allocate a new Comfort noise state
+ *
+ * @param cngp  Pointer to allocated comfort noise state
+ * @param srate Sample rate in [Hz]
+ * @param ch    Number of channels
+ *
+ * @return 0 for success, otherwise error code
+ */
+int aucng_alloc(struct aucng **cngp, uint32_t srate, uint8_t ch)
+{
+	struct aucng *cng;
+
+	if (!cngp || !srate || ch < 1 || ch > 2)
+		return EINVAL;
+
+	cng = mem_zalloc(sizeof(*cng), NULL);
+	if (!cng)
+		return ENOMEM;
+
+	cng->m    = (srate % 8000) ? 1 : srate / 8000;
+	cng->ch   = ch;
+	cng->seed = rand_u32();
+
+	*cngp = cng;
+
+	return 0;
+}
+
+
+/**
+ * Add one frame of background noise to the analysis
+ *
+ * @param cng   Comfort noise state
+ * @param sampv PCM data
+ * @param sampc Number of samples
+ */
+void aucng_analyse(struct aucng *cng, const int16_t *sampv, size_t sampc)
+{
+	double x[1920 / 4], r;
+	const size_t step = cng ? cng->m * cng->ch : 1;
+	size_t n, i, j;
+	uint32_t lag;
+
+	if (!cng || !sampv)
+		return;
+
+	/* average down to 8000 Hz mono */
+	n = min(sampc / step, sizeof(x) / sizeof(x[0]));
+	for (i=0; i<n; i++) {
+		int32_t acc = 0;
+
+		for (j=0; j<step; j++)
+			acc += sampv[i * step + j];
+
+		x[i] = (double)acc / step;
+	}
+
+	if (n <= CNG_ORDER)
+		return;
+
+	for (lag=0; lag<=CNG_ORDER; lag++) {
+
+		r = 0;
+		for (i=lag; i<n; i++)
+			r += x[i] * x[i - lag];
+
+		r /= n;
+
+		if (cng->r_valid)
+			cng->r[lag] += (r - cng->r[lag]) / (1 << CNG_AVG_SHIFT);
+		else
+			cng->r[lag] = r;
+	}
+
+	cng->r_valid = true;
+}
+
+
+/**
+ * Get the level of the analysed background noise
+ *
+ * @param cng Comfort noise state
+ *
+ * @return Noise level in [-dBov], 0 to 127
+ */
+uint8_t aucng_level(const struct aucng *cng)
+{
+	double db;
+
+	if (!cng || !cng->r_valid || cng->r[0] < 1.0)
+		return CNG_LEVEL_MAX;
+
+	db = -10.0 * log10(cng->r[0] / (32768.0 * 32768.0));
+
+	return (uint8_t)min(max(db + 0.5, 0.0), (double)CNG_LEVEL_MAX);
+}
+
+
+/**
+ * Encode a SID frame from the analysed background noise
+ *
+ * @param cng Comfort noise state
+ * @param buf Buffer for SID payload
+ * @param len Size of buffer, returned payload length
+ *
+ * @return 0 for success, otherwise error code
+ */
+int aucng_sid_encode(struct aucng *cng, uint8_t *buf, size_t *len)
+{
+	double a[CNG_ORDER + 1], tmp[CNG_ORDER + 1], err, k;
+	uint32_t i, j, order = CNG_ORDER;
+
+	if (!cng || !buf || !len)
+		return EINVAL;
+
+	if (*len < 1 + CNG_ORDER)
+		return ENOMEM;
+
+	buf[0] = aucng_level(cng);
+
+	/* Levinson-Durbin, with a slight white noise floor */
+	err = cng->r[0] * 1.0001;
+	a[0] = 1.0;
+
+	for (i=1; i<=CNG_ORDER; i++) {
+
+		double acc = cng->r[i];
+
+		if (err <= 0.0) {
+			order = i - 1;
+			break;
+		}
+
+		for (j=1; j<i; j++)
+			acc += a[j] * cng->r[i - j];
+
+		k = -acc / err;
+
+		for (j=1; j<i; j++)
+			tmp[j] = a[j] + k * a[i - j];
+		for (j=1; j<i; j++)
+			a[j] = tmp[j];
+		a[i] = k;
+
+		err *= 1.0 - k * k;
+
+		/* RFC 3389: k is quantized to 8 bits, 127 is zero */
+		buf[i] = (uint8_t)min(max(127.0 + floor(k * 128.0 + 0.5),
+					   0.0), 254.0);
+	}
+
+	*len = 1 + order;
+
+	return 0;
+}
+
+
+/**
+ * Decode a SID frame, the generated noise follows it smoothly
+ *
+ * @param cng Comfort noise state
+ * @param buf SID payload
+ * @param len Payload length
+ *
+ * @return 0 for success, otherwise error code
+ */
+int aucng_sid_decode(struct aucng *cng, const uint8_t *buf, size_t len)
+{
+	double rms, g = 1.0;
+	uint32_t i;
+
+	if (!cng || !buf || !len)
+		return EINVAL;
+
+	cng->order = (uint32_t)min(len - 1, (size_t)CNG_ORDER);
+
+	for (i=0; i<CNG_ORDER; i++) {
+		const float k = i < cng->order ?
+			(buf[1 + i] - 127) / 128.0f : 0.0f;
+
+		cng->k_tgt[i] = k;
+		g *= 1.0 - k * k;
+	}
+
+	/* excitation for the given output level through 1/A(z) */
+	rms = 32768.0 * pow(10.0, -(buf[0] & 0x7f) / 20.0);
+	cng->gain_tgt = (float)(rms * sqrt(g));
+
+	if (!cng->running) {
+		memcpy(cng->k, cng->k_tgt, sizeof(cng->k));
+		cng->gain = cng->gain_tgt;
+		k2a(cng);
+		cng->running = true;
+	}
+
+	return 0;
+}
+
+
+/**
+ * Generate comfort noise
+ *
+ * @param cng   Comfort noise state
+ * @param sampv Buffer for PCM data
+ * @param sampc Number of samples
+ */
+void aucng_generate(struct aucng *cng, int16_t *sampv, size_t sampc)
+{
+	const size_t step = cng ? cng->m * cng->ch : 1;
+	size_t n, i;
+	uint32_t j;
+
+	if (!cng || !sampv)
+		return;
+
+	if (!cng->running) {
+		memset(sampv, 0, sampc * 2);
+		return;
+	}
+
+	/* move halfway to the last SID on every frame */
+	cng->gain += (cng->gain_tgt - cng->gain) * 0.5f;
+	for (j=0; j<cng->order; j++)
+		cng->k[j] += (cng->k_tgt[j] - cng->k[j]) * 0.5f;
+	k2a(cng);
+
+	n = sampc / step;
+
+	for (i=0; i<n; i++) {
+
+		float y = cng->gain * noise(cng);
+		int16_t s;
+		uint32_t p;
+
+		for (j=0; j<cng->order; j++)
+			y -= cng->a[j] * cng->y[j];
+
+		for (j=cng->order; j>1; j--)
+			cng->y[j-1] = cng->y[j-2];
+		if (cng->order)
+			cng->y[0] = y;
+
+		/* linear interpolation up to the output rate */
+		for (p=0; p<cng->m; p++) {
+			const float v = cng->last +
+				(y - cng->last) * (p + 1) / cng->m;
+			uint8_t c;
+
+			s = (int16_t)(v > 32767.0f ? 32767 :
+				      v < -32768.0f ? -32768 : v);
+
+			for (c=0; c<cng->ch; c++)
+				*sampv++ = s;
+		}
+
+		cng->last = y;
+	}
+
+	/* leftover samples if sampc was not a whole number of steps */
+	for (i=n*step; i<sampc; i++)
+		*sampv++ = 0;
+}
@@ -5,9 +5,9 @@
  */
 
 #define _BSD_SOURCE 1
-#include <unistd.h>
 #include <pthread.h>
 #include <string.h>
+#include <time.h>
 #include <re.h>
 #include <rem_au.h>
 #include <rem_aubuf.h>
@@ -82,44 +82,110 @@ static void source_destructor(void *arg)
 }
 
 
+enum {
+	MAX_LATE = 4,  /* frames behind schedule before the clock resyncs */
+};
+
+
+static inline int16_t saturate_s16(int32_t v)
+{
+	if (v > 32767)
+		return 32767;
+	else if (v < -32768)
+		return -32768;
+
+	return (int16_t)v;
+}
+
+
+/*
+ * Mix one frame. All sources are summed once into a 32-bit accumulator
+ * and each participant gets the total minus its own contribution, so
+ * the cost is O(N) instead of O(N^2).
+ */
+static void mix_frame(struct aumix *mix, const int16_t *base,
+		      int32_t *acc, int16_t *out)
+{
+	const size_t n = mix->frame_size;
+	struct le *le;
+	size_t i;
+
+	for (i=0; i<n; i++)
+		acc[i] = base[i];
+
+	for (le=mix->srcl.head; le; le=le->next) {
+
+		struct aumix_source *src = le->data;
+		const int16_t *v = src->frame;
+
+		aubuf_read_samp(src->aubuf, src->frame, n);
+
+		for (i=0; i<n; i++)
+			acc[i] += v[i];
+	}
+
+	for (le=mix->srcl.head; le; le=le->next) {
+
+		struct aumix_source *src = le->data;
+		const int16_t *v = src->frame;
+
+		for (i=0; i<n; i++)
+			out[i] = saturate_s16(acc[i] - v[i]);
+
+		src->fh(out, n, src->arg);
+	}
+}
+
+
 static void *aumix_thread(void *arg)
 {
 	uint8_t *silence, *frame, *base_frame;
 	struct aumix *mix = arg;
-	int16_t *mix_frame;
+	int16_t *out_frame;
+	int32_t *acc;
 	uint64_t ts = 0;
 
 	silence   = mem_zalloc(mix->frame_size*2, NULL);
 	frame     = mem_alloc(mix->frame_size*2, NULL);
-	mix_frame = mem_alloc(mix->frame_size*2, NULL);
+	out_frame = mem_alloc(mix->frame_size*2, NULL);
+	acc       = mem_alloc(mix->frame_size*sizeof(*acc), NULL);
 
-	if (!silence || !frame || !mix_frame)
+	if (!silence || !frame || !out_frame || !acc)
 		goto out;
 
 	pthread_mutex_lock(&mix->mutex);
 
 	while (mix->run) {
 
-		struct le *le;
 		uint64_t now;
 
 		if (!mix->srcl.head) {
 			mix->af = mem_deref(mix->af);
 			pthread_cond_wait(&mix->cond, &mix->mutex);
 			ts = 0;
-		}
-		else {
-			pthread_mutex_unlock(&mix->mutex);
-			(void)usleep(4000);
-			pthread_mutex_lock(&mix->mutex);
+			continue;
 		}
 
 		now = tmr_jiffies();
 		if (!ts)
 			ts = now;
 
-		if (ts > now)
+		if (ts > now) {
+			struct timespec abstime;
+			uint64_t ms;
+
+			/* sleep until the absolute frame deadline */
+			ms = tmr_jiffies_unix(ts);
+			abstime.tv_sec  = (time_t)(ms / 1000);
+			abstime.tv_nsec = (long)(ms % 1000) * 1000000;
+			(void)pthread_cond_timedwait(&mix->cond, &mix->mutex,
+						     &abstime);
 			continue;
+		}
+
+		/* do not burst to catch up after a long stall */
+		if (now - ts > (uint64_t)mix->ptime * MAX_LATE)
+			ts = now;
 
 		if (mix->af) {
 
@@ -142,36 +208,7 @@ static void *aumix_thread(void *arg)
 			base_frame = silence;
 		}
 
-		for (le=mix->srcl.head; le; le=le->next) {
-
-			struct aumix_source *src = le->data;
-
-			aubuf_read_samp(src->aubuf, src->frame,
-					mix->frame_size);
-		}
-
-		for (le=mix->srcl.head; le; le=le->next) {
-
-			struct aumix_source *src = le->data;
-			struct le *cle;
-
-			memcpy(mix_frame, base_frame, mix->frame_size*2);
-
-			for (cle=mix->srcl.head; cle; cle=cle->next) {
-
-				struct aumix_source *csrc = cle->data;
-				size_t i;
-#if 1
-				/* skip self */
-				if (csrc == src)
-					continue;
-#endif
-				for (i=0; i<mix->frame_size; i++)
-					mix_frame[i] += csrc->frame[i];
-			}
-
-			src->fh(mix_frame, mix->frame_size, src->arg);
-		}
+		mix_frame(mix, (int16_t *)(void *)base_frame, acc, out_frame);
 
 		ts += mix->ptime;
 	}
@@ -179,9 +216,10 @@ static void *aumix_thread(void *arg)
 	pthread_mutex_unlock(&mix->mutex);
 
  out:
-	mem_deref(mix_frame);
+	mem_deref(out_frame);
 	mem_deref(silence);
 	mem_deref(frame);
+	mem_deref(acc);
 
 	return NULL;
 }
@@ -0,0 +1,349 @@
+/**
+ * @file plc.c Audio Packet Loss Concealment
+ *
+ * Pitch based waveform substitution, after ITU-T G.711 Appendix I. On the
+ * first lost frame the pitch period of the recent history is found with
+ * an AMDF search, and one period is cut out with its end cross-faded into
+ * the period before, so that it can be repeated without clicks. The lost
+ * frames are filled with that period, held at full level for 10 ms and
+ * then faded out over 50 ms. The first good frame after a loss is
+ * overlap-added with the continued synthetic signal.
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+#include <re.h>
+#include <string.h>
+#include <rem_auplc.h>
+
+
+/* All lengths in [frames] at 8000 Hz, scaled to the actual sample rate */
+enum {
+	PLC_PITCH_MIN = 40,    /**< Shortest pitch period, 200 Hz        */
+	PLC_PITCH_MAX = 120,   /**< Longest pitch period, 66.7 Hz        */
+	PLC_SPAN      = 160,   /**< Length of AMDF comparison window     */
+	PLC_HOLD      = 80,    /**< Synthetic signal at full level       */
+	PLC_FADE      = 400,   /**< Linear fade out after the hold       */
+	GAIN_SHIFT    = 15,
+	GAIN_UNITY    = 1 << GAIN_SHIFT
+};
+
+
+/** Defines an Audio packet loss concealer */
+struct auplc {
+	int16_t *histv;      /**< Last hist_len frames, newest last    */
+	int16_t *pitchv;     /**< One pitch period of synthetic signal */
+	uint32_t hist_len;   /**< [frames] Length of history           */
+	uint32_t pitch_min;  /**< [frames] Shortest pitch period       */
+	uint32_t pitch_max;  /**< [frames] Longest pitch period        */
+	uint32_t span;       /**< [frames] AMDF comparison window      */
+	uint32_t step;       /**< AMDF decimation, 1 at 8000 Hz        */
+	uint32_t hold;       /**< [frames] Concealed at full level     */
+	uint32_t fade;       /**< [frames] Fade out after the hold     */
+	uint32_t pitch;      /**< [frames] Pitch period of this loss   */
+	uint32_t offset;     /**< [frames] Read position in pitchv     */
+	uint32_t missing;    /**< [frames] Concealed so far, 0 if none */
+	size_t sampc;        /**< Number of samples in last good frame */
+	uint8_t ch;
+};
+
+
+static void destructor(void *arg)
+{
+	struct auplc *plc = arg;
+
+	mem_deref(plc->histv);
+	mem_deref(plc->pitchv);
+}
+
+
+static void history_save(struct auplc *plc, const int16_t *sampv,
+			 uint32_t n)
+{
+	const uint32_t ch = plc->ch;
+
+	if (n >= plc->hist_len) {
+		memcpy(plc->histv, &sampv[(n - plc->hist_len) * ch],
+		       plc->hist_len * ch * 2);
+		return;
+	}
+
+	memmove(plc->histv, &plc->histv[n * ch],
+		(plc->hist_len - n) * ch * 2);
+	memcpy(&plc->histv[(plc->hist_len - n) * ch], sampv, n * ch * 2);
+}
+
+
+/* Gain in Q15 after n concealed frames */
+static int32_t gain_calc(const struct auplc *plc, uint32_t n)
+{
+	if (n < plc->hold)
+		return GAIN_UNITY;
+
+	n -= plc->hold;
+	if (n >= plc->fade)
+		return 0;
+
+	return (int32_t)(((uint64_t)(plc->fade - n) << GAIN_SHIFT) /
+			 plc->fade);
+}
+
+
+/* Average magnitude difference of the last span frames, lag p */
+static uint32_t amdf(const struct auplc *plc, uint32_t p)
+{
+	const uint32_t ch = plc->ch;
+	const int16_t *x = &plc->histv[(plc->hist_len - plc->span) * ch];
+	const int16_t *y = x - p * ch;
+	uint32_t acc = 0, j;
+
+	for (j=0; j<plc->span; j+=plc->step) {
+		const int32_t d = x[j * ch] - y[j * ch];
+
+		acc += d < 0 ? -d : d;
+	}
+
+	return acc;
+}
+
+
+/*
+ * Coarse search on every step-th lag, then refine around the best one.
+ * The first channel is representative for the pitch of both.
+ */
+static uint32_t pitch_find(const struct auplc *plc)
+{
+	uint32_t p, lo, hi, best = plc->pitch_min;
+	uint32_t acc, best_acc = (uint32_t)-1;
+
+	for (p=plc->pitch_min; p<=plc->pitch_max; p+=plc->step) {
+
+		acc = amdf(plc, p);
+		if (acc < best_acc) {
+			best_acc = acc;
+			best = p;
+		}
+	}
+
+	if (plc->step == 1)
+		return best;
+
+	lo = best > plc->pitch_min + plc->step ?
+		best - plc->step + 1 : plc->pitch_min;
+	hi = min(best + plc->step - 1, plc->pitch_max);
+
+	for (p=lo; p<=hi; p++) {
+
+		acc = amdf(plc, p);
+		if (acc < best_acc) {
+			best_acc = acc;
+			best = p;
+		}
+	}
+
+	return best;
+}
+
+
+/*
+ * Cut the last pitch period out of the history. Its last quarter is
+ * cross-faded into the period before, which makes the end join up with
+ * the start when the period is repeated.
+ */
+static void pitch_setup(struct auplc *plc)
+{
+	const uint32_t ch = plc->ch;
+	const uint32_t pitch = pitch_find(plc);
+	const uint32_t ov = pitch / 4;
+	const int16_t *h1 = &plc->histv[(plc->hist_len - pitch) * ch];
+	const int16_t *h2 = &plc->histv[(plc->hist_len - 2 * pitch) * ch];
+	uint32_t i, c;
+
+	memcpy(plc->pitchv, h1, (pitch - ov) * ch * 2);
+
+	for (i=pitch-ov; i<pitch; i++) {
+
+		const int32_t w = (int32_t)(((i - (pitch - ov) + 1)
+					     << GAIN_SHIFT) / (ov + 1));
+
+		for (c=0; c<ch; c++) {
+			const uint32_t k = i * ch + c;
+
+			plc->pitchv[k] = (int16_t)((h1[k] * (GAIN_UNITY - w) +
+						    h2[k] * w) >> GAIN_SHIFT);
+		}
+	}
+
+	plc->pitch  = pitch;
+	plc->offset = 0;
+}
+
+
+/**
+ * Allocate a new Audio packet loss concealer
+ *
+ * @param plcp  Pointer to allocated packet loss concealer
+ * @param srate Sample rate in [Hz]
+ * @param ch    Number of channels
+ *
+ * @return 0 for success, otherwise error code
+ */
+int auplc_alloc(struct auplc **plcp, uint32_t srate, uint8_t ch)
+{
+	struct auplc *plc;
+	int err = 0;
+
+	if (!plcp || srate < 8000 || ch < 1 || ch > 2)
+		return EINVAL;
+
+	plc = mem_zalloc(sizeof(*plc), destructor);
+	if (!plc)
+		return ENOMEM;
+
+	plc->ch        = ch;
+	plc->pitch_min = PLC_PITCH_MIN * srate / 8000;
+	plc->pitch_max = PLC_PITCH_MAX * srate / 8000;
+	plc->span      = PLC_SPAN * srate / 8000;
+	plc->hold      = PLC_HOLD * srate / 8000;
+	plc->fade      = PLC_FADE * srate / 8000;
+	plc->step      = srate / 8000;
+	plc->hist_len  = plc->span + plc->pitch_max;
+
+	plc->histv  = mem_zalloc(plc->hist_len * ch * 2, NULL);
+	plc->pitchv = mem_zalloc(plc->pitch_max * ch * 2, NULL);
+	if (!plc->histv || !plc->pitchv) {
+		err = ENOMEM;
+		goto out;
+	}
+
+ out:
+	if (err)
+		mem_deref(plc);
+	else
+		*plcp = plc;
+
+	return err;
+}
+
+
+/**
+ * Pass a correctly received frame through the packet loss concealer.
+ * After a loss the start of the frame is smoothed into the synthetic
+ * signal.
+ *
+ * @param plc   Packet loss concealer
+ * @param sampv Decoded PCM data, modified in place
+ * @param sampc Number of samples
+ */
+void auplc_update(struct auplc *plc, int16_t *sampv, size_t sampc)
+{
+	uint32_t n;
+
+	if (!plc || !sampv)
+		return;
+
+	n = (uint32_t)(sampc / plc->ch);
+
+	if (plc->missing) {
+
+		const int32_t g = gain_calc(plc, plc->missing);
+		const uint32_t ov = min(plc->pitch / 4, n);
+		uint32_t i, c;
+
+		for (i=0; i<ov; i++) {
+
+			const int32_t w = (int32_t)(((i + 1) << GAIN_SHIFT) /
+						    (ov + 1));
+			const int16_t *y = &plc->pitchv[plc->offset * plc->ch];
+
+			for (c=0; c<plc->ch; c++) {
+				const int32_t s = (y[c] * g) >> GAIN_SHIFT;
+				int16_t *x = &sampv[i * plc->ch + c];
+
+				*x = (int16_t)((s * (GAIN_UNITY - w) + *x * w)
+					       >> GAIN_SHIFT);
+			}
+
+			if (++plc->offset >= plc->pitch)
+				plc->offset = 0;
+		}
+
+		plc->missing = 0;
+	}
+
+	plc->sampc = sampc;
+
+	history_save(plc, sampv, n);
+}
+
+
+/**
+ * Synthesize one lost frame, the same length as the last good frame
+ *
+ * @param plc   Packet loss concealer
+ * @param sampv Buffer for synthetic PCM data
+ * @param sampc Size of buffer, returned number of samples
+ *
+ * @return 0 for success, otherwise error code
+ */
+int auplc_conceal(struct auplc *plc, int16_t *sampv, size_t *sampc)
+{
+	uint32_t n, i = 0, c;
+	const uint32_t ch = plc ? plc->ch : 1;
+
+	if (!plc || !sampv || !sampc)
+		return EINVAL;
+
+	if (*sampc < plc->sampc)
+		return ENOMEM;
+
+	n = (uint32_t)(plc->sampc / ch);
+
+	if (!plc->missing) {
+
+		uint32_t ov;
+
+		pitch_setup(plc);
+
+		ov = min(plc->pitch / 4, n);
+
+		/* fade from the time-reversed end of the history into the
+		   synthetic signal, which needs no extra delay */
+		for (i=0; i<ov; i++) {
+
+			const int32_t w = (int32_t)(((i + 1) << GAIN_SHIFT) /
+						    (ov + 1));
+			const int16_t *h = &plc->histv[(plc->hist_len - 1 - i)
+						       * ch];
+
+			for (c=0; c<ch; c++) {
+				sampv[i * ch + c] =
+					(int16_t)((h[c] * (GAIN_UNITY - w) +
+						   plc->pitchv[i * ch + c] * w)
+						  >> GAIN_SHIFT);
+			}
+		}
+
+		plc->offset = ov;
+	}
+
+	for (; i<n; i++) {
+
+		const int32_t g = gain_calc(plc, plc->missing + i);
+		const int16_t *y = &plc->pitchv[plc->offset * ch];
+
+		for (c=0; c<ch; c++)
+			sampv[i * ch + c] = (int16_t)((y[c] * g) >> GAIN_SHIFT);
+
+		if (++plc->offset >= plc->pitch)
+			plc->offset = 0;
+	}
+
+	/* stop counting once faded out */
+	plc->missing = min(plc->missing + n, plc->hold + plc->fade);
+
+	history_save(plc, sampv, n);
+
+	*sampc = plc->sampc;
+
+	return 0;
+}
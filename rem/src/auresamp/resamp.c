@@ -1,129 +1,190 @@
 /**
  * @file resamp.c Audio Resampler
  *
+ * Polyphase windowed-sinc resampler. The conversion ratio is reduced to
+ * L/M, and a Kaiser-windowed low-pass prototype running at L times the
+ * input rate is split into L phases of TAPS coefficients each. Every
+ * output sample is a TAPS long dot product of one phase against the
+ * input history. The phase and the input history are carried across
+ * calls, so consecutive frames are resampled as one continuous signal.
+ *
  * Copyright (C) 2010 Creytiv.com
  */
 #include <re.h>
 #include <string.h>
 #include <stdlib.h>
-#include <rem_fir.h>
+#include <math.h>
 #include <rem_auresamp.h>
 
 
-typedef void (resample_h)(struct auresamp *ar, int16_t *dst,
-			  const int16_t *src, size_t nsamp_dst);
+#if !defined (M_PI)
+#define M_PI 3.14159265358979323846264338327
+#endif
+
+
+enum {
+	RESAMP_TAPS       = 32,    /**< Taps per phase when interpolating */
+	RESAMP_TAPS_MAX   = 128,   /**< Upper bound for taps per phase    */
+	RESAMP_PHASES_MAX = 1024,  /**< Upper bound for number of phases  */
+	COEFF_SHIFT       = 15,    /**< Coefficients are in Q15 format    */
+};
+
+static const double kaiser_beta = 7.0;   /* about 70 dB stopband */
+static const double cutoff      = 0.90;  /* relative to Nyquist   */
 
 
 /** Defines an Audio resampler */
 struct auresamp {
-	struct fir fir;
-	const int16_t *coeffv;
-	int16_t *sampv;
-	size_t sampc;
-	int coeffn;
-	double ratio;
+	int16_t *coeffv;   /**< Coefficient bank, L phases x TAPS     */
+	int16_t *sampv;    /**< History followed by current input     */
+	size_t sampc;      /**< Maximum number of input samples       */
+	uint32_t l;        /**< Interpolation factor                  */
+	uint32_t m;        /**< Decimation factor                     */
+	uint32_t taps;     /**< Taps per phase                        */
+	uint32_t phase;    /**< Current phase, 0 .. L-1               */
+	size_t idx;        /**< Input frame of next output sample     */
 	uint8_t ch_in;
 	uint8_t ch_out;
-	resample_h *resample;
-};
-
-
-/*
- * FIR filter with cutoff 8000Hz, samplerate 16000Hz
- */
-static const int16_t fir_lowpass[31] = {
-   -55,      0,     96,      0,   -220,      0,    461,      0,
-  -877,      0,   1608,      0,  -3176,      0,  10342,  16410,
- 10342,      0,  -3176,      0,   1608,      0,   -877,      0,
-   461,      0,   -220,      0,     96,      0,    -55,
 };
 
 
-static inline void resample(struct auresamp *ar, int16_t *dst,
-			    const int16_t *src, size_t nsamp_dst)
+static void destructor(void *arg)
 {
-	double p = 0;
+	struct auresamp *ar = arg;
 
-	while (nsamp_dst--) {
+	mem_deref(ar->coeffv);
+	mem_deref(ar->sampv);
+}
 
-		*dst++ = src[(int)p];
 
-		p += 1/ar->ratio;
+static uint32_t gcd(uint32_t a, uint32_t b)
+{
+	while (b) {
+		uint32_t t = a % b;
+		a = b;
+		b = t;
 	}
+
+	return a;
 }
 
 
-static inline void resample_mono2stereo(struct auresamp *ar, int16_t *dst,
-					const int16_t *src, size_t nsamp_dst)
+/* Zeroth order modified Bessel function of the first kind */
+static double bessel_i0(double x)
 {
-	double p = 0;
+	double sum = 1.0, term = 1.0;
+	int k;
 
-	while (nsamp_dst--) {
+	for (k=1; k<50; k++) {
 
-		const int i = (int)p;
+		term *= (x / (2.0 * k)) * (x / (2.0 * k));
+		sum  += term;
 
-		*dst++ = src[i];  /* Left channel */
-		*dst++ = src[i];  /* Right channel */
-
-		p += 1/ar->ratio;
+		if (term < sum * 1e-12)
+			break;
 	}
+
+	return sum;
 }
 
 
-static inline void resample_stereo2mono(struct auresamp *ar, int16_t *dst,
-					const int16_t *src, size_t nsamp_dst)
+/*
+ * Design the prototype low-pass filter and store it as L phases, each
+ * normalised to unity DC gain. Phases are stored time-reversed so that
+ * the dot product walks the input forward.
+ */
+static void coeff_design(struct auresamp *ar)
 {
-	double p = 0;
+	const uint32_t n = ar->l * ar->taps;
+	const double fc  = cutoff * 0.5 / max(ar->l, ar->m);
+	const double mid = (n - 1) / 2.0;
+	const double i0b = bessel_i0(kaiser_beta);
+	uint32_t p, j;
 
-	while (nsamp_dst--) {
+	for (p=0; p<ar->l; p++) {
 
-		const int i = ((int)p) & ~1;
+		int16_t *coeff = &ar->coeffv[p * ar->taps];
+		double hv[RESAMP_TAPS_MAX];
+		double sum = 0;
 
-		*dst++ = (src[i] + src[i+1]) / 2;
+		for (j=0; j<ar->taps; j++) {
 
-		p += 1/ar->ratio * 2;
-	}
-}
+			const double t = (p + j * ar->l) - mid;
+			const double r = t / mid;
+			double h, w;
 
+			if (t == 0.0)
+				h = 2 * fc;
+			else
+				h = sin(2 * M_PI * fc * t) / (M_PI * t);
 
-static inline void resample_stereo(struct auresamp *ar, int16_t *dst,
-				   const int16_t *src, size_t nsamp_dst)
-{
-	double p = 0;
+			w = bessel_i0(kaiser_beta * sqrt(max(0.0, 1 - r*r)))
+				/ i0b;
 
-	while (nsamp_dst--) {
+			hv[j] = h * w;
+			sum  += hv[j];
+		}
 
-		const int i = ((int)p) & ~1;
+		for (j=0; j<ar->taps; j++) {
 
-		*dst++ = src[i];    /* Left channel */
-		*dst++ = src[i+1];  /* Right channel */
+			const double c = hv[j] / sum * (1 << COEFF_SHIFT);
 
-		p += 1/ar->ratio * 2;
+			if (c >= 32767.0)
+				coeff[ar->taps-1-j] = 32767;
+			else if (c <= -32768.0)
+				coeff[ar->taps-1-j] = -32768;
+			else
+				coeff[ar->taps-1-j] =
+					(int16_t)(c < 0 ? c - 0.5 : c + 0.5);
+		}
 	}
 }
 
 
-static void auresamp_lowpass(struct auresamp *ar, int16_t *buf, size_t nsamp,
-			     int channels)
+static inline int16_t saturate_s16(int32_t v)
 {
-	while (nsamp > 0) {
+	if (v > 32767)
+		return 32767;
+	else if (v < -32768)
+		return -32768;
 
-		size_t len = min(nsamp, FIR_MAX_INPUT_LEN);
+	return (int16_t)v;
+}
 
-		fir_process(&ar->fir, ar->coeffv, buf, buf, len, ar->coeffn,
-			    channels);
 
-		buf   += (len*channels);
-		nsamp -= len;
-	}
+/* Dot product of one phase against the oldest TAPS input frames */
+static inline int32_t fir_dot(const int16_t *coeff, const int16_t *x,
+			      uint32_t taps, uint8_t ch)
+{
+	int32_t acc = 1 << (COEFF_SHIFT - 1);
+	uint32_t j;
+
+	for (j=0; j<taps; j++)
+		acc += (int32_t)coeff[j] * (int32_t)x[j * ch];
+
+	return acc >> COEFF_SHIFT;
 }
 
 
-static void destructor(void *arg)
+/* Pass-through for L == M, only converting the number of channels */
+static void convert_channels(const struct auresamp *ar, int16_t *dst,
+			     const int16_t *src, size_t nframes)
 {
-	struct auresamp *ar = arg;
-
-	mem_deref(ar->sampv);
+	if (ar->ch_in == ar->ch_out) {
+		memcpy(dst, src, nframes * ar->ch_in * 2);
+	}
+	else if (ar->ch_in == 1) {
+		while (nframes--) {
+			*dst++ = *src;
+			*dst++ = *src++;
+		}
+	}
+	else {
+		while (nframes--) {
+			*dst++ = (int16_t)((src[0] + src[1]) / 2);
+			src += 2;
+		}
+	}
 }
 
 
@@ -131,56 +192,69 @@ static void destructor(void *arg)
  * Allocate a new Audio resampler
  *
  * @param arp       Pointer to allocated audio resampler
- * @param sampc_max Maximum number of source samples when downsampling
+ * @param sampc_max Maximum number of source samples per call
  * @param srate_in  Sample rate for the input in [Hz]
  * @param ch_in     Number of channels for the input
  * @param srate_out Sample rate for the output in [Hz]
  * @param ch_out    Number of channels for the output
  *
  * @return 0 for success, otherwise error code
+ *
+ * @note Ratios that need more than 1024 phases are approximated
  */
 int auresamp_alloc(struct auresamp **arp, size_t sampc_max,
 		   uint32_t srate_in, uint8_t ch_in,
 		   uint32_t srate_out, uint8_t ch_out)
 {
 	struct auresamp *ar;
+	uint32_t g;
 	int err = 0;
 
 	if (!arp || !sampc_max || !srate_in || !srate_out)
 		return EINVAL;
 
+	if (ch_in < 1 || ch_in > 2 || ch_out < 1 || ch_out > 2)
+		return EINVAL;
+
 	ar = mem_zalloc(sizeof(*ar), destructor);
 	if (!ar)
 		return ENOMEM;
 
-	ar->sampv = mem_zalloc(sampc_max * 2, NULL);
-	if (!ar->sampv) {
-		err = ENOMEM;
-		goto out;
-	}
+	g = gcd(srate_in, srate_out);
 
-	ar->sampc = sampc_max;
-	ar->ratio = 1.0 * srate_out / srate_in;
-	ar->ch_in = ch_in;
+	ar->l      = srate_out / g;
+	ar->m      = srate_in / g;
+	ar->ch_in  = ch_in;
 	ar->ch_out = ch_out;
+	ar->sampc  = sampc_max;
+
+	if (ar->l > RESAMP_PHASES_MAX) {
+		ar->m = (uint32_t)((uint64_t)ar->m * RESAMP_PHASES_MAX
+				   / ar->l);
+		ar->l = RESAMP_PHASES_MAX;
+		if (!ar->m)
+			ar->m = 1;
+	}
 
-	fir_init(&ar->fir);
+	if (ar->l == ar->m)
+		goto out;
 
-	if (ch_in == 1 && ch_out == 1)
-		ar->resample = resample;
-	else if (ch_in == 1 && ch_out == 2)
-		ar->resample = resample_mono2stereo;
-	else if (ch_in == 2 && ch_out == 1)
-		ar->resample = resample_stereo2mono;
-	else if (ch_in == 2 && ch_out == 2)
-		ar->resample = resample_stereo;
-	else {
-		err = EINVAL;
+	/* keep the transition band constant relative to the output rate */
+	ar->taps = RESAMP_TAPS * max(ar->l, ar->m) / ar->l;
+	ar->taps = min(ar->taps, RESAMP_TAPS_MAX);
+
+	ar->coeffv = mem_alloc(ar->l * ar->taps * sizeof(int16_t), NULL);
+	ar->sampv  = mem_zalloc((sampc_max + ar->taps * ch_in) * 2, NULL);
+	if (!ar->coeffv || !ar->sampv) {
+		err = ENOMEM;
 		goto out;
 	}
 
-	ar->coeffv = fir_lowpass;
-	ar->coeffn = (int)ARRAY_SIZE(fir_lowpass);
+	coeff_design(ar);
+
+	/* the first output is aligned with the first input frame */
+	ar->idx   = ar->taps - 1;
+	ar->phase = 0;
 
  out:
 	if (err)
@@ -207,38 +281,82 @@ int auresamp_process(struct auresamp *ar,
 		     int16_t *dst_sampv, size_t *dst_sampc,
 		     const int16_t *src_sampv, size_t src_sampc)
 {
-	size_t ns, nd;
+	const uint8_t ch = ar ? ar->ch_in : 1;
+	size_t ns, nd, hist, end, k;
+	uint64_t pos;
 
 	if (!ar || !dst_sampv || !dst_sampc || !src_sampv)
 		return EINVAL;
 
-	ns = src_sampc / ar->ch_in;
-	nd = (size_t)(ns * ar->ratio);
+	ns = src_sampc / ch;
 
-	if (*dst_sampc < nd * ar->ch_out)
-		return ENOMEM;
+	if (ar->l == ar->m) {
 
-	if (ar->ratio > 1) {
+		if (*dst_sampc < ns * ar->ch_out)
+			return ENOMEM;
+
+		convert_channels(ar, dst_sampv, src_sampv, ns);
+		*dst_sampc = ns * ar->ch_out;
 
-		ar->resample(ar, dst_sampv, src_sampv, nd);
-		auresamp_lowpass(ar, dst_sampv, nd, ar->ch_out);
+		return 0;
 	}
-	else if (ar->ratio < 1) {
 
-		/* decimation: low-pass filter, then downsample */
+	if (src_sampc > ar->sampc)
+		return ENOMEM;
 
-		if (src_sampc > ar->sampc)
-			return ENOMEM;
+	hist = ar->taps - 1;
+	end  = hist + ns;
 
-		memcpy(ar->sampv, src_sampv, src_sampc * 2);
+	/* number of outputs whose input position falls before the end */
+	pos = (uint64_t)ar->idx * ar->l + ar->phase;
+	if (pos < (uint64_t)end * ar->l)
+		nd = (size_t)(((uint64_t)end * ar->l - pos + ar->m - 1)
+			      / ar->m);
+	else
+		nd = 0;
 
-		auresamp_lowpass(ar, ar->sampv, ns, ar->ch_in);
-		ar->resample(ar, dst_sampv, ar->sampv, nd);
-	}
-	else {
-		ar->resample(ar, dst_sampv, src_sampv, nd);
+	if (*dst_sampc < nd * ar->ch_out)
+		return ENOMEM;
+
+	memcpy(&ar->sampv[hist * ch], src_sampv, ns * ch * 2);
+
+	for (k=0; k<nd; k++) {
+
+		const int16_t *coeff = &ar->coeffv[ar->phase * ar->taps];
+		const int16_t *x = &ar->sampv[(ar->idx - hist) * ch];
+
+		if (ch == 1) {
+			const int16_t y = saturate_s16(fir_dot(coeff, x,
+							       ar->taps, 1));
+
+			*dst_sampv++ = y;
+			if (ar->ch_out == 2)
+				*dst_sampv++ = y;
+		}
+		else {
+			const int32_t yl = fir_dot(coeff, x,     ar->taps, 2);
+			const int32_t yr = fir_dot(coeff, x + 1, ar->taps, 2);
+
+			if (ar->ch_out == 2) {
+				*dst_sampv++ = saturate_s16(yl);
+				*dst_sampv++ = saturate_s16(yr);
+			}
+			else {
+				*dst_sampv++ = saturate_s16((yl + yr) / 2);
+			}
+		}
+
+		ar->phase += ar->m;
+		while (ar->phase >= ar->l) {
+			ar->phase -= ar->l;
+			++ar->idx;
+		}
 	}
 
+	/* keep the last TAPS-1 input frames as history for the next call */
+	memmove(ar->sampv, &ar->sampv[ns * ch], hist * ch * 2);
+	ar->idx -= ns;
+
 	*dst_sampc = nd * ar->ch_out;
 
 	return 0;
@@ -19,6 +19,16 @@
  */
 
 
+/*
+ * The history is a ring of FIR_RING_LEN samples per channel, written
+ * backwards in time. Every sample is stored twice, at pos and at
+ * pos + FIR_RING_LEN, so the newest filterLength samples always form
+ * one contiguous run starting at pos. No memmove is needed between
+ * calls, and the multiply-accumulate walks coefficients and samples
+ * forward, which lets the compiler vectorise it.
+ */
+
+
 /**
  * Initialize the FIR-filter
  *
@@ -27,6 +37,36 @@
 void fir_init(struct fir *fir)
 {
 	memset(fir->insamp, 0, sizeof(fir->insamp));
+	fir->pos = 0;
+}
+
+
+static inline int16_t fir_dot(const int16_t *coeffs, const int16_t *x,
+			      int n)
+{
+	int32_t acc0 = 1 << 14, acc1 = 0, acc2 = 0, acc3 = 0;
+	int k;
+
+	/* four independent accumulators, then the remainder */
+	for (k = 0; k + 4 <= n; k += 4) {
+		acc0 += (int32_t)coeffs[k]   * (int32_t)x[k];
+		acc1 += (int32_t)coeffs[k+1] * (int32_t)x[k+1];
+		acc2 += (int32_t)coeffs[k+2] * (int32_t)x[k+2];
+		acc3 += (int32_t)coeffs[k+3] * (int32_t)x[k+3];
+	}
+	for (; k < n; k++)
+		acc0 += (int32_t)coeffs[k] * (int32_t)x[k];
+
+	acc0 += acc1 + acc2 + acc3;
+
+	/* saturate the result */
+	if (acc0 > 0x3fffffff)
+		acc0 = 0x3fffffff;
+	else if (acc0 < -0x40000000)
+		acc0 = -0x40000000;
+
+	/* convert from Q30 to Q15 */
+	return (int16_t)(acc0 >> 15);
 }
 
 
@@ -40,61 +80,37 @@ void fir_init(struct fir *fir)
  * @param length       Number of samples
  * @param filterLength Number of coefficients
  * @param channels     Number of channels
+ *
+ * @note Input and output may point to the same buffer
  */
 void fir_process(struct fir *fir, const int16_t *coeffs,
 		 const int16_t *input, int16_t *output,
 		 size_t length, int filterLength, uint8_t channels)
 {
-	const int16_t *inputx = input;
-	int32_t acc;
-	const int16_t *coeffp;
-	int16_t *inputp;
+	unsigned pos = fir->pos;
 	size_t n;
-	int k;
 	int ch;
 
-	/* put the new samples at the high end of the buffer */
-	for (n = 0; n < length; n++) {
+	if (filterLength > FIR_MAX_FLT_LEN)
+		filterLength = FIR_MAX_FLT_LEN;
+	if (channels > FIR_MAX_CHANNELS)
+		channels = FIR_MAX_CHANNELS;
 
-		for (ch = 0; ch < channels; ch++) {
-
-			fir->insamp[ch][filterLength - 1 + n] = *inputx++;
-		}
-	}
-
-	for (ch = 0; ch < channels; ch++) {
-
-		/* apply the filter to each input sample */
-		for ( n = 0; n < length; n++ ) {
+	for (n = 0; n < length; n++) {
 
-			coeffp = coeffs;
-			inputp = &fir->insamp[ch][filterLength - 1 + n];
+		pos = (pos - 1) & (FIR_RING_LEN - 1);
 
-			/* load rounding constant */
-			acc = 1 << 14;
+		for (ch = 0; ch < channels; ch++) {
 
-			/* perform the multiply-accumulate */
-			for ( k = 0; k < filterLength; k++ ) {
-				acc += (int32_t)(*coeffp++) *
-					(int32_t)(*inputp--);
-			}
+			int16_t *ring = fir->insamp[ch];
+			const int16_t x = input[channels*n + ch];
 
-			/* saturate the result */
-			if ( acc > 0x3fffffff ) {
-				acc = 0x3fffffff;
-			}
-			else if ( acc < -0x40000000 ) {
-				acc = -0x40000000;
-			}
+			ring[pos] = ring[pos + FIR_RING_LEN] = x;
 
-			/* convert from Q30 to Q15 */
-			output[channels*n + ch] = (int16_t)(acc >> 15);
+			output[channels*n + ch] = fir_dot(coeffs, &ring[pos],
+							  filterLength);
 		}
 	}
 
-	/* shift input samples back in time for next time */
-	for (ch = 0; ch < channels; ch++) {
-		memmove( &fir->insamp[ch][0], &fir->insamp[ch][length],
-			 (filterLength - 1) * sizeof(int16_t) );
-	}
+	fir->pos = pos;
 }
@@ -851,3 +851,129 @@ const int16_t g711_A2l[256] = {
 	   688,   656,   752,   720,   560,   528,   624,   592,
 	   944,   912,  1008,   976,   816,   784,   880,   848,
 };
+
+
+/*
+ * Batch kernels. The sign handling is branch-free and the loops are
+ * unrolled, so each sample is a few ALU operations and one table load.
+ * Output is bit-exact with the per-sample inline functions.
+ */
+
+
+static inline uint8_t enc_ulaw(int16_t l)
+{
+	const int32_t s = (int32_t)l >> 31;           /* 0 or -1         */
+	int32_t a = ((int32_t)l ^ s) - s;             /* |l|             */
+	const uint8_t mask = (uint8_t)(0xff ^ (s & 0x80));
+
+	a -= (a >> 15);                               /* 32768 -> 32767  */
+
+	if (a < 4)
+		return 0xff & mask;
+
+	return g711_l2u[(a - 4) >> 3] & mask;
+}
+
+
+static inline uint8_t enc_alaw(int16_t l)
+{
+	const int32_t s = (int32_t)l >> 31;
+	int32_t a = ((int32_t)l ^ s) - s;
+	const uint8_t mask = (uint8_t)(0xff ^ (s & 0x80));
+
+	a -= (a >> 15);
+
+	return g711_l2A[a >> 4] & mask;
+}
+
+
+/**
+ * Encode a block of 16-bit PCM samples to U-law format
+ *
+ * @param dst Destination buffer for U-law bytes
+ * @param src Signed PCM samples
+ * @param n   Number of samples
+ */
+void g711_pcm2ulaw_v(uint8_t *dst, const int16_t *src, size_t n)
+{
+	for (; n >= 4; n -= 4) {
+		dst[0] = enc_ulaw(src[0]);
+		dst[1] = enc_ulaw(src[1]);
+		dst[2] = enc_ulaw(src[2]);
+		dst[3] = enc_ulaw(src[3]);
+		dst += 4;
+		src += 4;
+	}
+
+	while (n--)
+		*dst++ = enc_ulaw(*src++);
+}
+
+
+/**
+ * Encode a block of 16-bit PCM samples to A-law format
+ *
+ * @param dst Destination buffer for A-law bytes
+ * @param src Signed PCM samples
+ * @param n   Number of samples
+ */
+void g711_pcm2alaw_v(uint8_t *dst, const int16_t *src, size_t n)
+{
+	for (; n >= 4; n -= 4) {
+		dst[0] = enc_alaw(src[0]);
+		dst[1] = enc_alaw(src[1]);
+		dst[2] = enc_alaw(src[2]);
+		dst[3] = enc_alaw(src[3]);
+		dst += 4;
+		src += 4;
+	}
+
+	while (n--)
+		*dst++ = enc_alaw(*src++);
+}
+
+
+/**
+ * Decode a block of U-law samples to 16-bit PCM
+ *
+ * @param dst Destination buffer for signed PCM samples
+ * @param src U-law bytes
+ * @param n   Number of samples
+ */
+void g711_ulaw2pcm_v(int16_t *dst, const uint8_t *src, size_t n)
+{
+	for (; n >= 4; n -= 4) {
+		dst[0] = g711_u2l[src[0]];
+		dst[1] = g711_u2l[src[1]];
+		dst[2] = g711_u2l[src[2]];
+		dst[3] = g711_u2l[src[3]];
+		dst += 4;
+		src += 4;
+	}
+
+	while (n--)
+		*dst++ = g711_u2l[*src++];
+}
+
+
+/**
+ * Decode a block of A-law samples to 16-bit PCM
+ *
+ * @param dst Destination buffer for signed PCM samples
+ * @param src A-law bytes
+ * @param n   Number of samples
+ */
+void g711_alaw2pcm_v(int16_t *dst, const uint8_t *src, size_t n)
+{
+	for (; n >= 4; n -= 4) {
+		dst[0] = g711_A2l[src[0]];
+		dst[1] = g711_A2l[src[1]];
+		dst[2] = g711_A2l[src[2]];
+		dst[3] = g711_A2l[src[3]];
+		dst += 4;
+		src += 4;
+	}
+
+	while (n--)
+		*dst++ = g711_A2l[*src++];
+}
@@ -0,0 +1,82 @@
+/**
+ * @file tests/g711.c  G.711 block kernel bit-exactness test
+ *
+ * Checks g711_*_v() against the inline per-sample functions for all
+ * 65536 PCM inputs and all 256 codewords, and at every block length
+ * around the unrolled loop so that the tail is covered. Build with the
+ * defines of rem and link with rem and libre, e.g.
+ *
+ *   cc $CFLAGS -Iinclude -I../re/include tests/g711.c src/g711/g711.c \
+ *      ../re/libre.a -o g711 && ./g711
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+#include <stdio.h>
+#include <re.h>
+#include <rem_g711.h>
+
+
+enum {
+	NPCM = 65536
+};
+
+
+static int16_t pcm[NPCM], pcm_out[NPCM];
+static uint8_t ulaw[NPCM], alaw[NPCM], code[256];
+
+
+int main(void)
+{
+	size_t i, n;
+	int bad = 0;
+
+	for (i=0; i<NPCM; i++)
+		pcm[i] = (int16_t)(i - 32768);
+
+	for (i=0; i<256; i++)
+		code[i] = (uint8_t)i;
+
+	for (n=0; n<=NPCM; n += (n < 16) ? 1 : NPCM - 16) {
+
+		const size_t off = NPCM - n;
+
+		g711_pcm2ulaw_v(ulaw, &pcm[off], n);
+		g711_pcm2alaw_v(alaw, &pcm[off], n);
+
+		for (i=0; i<n; i++) {
+			if (ulaw[i] != g711_pcm2ulaw(pcm[off + i]) ||
+			    alaw[i] != g711_pcm2alaw(pcm[off + i])) {
+				(void)re_fprintf(stderr, "encode %d (n=%u)\n",
+						 pcm[off + i], (unsigned)n);
+				++bad;
+			}
+		}
+	}
+
+	for (n=0; n<=256; n += (n < 16) ? 1 : 256 - 16) {
+
+		const size_t off = 256 - n;
+
+		g711_ulaw2pcm_v(pcm_out, &code[off], n);
+		for (i=0; i<n; i++) {
+			if (pcm_out[i] != g711_ulaw2pcm(code[off + i])) {
+				(void)re_fprintf(stderr, "ulaw 0x%02x (n=%u)\n",
+						 code[off + i], (unsigned)n);
+				++bad;
+			}
+		}
+
+		g711_alaw2pcm_v(pcm_out, &code[off], n);
+		for (i=0; i<n; i++) {
+			if (pcm_out[i] != g711_alaw2pcm(code[off + i])) {
+				(void)re_fprintf(stderr, "alaw 0x%02x (n=%u)\n",
+						 code[off + i], (unsigned)n);
+				++bad;
+			}
+		}
+	}
+
+	(void)re_fprintf(stderr, "g711: %s\n", bad ? "FAILED" : "ok");
+
+	return bad ? 1 : 0;
+}
@@ -26,9 +26,12 @@ CallbackQueue::CallbackQueue()
 
 }
 
+/*
+	Single consumer (GUI thread) is reading without locking - mutex only
+	serializes producers.
+*/
 int CallbackQueue::GetCallback(Callback& cb)
 {
-	ScopedLock<Mutex> lock(mutex);
 	Callback *tmpcb = fifo.getReadable();
 	if (tmpcb == NULL)
 	{
@@ -39,6 +42,23 @@ int CallbackQueue::GetCallback(Callback& cb)
 	return 0;
 }
 
+unsigned int CallbackQueue::DrainAll(std::vector<Callback>& cbs)
+{
+	unsigned int cnt = fifo.count();
+	for (unsigned int i=0; i<cnt; i++)
+	{
+		Callback *tmpcb = fifo.getReadable();
+		cbs.push_back(*tmpcb);
+		fifo.pop();
+	}
+	return cnt;
+}
+
+unsigned int CallbackQueue::GetOverflowCount(void)
+{
+	return fifo.getOverflowCount();
+}
+
 void CallbackQueue::SetCallData(AnsiString initialRxInvite)
 {
 	ScopedLock<Mutex> lock(mutex);
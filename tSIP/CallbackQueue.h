@@ -7,6 +7,7 @@
 #include "common/singleton.h"
 #include "Callback.h"
 #include <System.hpp>
+#include <vector>
 
 class Callback;
 
@@ -17,6 +18,13 @@ private:
 	friend CSingleton<CallbackQueue>;
 public:
 	int GetCallback(Callback& cb);
+	/** \brief Move all callbacks queued at the moment of the call to cbs
+		\return number of callbacks appended
+	*/
+	unsigned int DrainAll(std::vector<Callback>& cbs);
+	/** \brief Number of callbacks dropped because queue was full
+	*/
+	unsigned int GetOverflowCount(void);
 	/** \param scode SIP code for closing call
 	*/
 	void ChangeCallState(Callback::ua_state_e state, AnsiString caller, AnsiString caller_name, int scode, int answer_after, AnsiString alert_info, AnsiString access_url, int access_url_mode);
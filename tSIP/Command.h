@@ -44,6 +44,7 @@ public:
 	AnsiString pagingTxCodec;
 	unsigned int pagingTxPtime;
 	unsigned int channels;
+	unsigned int recFormat;	///< recording file format, as in UaConf::RecordingCfg::RecFormat
 	unsigned int softvol;
 };
 
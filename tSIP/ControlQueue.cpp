@@ -13,11 +13,19 @@
 
 #include "common/fifo.h"
 #include "Command.h"
+#include <re.h>
 
 namespace
 {
 	Fifo<Command, 512> fifo;
 	Mutex mutex;
+
+	/** Commit command and wake up re_main loop to execute it immediately */
+	void Push(void)
+	{
+		fifo.push();
+		re_wakeup();
+	}
 }
 
 ControlQueue::ControlQueue()
@@ -25,9 +33,12 @@ ControlQueue::ControlQueue()
 
 }
 
+/*
+	Single consumer (re thread) is reading without locking - mutex only
+	serializes producers.
+*/
 int ControlQueue::GetCommand(Command& cmd)
 {
-	ScopedLock<Mutex> lock(mutex);
 	Command *tmpcmd = fifo.getReadable();
 	if (tmpcmd == NULL)
 	{
@@ -46,7 +57,7 @@ void ControlQueue::ReRegister(int accountId)
 		return;
 	cmd->type = Command::REREGISTER;
 	cmd->accountId = accountId;
-	fifo.push();
+	Push();
 }
 
 void ControlQueue::UnRegister(int accountId)
@@ -57,7 +68,7 @@ void ControlQueue::UnRegister(int accountId)
 		return;
 	cmd->type = Command::UNREGISTER;
 	cmd->accountId = accountId;
-	fifo.push();
+	Push();
 }
 
 void ControlQueue::Call(int accountId, AnsiString target, AnsiString extraHeaderLines)
@@ -85,7 +96,7 @@ void ControlQueue::Call(int accountId, AnsiString target, AnsiString extraHeader
         }
     }
 	cmd->extraHeaderLines = extraHeaderLines;
-	fifo.push();
+	Push();
 }
 
 void ControlQueue::Answer(int callId, AnsiString audioRxMod, AnsiString audioRxDev)
@@ -98,7 +109,7 @@ void ControlQueue::Answer(int callId, AnsiString audioRxMod, AnsiString audioRxD
 	cmd->audioMod = audioRxMod;
 	cmd->audioDev = audioRxDev;
 	cmd->callId = callId;
-	fifo.push();
+	Push();
 }
 
 void ControlQueue::Transfer(int callId, AnsiString target)
@@ -110,7 +121,7 @@ void ControlQueue::Transfer(int callId, AnsiString target)
 	cmd->type = Command::TRANSFER;
 	cmd->callId = callId;
 	cmd->target = target;
-	fifo.push();
+	Push();
 }
 
 void ControlQueue::SendDigit(int callId, char key)
@@ -122,7 +133,7 @@ void ControlQueue::SendDigit(int callId, char key)
 	cmd->type = Command::SEND_DIGIT;
 	cmd->callId = callId;
 	cmd->key = key;
-	fifo.push();
+	Push();
 }
 
 void ControlQueue::Hold(int callId, bool state)
@@ -134,7 +145,7 @@ void ControlQueue::Hold(int callId, bool state)
 	cmd->type = Command::HOLD;
 	cmd->callId = callId;
 	cmd->bEnabled = state;
-	fifo.push();
+	Push();
 }
 
 void ControlQueue::Mute(int callId, bool state)
@@ -146,7 +157,7 @@ void ControlQueue::Mute(int callId, bool state)
 	cmd->type = Command::MUTE;
 	cmd->callId = callId;
 	cmd->bEnabled = state;
-	fifo.push();
+	Push();
 }
 
 void ControlQueue::SetMsgLogging(bool enabled)
@@ -157,7 +168,7 @@ void ControlQueue::SetMsgLogging(bool enabled)
 		return;
 	cmd->type = Command::SET_MSG_LOGGING;
 	cmd->bEnabled = enabled;
-	fifo.push();
+	Push();
 }
 
 void ControlQueue::Hangup(int callId, int code)
@@ -169,7 +180,7 @@ void ControlQueue::Hangup(int callId, int code)
 	cmd->type = Command::HANGUP;
 	cmd->callId = callId;
 	cmd->code = code;
-	fifo.push();
+	Push();
 }
 
 void ControlQueue::StartRing(AnsiString wavFile)
@@ -180,7 +191,7 @@ void ControlQueue::StartRing(AnsiString wavFile)
 		return;
 	cmd->type = Command::START_RING;
 	cmd->target = wavFile;
-	fifo.push();
+	Push();
 }
 
 void ControlQueue::StopRing(void)
@@ -190,10 +201,10 @@ void ControlQueue::StopRing(void)
 	if (!cmd)
 		return;
 	cmd->type = Command::STOP_RING;
-	fifo.push();
+	Push();
 }
 
-void ControlQueue::Record(AnsiString wavFile, unsigned int channels)
+void ControlQueue::Record(AnsiString wavFile, unsigned int channels, unsigned int recFormat)
 {
 	ScopedLock<Mutex> lock(mutex);
 	Command *cmd = fifo.getWriteable();
@@ -201,8 +212,9 @@ void ControlQueue::Record(AnsiString wavFile, unsigned int channels)
 		return;
 	cmd->type = Command::RECORD;
 	cmd->channels = channels;
+	cmd->recFormat = recFormat;
 	cmd->target = wavFile;
-	fifo.push();
+	Push();
 }
 
 void ControlQueue::PagingTx(AnsiString target, AnsiString pagingTxWaveFile, AnsiString codec, unsigned int ptime)
@@ -216,7 +228,7 @@ void ControlQueue::PagingTx(AnsiString target, AnsiString pagingTxWaveFile, Ansi
 	cmd->pagingTxWaveFile = pagingTxWaveFile;
 	cmd->pagingTxCodec = codec;
 	cmd->pagingTxPtime = ptime; 
-	fifo.push();
+	Push();
 }
 
 void ControlQueue::SwitchAudioSource(int callId, AnsiString audioMod, AnsiString audioDev)
@@ -229,7 +241,7 @@ void ControlQueue::SwitchAudioSource(int callId, AnsiString audioMod, AnsiString
 	cmd->audioMod = audioMod;
 	cmd->audioDev = audioDev;
 	cmd->callId = callId;
-	fifo.push();
+	Push();
 }
 
 void ControlQueue::SwitchAudioPlayer(int callId, AnsiString audioMod, AnsiString audioDev)
@@ -242,7 +254,7 @@ void ControlQueue::SwitchAudioPlayer(int callId, AnsiString audioMod, AnsiString
 	cmd->audioMod = audioMod;
 	cmd->audioDev = audioDev;
 	cmd->callId = callId;
-	fifo.push();
+	Push();
 }
 
 void ControlQueue::UpdateSoftvolTx(unsigned int val)
@@ -253,7 +265,7 @@ void ControlQueue::UpdateSoftvolTx(unsigned int val)
 		return;
 	cmd->type = Command::UPDATE_SOFTVOL_TX;
 	cmd->softvol = val;
-	fifo.push();
+	Push();
 }
 
 void ControlQueue::UpdateSoftvolRx(unsigned int val)
@@ -264,6 +276,6 @@ void ControlQueue::UpdateSoftvolRx(unsigned int val)
 		return;
 	cmd->type = Command::UPDATE_SOFTVOL_RX;
 	cmd->softvol = val;
-	fifo.push();
+	Push();
 }
 
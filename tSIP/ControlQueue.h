@@ -29,7 +29,7 @@ public:
 	void UnRegister(int accountId);
 	void StartRing(AnsiString wavFile);
 	void StopRing(void);
-	void Record(AnsiString wavFile, unsigned int channels);
+	void Record(AnsiString wavFile, unsigned int channels, unsigned int recFormat);
 	/** \brief Start transmitting RTP to specified targee
 		\param target address IP + port
 		\param pagingTxWaveFile audio file to be transmitted; if not specified default audio source is used
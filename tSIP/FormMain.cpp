@@ -25,6 +25,7 @@
 #include "CallbackQueue.h"
 #include <assert.h>
 #include <stdio.h>
+#include <vector>
 #include "CustomDateUtils.hpp"
 #include "ProgrammableButton.h"
 #include "ProgrammableButtons.h"
@@ -89,6 +90,7 @@ namespace {
 //---------------------------------------------------------------------------
 __fastcall TfrmMain::TfrmMain(TComponent* Owner)
 	: TForm(Owner),
+	callbackOverflows(0),
 	muteRing(false),
 	notificationIconState(false)
 {
@@ -432,6 +434,7 @@ void TfrmMain::UpdateSettings(const Settings &prev)
 
 void __fastcall TfrmMain::FormDestroy(TObject *Sender)
 {
+	ScriptExec::Cleanup();
 	UA->Destroy();
 	UA_CB->Destroy();
 	CLog::Instance()->Destroy();
@@ -771,7 +774,7 @@ int TfrmMain::OnRecordStart(const char* file, int channels)
 		LOG("OnRecordStart: no current call with active media\n");
 		return -2;
 	}
-	UA->Record(file, channels);
+	UA->Record(file, channels, appSettings.uaConf.recording.recFormat);
 	call.recordFile = file;
 	call.recording = true;
 	return 0;
@@ -853,12 +856,30 @@ void __fastcall TfrmMain::tmrCallbackPollTimer(TObject *Sender)
 		}
 	}
 
-	Callback cb;
-	bool answered = false;
-	if (UA_CB->GetCallback(cb) != 0)
+	// handle all callbacks pending at this tick, not just single one;
+	// local buffer: OnCallback may re-enter this timer through
+	// Application->ProcessMessages (Lua Sleep, message boxes)
+	std::vector<Callback> callbacks;
+	if (UA_CB->DrainAll(callbacks) == 0)
 	{
 		return;
 	}
+	for (unsigned int i=0; i<callbacks.size(); i++)
+	{
+		OnCallback(callbacks[i]);
+	}
+
+	unsigned int overflows = UA_CB->GetOverflowCount();
+	if (overflows != callbackOverflows)
+	{
+		LOG("Callback queue overflow: %u callback(s) lost\n", overflows - callbackOverflows);
+		callbackOverflows = overflows;
+	}
+}
+
+void TfrmMain::OnCallback(Callback &cb)
+{
+	bool answered = false;
 	switch (cb.type)
 	{
 		case Callback::CALL_STATE:
@@ -1523,7 +1544,7 @@ void TfrmMain::StartRecording(void)
 			file += b64uri.c_str();
 			file += ".wav";
 			LOG("Record file: %s\n", file.c_str());
-			UA->Record(file, appSettings.uaConf.recording.channels);
+			UA->Record(file, appSettings.uaConf.recording.channels, appSettings.uaConf.recording.recFormat);
 			call.recordFile = file;
 			call.recording = true;
 		}
@@ -1879,24 +1900,16 @@ void TfrmMain::RunScriptFile(int srcType, int srcId, AnsiString filename, bool s
 	{
     	LOG("Running Lua script: %s\n", ExtractFileName(filename).c_str());
 	}
-	std::auto_ptr<TStrings> strings(new TStringList());
 	if (FileExists(filename))
 	{
-		AnsiString scriptText;
-		try
-		{
-			strings->LoadFromFile(filename);
-			scriptText = strings->Text;
-		}
-		catch(...)
+		bool breakReq = false;
+		if (ExecScript(srcType, srcId, "", filename, breakReq) != 0)
 		{
 			AnsiString msg;
 			msg.sprintf("Failed to load script file (%s).", filename.c_str());
 			MessageBox(this->Handle, msg.c_str(), this->Caption.c_str(), MB_ICONEXCLAMATION);
 			return;
 		}
-		bool breakReq = false;
-		RunScript(srcType, srcId, scriptText, breakReq);
 	}
 	else
 	{
@@ -1907,6 +1920,11 @@ void TfrmMain::RunScriptFile(int srcType, int srcId, AnsiString filename, bool s
 }
 
 int TfrmMain::RunScript(int srcType, int srcId, AnsiString script, bool &breakRequest)
+{
+	return ExecScript(srcType, srcId, script, "", breakRequest);
+}
+
+int TfrmMain::ExecScript(int srcType, int srcId, AnsiString script, AnsiString filename, bool &breakRequest)
 {
 	ScriptExec scriptExec(
 		static_cast<enum ScriptSource>(srcType), srcId, breakRequest,
@@ -1930,6 +1948,11 @@ int TfrmMain::RunScript(int srcType, int srcId, AnsiString script, bool &breakRe
 		&ProgrammableButtonClick,
 		&UpdateSettingsFromJson
 		);
+	if (filename != "")
+	{
+		// file: compiled chunk is cached by ScriptExec
+		return scriptExec.RunFile(filename);
+	}
 	scriptExec.Run(script.c_str());
 	return 0;
 }
@@ -1960,6 +1983,7 @@ void TfrmMain::UpdateLogConfig(void)
 	log->SetFlush(appSettings.Logging.bFlush);
 	log->SetMaxFileSize(appSettings.Logging.iMaxFileSize);
 	log->SetLogRotateCnt(appSettings.Logging.iLogRotate);
+	log->SetAsync(appSettings.Logging.bAsync);
 }
 
 void TfrmMain::SetSpeedDial(bool visible)
@@ -20,6 +20,7 @@
 
 #include "ButtonType.h"
 #include "Call.h"
+#include "Callback.h"
 #include "common/Observer.h"
 #include <Dialogs.hpp>
 #include <list>
@@ -199,6 +200,9 @@ private:	// User declarations
 	std::string OnGetRxDtmf(void);
 	std::string OnGetUserName(void);
 
+	unsigned int callbackOverflows;
+	void OnCallback(Callback &cb);
+
 	int autoAnswerCode;
 	bool autoAnswerIntercom;
 	bool muteRing;
@@ -239,6 +243,8 @@ private:	// User declarations
 	void ExecAction(const struct Action& action);
 	void RunScriptFile(int srcType, int srcId, AnsiString filename, bool showLog = true);
 	int RunScript(int srcType, int srcId, AnsiString script, bool &breakRequest);
+	/** \brief Run script text or script file (if filename is not empty) */
+	int ExecScript(int srcType, int srcId, AnsiString script, AnsiString filename, bool &breakRequest);
 	bool notificationIconState;
 	void SetNotificationIcon(bool state);
 	void SetKioskMode(bool state);
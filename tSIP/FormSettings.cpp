@@ -254,6 +254,7 @@ void __fastcall TfrmSettings::FormShow(TObject *Sender)
 
 	chbLogToFile->Checked = tmpSettings.Logging.bLogToFile;
 	chbLogFlush->Checked = tmpSettings.Logging.bFlush;
+	chbLogAsync->Checked = tmpSettings.Logging.bAsync;
 	chbLogMessages->Checked = tmpSettings.uaConf.logMessages;
 	cmbMaxUiLogLines->ItemIndex = -1;
 	for (int i=0; i<cmbMaxUiLogLines->Items->Count; i++)
@@ -436,6 +437,7 @@ void __fastcall TfrmSettings::btnApplyClick(TObject *Sender)
 
 	tmpSettings.Logging.bLogToFile = chbLogToFile->Checked;
 	tmpSettings.Logging.bFlush = chbLogFlush->Checked;
+	tmpSettings.Logging.bAsync = chbLogAsync->Checked;
 	tmpSettings.Logging.iMaxFileSize = StrToIntDef(cbLogMaxFileSize->Text, tmpSettings.Logging.iMaxFileSize);
 	if (tmpSettings.Logging.iMaxFileSize < Settings::_Logging::MIN_MAX_FILE_SIZE || tmpSettings.Logging.iMaxFileSize > Settings::_Logging::MIN_MAX_FILE_SIZE)
 	{
@@ -216,6 +216,7 @@ __published:	// IDE-managed Components
 	TCheckBox *chbAudioPreprocessingTxDereverbEnabled;
 	TCheckBox *chbSpeedDialPopupMenu;
 	TCheckBox *chbLogFlush;
+	TCheckBox *chbLogAsync;
 	TLabel *lblLogMaxFileSize;
 	TComboBox *cbLogMaxFileSize;
 	TTabSheet *tsScripts;
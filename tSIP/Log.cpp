@@ -22,6 +22,65 @@
 namespace {
 	FILE *fout = NULL;
 	Mutex mutex;
+
+	/*
+		Asynchronous mode: bounded multi-producer / single-consumer queue
+		with sequence number per slot. Producers claim slot with
+		InterlockedCompareExchange and format text directly into it,
+		writer thread consumes slots in order.
+	*/
+	enum { RING_SIZE = 512 };	// must be power of two
+	enum { RECORD_SIZE = 2048 };	// determines max message length
+	struct Record
+	{
+		volatile LONG seq;
+		int size;
+		char buf[RECORD_SIZE];
+	};
+	Record ring[RING_SIZE];
+	volatile LONG enqueuePos = 0;
+	LONG dequeuePos = 0;
+
+	HANDLE writerThread = NULL;
+	HANDLE writerEvent = NULL;
+	volatile bool writerStop = false;
+	volatile LONG writerIdle = 0;
+	// number of log() calls that saw bAsync set and may still use the ring
+	volatile LONG producers = 0;
+
+	volatile LONG statDropped = 0;
+	volatile LONG statWaits = 0;
+	unsigned int statMaxQueued = 0;
+	unsigned int reportedDropped = 0;
+
+	int FormatLine(char *buf, int bufsize, char *lpData, va_list ap)
+	{
+		/*
+		After looking inside RTL sources it seems that this is thread-safe (when linking
+		with MT version).
+		*/
+		//int size = strftime(buf, sizeof(buf), "%Y-%m-%d %T", localtime(&timebuffer.time));
+	#if 0
+		struct timeb timebuffer;
+		ftime( &timebuffer );
+		int size = strftime(buf, bufsize, "%T", localtime(&timebuffer.time));
+		int res = snprintf(buf+size, bufsize-size, ".%03hu ", timebuffer.millitm);
+		buf[bufsize-1] = '\0';
+		size += res;
+	#else
+		int size = 0;
+	#endif
+
+		if (bufsize-size-2 > 0)
+		{
+			size += vsnprintf(buf + size, bufsize-size-2, lpData, ap);
+		}
+		if (size > bufsize - 2 || size < 0)
+			size = bufsize - 2;
+
+		buf[size] = '\0';
+		return size;
+	}
 }
 
 CLog::CLog()
@@ -30,10 +89,16 @@ CLog::CLog()
 	iLogLevel = 0;
 	bLogToFile = true;
 	bFlush = false;
+	bAsync = false;
 	callbackLog = NULL;
 	maxFileSize = 0;
 };
 
+CLog::~CLog()
+{
+	SetAsync(false);
+}
+
 int CLog::SetFile(std::string file)
 {
 	ScopedLock<Mutex> lock(mutex);
@@ -57,6 +122,7 @@ int CLog::SetFile(std::string file)
 
 void CLog::Close(void)
 {
+	StopWriter();
 	ScopedLock<Mutex> lock(mutex);
 	if (fout)
 		fclose(fout);
@@ -88,81 +154,261 @@ void CLog::SetLevel(int level)
 	iLogLevel = level;
 }
 
-void CLog::log(char *lpData, ...)
+void CLog::SetAsync(bool state)
 {
-	ScopedLock<Mutex> lock(mutex);
-	va_list ap;
-	char buf[2048]; //determines max message length
+	if (state == false)
+	{
+		bAsync = false;
+		StopWriter();
+		return;
+	}
+	if (writerThread)
+	{
+		bAsync = true;
+		return;
+	}
+	for (LONG i=0; i<RING_SIZE; i++)
+	{
+		ring[i].seq = i;
+	}
+	enqueuePos = 0;
+	dequeuePos = 0;
+	writerStop = false;
+	writerIdle = 0;
+	writerEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+	if (writerEvent == NULL)
+		return;
+	DWORD threadId;
+	writerThread = CreateThread(NULL, 0, WriterThreadProc, this, 0, &threadId);
+	if (writerThread == NULL)
+	{
+		CloseHandle(writerEvent);
+		writerEvent = NULL;
+		return;
+	}
+	bAsync = true;
+}
 
-	/*
-	After looking inside RTL sources it seems that this is thread-safe (when linking
-	with MT version).
-	*/
-	//int size = strftime(buf, sizeof(buf), "%Y-%m-%d %T", localtime(&timebuffer.time));
-#if 0
-	struct timeb timebuffer;
-	ftime( &timebuffer );
-	int size = strftime(buf, sizeof(buf), "%T", localtime(&timebuffer.time));
-	int res = snprintf(buf+size, sizeof(buf)-size, ".%03hu ", timebuffer.millitm);
-	buf[sizeof(buf)-1] = '\0';
-	size += res;
-#else
-	int size = 0;
-#endif
+void CLog::GetStats(Stats &stats)
+{
+	stats.dropped = statDropped;
+	stats.waits = statWaits;
+	stats.maxQueued = statMaxQueued;
+}
+
+void CLog::StopWriter(void)
+{
+	if (writerThread == NULL)
+		return;
+	bAsync = false;
+	// interlocked read orders it after the store above; producers that
+	// are still inside Enqueue() are let finish before the last Drain()
+	while (InterlockedExchangeAdd(const_cast<LONG*>(&producers), 0) != 0)
+	{
+		Sleep(1);
+	}
+	writerStop = true;
+	SetEvent(writerEvent);
+	WaitForSingleObject(writerThread, INFINITE);
+	CloseHandle(writerThread);
+	writerThread = NULL;
+	Drain();
+	// no producer can reach SetEvent() anymore
+	CloseHandle(writerEvent);
+	writerEvent = NULL;
+}
+
+unsigned long __stdcall CLog::WriterThreadProc(void *arg)
+{
+	CLog *log = reinterpret_cast<CLog*>(arg);
+	log->WriterThread();
+	return 0;
+}
+
+void CLog::WriterThread(void)
+{
+	for (;;)
+	{
+		InterlockedExchange(const_cast<LONG*>(&writerIdle), 1);
+		WaitForSingleObject(writerEvent, 500);
+		InterlockedExchange(const_cast<LONG*>(&writerIdle), 0);
+		Drain();
+		if (writerStop)
+			break;
+	}
+}
+
+/** Producer side of asynchronous mode
+	\return false if queue is full
+*/
+bool CLog::Enqueue(char *lpData, va_list ap)
+{
+	LONG pos = enqueuePos;
+	Record *rec;
+	bool waited = false;
+	for (;;)
+	{
+		rec = &ring[pos & (RING_SIZE - 1)];
+		LONG dif = rec->seq - pos;
+		if (dif == 0)
+		{
+			if (InterlockedCompareExchange(const_cast<LONG*>(&enqueuePos), pos + 1, pos) == pos)
+				break;
+			pos = enqueuePos;
+		}
+		else if (dif < 0)
+		{
+			// queue full - give writer a chance once before dropping line
+			if (waited)
+			{
+				InterlockedIncrement(const_cast<LONG*>(&statDropped));
+				return false;
+			}
+			waited = true;
+			InterlockedIncrement(const_cast<LONG*>(&statWaits));
+			SetEvent(writerEvent);
+			Sleep(0);
+			pos = enqueuePos;
+		}
+		else
+		{
+			pos = enqueuePos;
+		}
+	}
+
+	rec->size = FormatLine(rec->buf, sizeof(rec->buf), lpData, ap);
+	InterlockedExchange(const_cast<LONG*>(&rec->seq), pos + 1);
 
-	if ((int)sizeof(buf)-size-2 > 0)
+	// wake up writer only if it is sleeping
+	if (writerIdle && InterlockedExchange(const_cast<LONG*>(&writerIdle), 0))
 	{
-		va_start(ap, lpData);
-		size += vsnprintf(buf + size, sizeof(buf)-size-2, lpData, ap);
-		va_end(ap);
+		SetEvent(writerEvent);
 	}
-	if (size > (int)sizeof(buf) - 2)
-		size = sizeof(buf) - 2;
+	return true;
+}
 
-	buf[size] = '\0';
+/** Consumer side of asynchronous mode - write all queued lines in single batch
+*/
+void CLog::Drain(void)
+{
+	ScopedLock<Mutex> lock(mutex);
+	unsigned int queued = enqueuePos - dequeuePos;
+	if (queued > statMaxQueued)
+		statMaxQueued = queued;
+	bool written = false;
+	for (;;)
+	{
+		Record *rec = &ring[dequeuePos & (RING_SIZE - 1)];
+		if (rec->seq - (dequeuePos + 1) < 0)
+			break;
+		Write(rec->buf, rec->size);
+		InterlockedExchange(const_cast<LONG*>(&rec->seq), dequeuePos + RING_SIZE);
+		dequeuePos++;
+		written = true;
+	}
+	unsigned int dropped = statDropped;
+	if (dropped != reportedDropped)
+	{
+		char buf[128];
+		int size = snprintf(buf, sizeof(buf), "Log queue full, %u line(s) dropped\n", dropped - reportedDropped);
+		reportedDropped = dropped;
+		Write(buf, size);
+	}
+	if (written && bLogToFile && fout)
+	{
+		if (bFlush)
+		{
+			fflush(fout);
+		}
+		CheckFileSize();
+	}
+}
 
+void CLog::log(char *lpData, ...)
+{
+	va_list ap;
+	if (bAsync)
+	{
+		// announce before re-checking, so StopWriter() either waits for
+		// this line or this call falls back to synchronous write
+		InterlockedIncrement(const_cast<LONG*>(&producers));
+		if (bAsync)
+		{
+			va_start(ap, lpData);
+			Enqueue(lpData, ap);	// if queue is full line is dropped and counted
+			va_end(ap);
+			InterlockedDecrement(const_cast<LONG*>(&producers));
+			return;
+		}
+		InterlockedDecrement(const_cast<LONG*>(&producers));
+	}
+
+	ScopedLock<Mutex> lock(mutex);
+	char buf[RECORD_SIZE]; //determines max message length
+
+	va_start(ap, lpData);
+	int size = FormatLine(buf, sizeof(buf), lpData, ap);
+	va_end(ap);
+
+	Write(buf, size);
 	if (bLogToFile && fout)
 	{
-		fwrite(buf, size, 1, fout);
 		if (bFlush)
 		{
             fflush(fout);
 		}
-		if (maxFileSize != 0)
+		CheckFileSize();
+	}
+}
+
+/** Write line to file and to callback; mutex must be locked
+*/
+void CLog::Write(char *buf, int size)
+{
+	if (bLogToFile && fout)
+	{
+		fwrite(buf, size, 1, fout);
+	}
+
+	if (callbackLog)
+		callbackLog(buf);
+}
+
+/** Reset/rotate log file if size limit is exceeded; mutex must be locked
+*/
+void CLog::CheckFileSize(void)
+{
+	if (maxFileSize != 0)
+	{
+		int size = ftell(fout);
+		if (size > maxFileSize)
 		{
-			int size = ftell(fout);
-			if (size > maxFileSize)
+			fclose(fout);
+			if (maxLogrotateCnt > 0)
 			{
-				fclose(fout);
-				if (maxLogrotateCnt > 0)
+				/*
+				Renaming (in reverse order, base log file -> file.log.1 as last):
+					file.log   -> file.log.1
+					file.log.1 -> file.log.2
+					file.log.2 -> file.log.3
+					etc.
+				*/
+				for (unsigned int i=maxLogrotateCnt; i>=2; i--)
 				{
-					/*
-					Renaming (in reverse order, base log file -> file.log.1 as last):
-						file.log   -> file.log.1
-						file.log.1 -> file.log.2
-						file.log.2 -> file.log.3
-						etc.
-					*/
-					for (unsigned int i=maxLogrotateCnt; i>=2; i--)
-					{
-						AnsiString fileN, fileNminus1;
-						fileN.sprintf("%s.%u", sFile.c_str(), i);
-						fileNminus1.sprintf("%s.%u", sFile.c_str(), i-1);
-						DeleteFile(fileN);
-						RenameFile(fileNminus1, fileN);
-					}
-					AnsiString file1;
-					file1.sprintf("%s.1", sFile.c_str());
-					DeleteFile(file1);
-					RenameFile(sFile.c_str(), file1);
+					AnsiString fileN, fileNminus1;
+					fileN.sprintf("%s.%u", sFile.c_str(), i);
+					fileNminus1.sprintf("%s.%u", sFile.c_str(), i-1);
+					DeleteFile(fileN);
+					RenameFile(fileNminus1, fileN);
 				}
-				// truncate				
-				fout = fopen(sFile.c_str(),"wt+");								
-            }
-        }
+				AnsiString file1;
+				file1.sprintf("%s.1", sFile.c_str());
+				DeleteFile(file1);
+				RenameFile(sFile.c_str(), file1);
+			}
+			// truncate
+			fout = fopen(sFile.c_str(),"wt+");
+		}
 	}
-
-	if (callbackLog)
-		callbackLog(buf);
 }
 
@@ -5,6 +5,7 @@
 #ifndef LogH
 #define LogH
 #include <string>
+#include <stdarg.h>
 #include "common/singleton.h"
 
 /** \brief Log detail level
@@ -36,6 +37,23 @@ public:
 		\note If limit is decreased, old files exceeding it are not deleted
 	*/
 	void SetLogRotateCnt(unsigned int cnt);
+	/** \brief Enable/disable asynchronous mode
+	 *
+	 *  In asynchronous mode log() only formats text directly into lock-free
+	 *  queue; file writing, flushing, rotation and callbackLog are handled
+	 *  by dedicated writer thread, so caller (e.g. SIP thread) is not blocked
+	 *  by disk I/O.
+	 */
+	void SetAsync(bool state);
+	/** \brief Asynchronous mode statistics
+	*/
+	struct Stats
+	{
+		unsigned int dropped;	///< lines lost because queue was full
+		unsigned int waits;		///< producer found queue full and had to yield
+		unsigned int maxQueued;	///< queue high-water mark seen by writer
+	};
+	void GetStats(Stats &stats);
 	/** \brief Set log detail level / disable logging */
 	void SetLevel(int);
 	/** \brief Close log file */
@@ -53,14 +71,22 @@ public:
 	CallbackLog callbackLog;
 private:
 	CLog();
-	//~CLog() {};
+	~CLog();
 	friend CSingleton<CLog>;
+	static unsigned long __stdcall WriterThreadProc(void *arg);
+	void WriterThread(void);
+	bool Enqueue(char *lpData, va_list ap);
+	void Drain(void);
+	void StopWriter(void);
+	void Write(char *buf, int size);
+	void CheckFileSize(void);
 	std::string sFile;
 	bool bLogToFile;
 	bool bFlush;
 	int iLogLevel;
 	unsigned int maxFileSize;
 	unsigned int maxLogrotateCnt;
+	volatile bool bAsync;
 };
 
 /** \brief Macro to avoid unnecessary typing
@@ -8,6 +8,7 @@
 #include "LuaState.h"
 #include "lua.hpp"
 #include "AudioDevicesList.h"
+#include "UaMain.h"
 #include "common/Mutex.h"
 #include "common/ScopedLock.h"
 #include <Clipbrd.hpp>
@@ -17,6 +18,8 @@
 #include <time.h>
 #include <map>
 #include <deque>
+#include <vector>
+#include <memory>
 
 #pragma link "psapi.lib"
 
@@ -35,6 +38,76 @@ namespace {
 		return it->second;
 	}
 
+	/** \brief Idle Lua states with libraries and tSIP functions already registered
+	*/
+	std::vector<lua_State*> statePool;
+	enum { MAX_POOLED_STATES = 4 };
+
+	/** \brief Script file compiled with lua_dump, reused until file is modified
+	*/
+	struct CompiledChunk
+	{
+		FILETIME lastWrite;
+		DWORD fileSize;
+		unsigned int lastUse;
+		std::string bytecode;
+	};
+	std::map<AnsiString, CompiledChunk> chunkCache;
+	/** \brief Limit for number of cached files, least recently used is dropped */
+	enum { MAX_CACHED_CHUNKS = 32 };
+	unsigned int chunkUseCounter = 0;
+
+	void EvictChunk(void)
+	{
+		std::map<AnsiString, CompiledChunk>::iterator it, oldest = chunkCache.begin();
+		for (it = chunkCache.begin(); it != chunkCache.end(); ++it)
+		{
+			if (it->second.lastUse < oldest->second.lastUse)
+			{
+				oldest = it;
+			}
+		}
+		if (oldest != chunkCache.end())
+		{
+			chunkCache.erase(oldest);
+		}
+	}
+
+	/** \brief Registry key of function restoring library tables of pooled state */
+	const char* const RESTORE_KEY = "tsip.restore";
+
+	/** \brief Takes shallow copy of package.loaded and of every library table
+		in it (including _G with tSIP functions) and returns function
+		that puts back copied fields and removes fields added later
+	*/
+	const char* const restoreChunk =
+		"local next, rawset, type = next, rawset, type\n"
+		"local loaded = ...\n"
+		"local saved = {}\n"
+		"local function snapshot(t)\n"
+		"  local copy = {}\n"
+		"  for k, v in next, t do copy[k] = v end\n"
+		"  saved[t] = copy\n"
+		"end\n"
+		"for _, lib in next, loaded do\n"
+		"  if type(lib) == 'table' and saved[lib] == nil then snapshot(lib) end\n"
+		"end\n"
+		"snapshot(loaded)\n"
+		"return function()\n"
+		"  for t, copy in next, saved do\n"
+		"    for k in next, t do\n"
+		"      if copy[k] == nil then rawset(t, k, nil) end\n"
+		"    end\n"
+		"    for k, v in next, copy do rawset(t, k, v) end\n"
+		"  end\n"
+		"end\n";
+
+	int ChunkWriter(lua_State *L, const void* p, size_t sz, void* ud)
+	{
+		reinterpret_cast<std::string*>(ud)->append(static_cast<const char*>(p), sz);
+		return 0;
+	}
+
 	/** \brief Mutex protecting access to variables */
 	Mutex mutexVariables;
 	/** \brief Named variables - shared by scripts and plugins */
@@ -929,6 +1002,25 @@ int ScriptExec::l_GetAudioDevice(lua_State* L)
 	return 2;
 }
 
+/** \brief Lua: peak, rms = GetAudioLevel(dir) with dir = "in" or "out"
+*/
+int ScriptExec::l_GetAudioLevel(lua_State* L)
+{
+	const char* dir = lua_tostring(L, 1);
+	if (dir == NULL || (strcmp(dir, "in") && strcmp(dir, "out")))
+	{
+		LOG("Lua error: direction for audio level invalid (expecting \"in\" or \"out\")\n");
+		lua_pushinteger(L, 0);
+		lua_pushinteger(L, 0);
+		return 2;
+	}
+	unsigned int peak = 0, rms = 0;
+	Ua::Instance().GetAudioLevel(strcmp(dir, "in") == 0, peak, rms);
+	lua_pushinteger(L, peak);
+	lua_pushinteger(L, rms);
+	return 2;
+}
+
 int ScriptExec::l_UpdateSettings(lua_State* L)
 {
 	const char* json = lua_tostring(L, 1);
@@ -1044,13 +1136,10 @@ ScriptExec::~ScriptExec()
 {
 }
 
-void ScriptExec::Run(const char* script)
+lua_State* ScriptExec::NewState(void)
 {
-	breakReq = false;
-	running = true;
-	Lua_State L;
+	lua_State *L = luaL_newstate();
 	luaL_openlibs(L);
-	contexts[L] = this;
 
 	lua_register(L, "_ALERT", LuaError );
 	lua_register(L, "print", LuaPrint );
@@ -1114,24 +1203,187 @@ void ScriptExec::Run(const char* script)
 	lua_register(L, "ProgrammableButtonClick", l_ProgrammableButtonClick);
 	lua_register(L, "RefreshAudioDevicesList", l_RefreshAudioDevicesList);
 	lua_register(L, "GetAudioDevice", l_GetAudioDevice);
+	lua_register(L, "GetAudioLevel", l_GetAudioLevel);
 	lua_register(L, "UpdateSettings", l_UpdateSettings);
 
 	// add library
 	luaL_requiref(L, "tsip_winapi", luaopen_tsip_winapi, 0);
+	lua_pop(L, 1);
+
+	if (luaL_loadstring(L, restoreChunk) == 0)
+	{
+		lua_getfield(L, LUA_REGISTRYINDEX, LUA_LOADED_TABLE);
+		if (lua_pcall(L, 1, 1, 0) == 0)
+		{
+			lua_setfield(L, LUA_REGISTRYINDEX, RESTORE_KEY);
+		}
+	}
+	lua_settop(L, 0);
+
+	return L;
+}
+
+lua_State* ScriptExec::AcquireState(void)
+{
+	if (statePool.empty())
+	{
+		return NewState();
+	}
+	lua_State *L = statePool.back();
+	statePool.pop_back();
+	return L;
+}
+
+void ScriptExec::ReleaseState(lua_State *L)
+{
+	lua_settop(L, 0);
+	if (statePool.size() < MAX_POOLED_STATES)
+	{
+		/* Script might have modified libraries, package.loaded or tSIP
+		functions - undo it before reusing state. Full collection runs
+		finalizers (e.g. closes files left open by script) as lua_close did.
+		*/
+		if (lua_getfield(L, LUA_REGISTRYINDEX, RESTORE_KEY) == LUA_TFUNCTION &&
+			lua_pcall(L, 0, 0, 0) == 0)
+		{
+			lua_gc(L, LUA_GCCOLLECT, 0);
+			statePool.push_back(L);
+			return;
+		}
+		lua_settop(L, 0);
+	}
+	lua_close(L);
+}
+
+void ScriptExec::Cleanup(void)
+{
+	assert(contexts.empty());
+	for (unsigned int i=0; i<statePool.size(); i++)
+	{
+		lua_close(statePool[i]);
+	}
+	statePool.clear();
+	chunkCache.clear();
+}
 
-	int res = luaL_dostring(L, script);
-	if(res != 0)
+void ScriptExec::Execute(lua_State *L, int status)
+{
+	if (status == 0)
+	{
+		/* Pooled state is reused: give each run its own environment
+		falling back to globals, so that global variables assigned by script
+		do not survive to the next run (as with fresh lua_State).
+		*/
+		lua_newtable(L);	// environment
+		lua_newtable(L);	// metatable
+		lua_rawgeti(L, LUA_REGISTRYINDEX, LUA_RIDX_GLOBALS);
+		lua_setfield(L, -2, "__index");
+		lua_setmetatable(L, -2);
+		lua_pushvalue(L, -1);
+		lua_setfield(L, -2, "_G");
+		if (lua_setupvalue(L, -2, 1) == NULL)	// _ENV of main chunk
+		{
+			lua_pop(L, 1);
+		}
+		status = lua_pcall(L, 0, LUA_MULTRET, 0);
+	}
+	if(status != 0)
 	{
 		AnsiString txt;
 		txt.sprintf("Execution error:\n%s", lua_tostring(L, -1));
 		MessageBox(NULL, txt.c_str(), "Lua", MB_ICONINFORMATION);
 	}
+}
+
+void ScriptExec::Run(const char* script)
+{
+	breakReq = false;
+	running = true;
+	lua_State *L = AcquireState();
+	contexts[L] = this;
+
+	Execute(L, luaL_loadstring(L, script));
+
+	running = false;
+
+	std::map<lua_State*, ScriptExec*>::iterator it;
+	it = contexts.find(L);
+	assert(it != contexts.end());
+	contexts.erase(it);
+	ReleaseState(L);
+}
+
+int ScriptExec::RunFile(AnsiString filename)
+{
+	WIN32_FILE_ATTRIBUTE_DATA attr;
+	if (!GetFileAttributesEx(filename.c_str(), GetFileExInfoStandard, &attr))
+	{
+		return -1;
+	}
+
+	AnsiString scriptText;
+	std::map<AnsiString, CompiledChunk>::iterator chunk = chunkCache.find(filename);
+	bool cached = (chunk != chunkCache.end() &&
+		CompareFileTime(&chunk->second.lastWrite, &attr.ftLastWriteTime) == 0 &&
+		chunk->second.fileSize == attr.nFileSizeLow);
+	if (cached)
+	{
+		chunk->second.lastUse = ++chunkUseCounter;
+	}
+	else
+	{
+		std::auto_ptr<TStrings> strings(new TStringList());
+		try
+		{
+			strings->LoadFromFile(filename);
+			scriptText = strings->Text;
+		}
+		catch(...)
+		{
+			return -1;
+		}
+	}
+
+	breakReq = false;
+	running = true;
+	lua_State *L = AcquireState();
+	contexts[L] = this;
+
+	AnsiString chunkName = "@" + filename;
+	int status;
+	if (cached)
+	{
+		const std::string &bytecode = chunk->second.bytecode;
+		status = luaL_loadbuffer(L, bytecode.data(), bytecode.size(), chunkName.c_str());
+	}
+	else
+	{
+		status = luaL_loadbuffer(L, scriptText.c_str(), scriptText.Length(), chunkName.c_str());
+		if (status == 0)
+		{
+			if (chunkCache.find(filename) == chunkCache.end() &&
+				chunkCache.size() >= MAX_CACHED_CHUNKS)
+			{
+				EvictChunk();
+			}
+			CompiledChunk &entry = chunkCache[filename];
+			entry.lastWrite = attr.ftLastWriteTime;
+			entry.fileSize = attr.nFileSizeLow;
+			entry.lastUse = ++chunkUseCounter;
+			entry.bytecode.clear();
+			lua_dump(L, ChunkWriter, &entry.bytecode, 0);
+		}
+	}
+	Execute(L, status);
+
 	running = false;
 
 	std::map<lua_State*, ScriptExec*>::iterator it;
 	it = contexts.find(L);
 	assert(it != contexts.end());
 	contexts.erase(it);
+	ReleaseState(L);
+	return 0;
 }
 
 void ScriptExec::Break(void)
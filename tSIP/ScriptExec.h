@@ -150,8 +150,18 @@ private:
 	static int l_ProgrammableButtonClick(lua_State* L);
     static int l_RefreshAudioDevicesList(lua_State* L);
 	static int l_GetAudioDevice(lua_State* L);
+	static int l_GetAudioLevel(lua_State* L);
 	static int l_UpdateSettings(lua_State* L);
 
+	static lua_State* NewState(void);
+	/** \brief Get lua_State from pool (or create new one) with tSIP functions registered */
+	static lua_State* AcquireState(void);
+	static void ReleaseState(lua_State *L);
+	/** \brief Run chunk loaded on top of the stack in separate environment
+		\param status result of loading chunk
+	*/
+	void Execute(lua_State *L, int status);
+
 	bool &breakReq;
 	bool running;
 public:
@@ -194,7 +204,15 @@ public:
 		);
 	~ScriptExec();
 	void Run(const char* script);
+	/** \brief Run script file; compiled chunk is cached and reused while file is not modified
+		\return 0 on success, -1 if file could not be read
+	*/
+	int RunFile(AnsiString filename);
 	void Break(void);
+	/** \brief Close pooled Lua states (running their finalizers) and drop cached chunks;
+		to be called at application shutdown, when no script is running
+	*/
+	static void Cleanup(void);
 	bool isRunning(void) {
 		return running;
 	}
@@ -280,6 +280,10 @@ int Settings::UpdateFromJsonValue(const Json::Value &root)
 			if (recStart >= 0 && recStart < UaConf::RecordingCfg::RecStartLimiter) {
 				uaConf.recording.recStart = recStart;
 			}
+			UaConf::RecordingCfg::RecFormat recFormat = static_cast<UaConf::RecordingCfg::RecFormat>(uaConfRecordingJson.get("recFormat", uaConf.recording.recFormat).asInt());
+			if (recFormat >= 0 && recFormat < UaConf::RecordingCfg::RecFormatLimiter) {
+				uaConf.recording.recFormat = recFormat;
+			}
 		}
 		else
 		{
@@ -321,6 +325,8 @@ int Settings::UpdateFromJsonValue(const Json::Value &root)
 			uaConf.avt.portMax = uaAvtJson.get("portMax", uaConf.avt.portMax).asUInt();
 			uaConf.avt.jbufDelayMin = uaAvtJson.get("jbufDelayMin", uaConf.avt.jbufDelayMin).asUInt();
 			uaConf.avt.jbufDelayMax = uaAvtJson.get("jbufDelayMax", uaConf.avt.jbufDelayMax).asUInt();
+			uaConf.avt.jbufAdaptive = uaAvtJson.get("jbufAdaptive", uaConf.avt.jbufAdaptive).asBool();
+			uaConf.avt.rtpRxPull = uaAvtJson.get("rtpRxPull", uaConf.avt.rtpRxPull).asBool();
 			uaConf.avt.rtpTimeout = uaAvtJson.get("rtpTimeout", uaConf.avt.rtpTimeout).asUInt();
 			if (uaConf.avt.Validate())
 			{
@@ -565,6 +571,7 @@ int Settings::UpdateFromJsonValue(const Json::Value &root)
 		const Json::Value &LoggingJson = root["Logging"];
 		Logging.bLogToFile = LoggingJson.get("LogToFile", Logging.bLogToFile).asBool();
 		Logging.bFlush = LoggingJson.get("Flush", Logging.bFlush).asBool();
+		Logging.bAsync = LoggingJson.get("Async", Logging.bAsync).asBool();
 		int iMaxFileSize = LoggingJson.get("MaxFileSize", Logging.iMaxFileSize).asInt();
 		if (iMaxFileSize >= Settings::_Logging::MIN_MAX_FILE_SIZE && Logging.iMaxFileSize <= Settings::_Logging::MIN_MAX_FILE_SIZE)
 		{
@@ -747,6 +754,7 @@ int Settings::Write(AnsiString asFileName)
 
 	root["Logging"]["LogToFile"] = Logging.bLogToFile;
 	root["Logging"]["Flush"] = Logging.bFlush;
+	root["Logging"]["Async"] = Logging.bAsync;
 	root["Logging"]["MaxFileSize"] = Logging.iMaxFileSize;
 	root["Logging"]["LogRotate"] = Logging.iLogRotate;
 	root["Logging"]["MaxUiLogLines"] = Logging.iMaxUiLogLines;
@@ -806,6 +814,7 @@ int Settings::Write(AnsiString asFileName)
 		root["uaConf"]["recording"]["customRecDir"] = uaConf.recording.customRecDir;
 		root["uaConf"]["recording"]["channels"] = uaConf.recording.channels;
 		root["uaConf"]["recording"]["recStart"] = uaConf.recording.recStart;
+		root["uaConf"]["recording"]["recFormat"] = uaConf.recording.recFormat;
 	}
 
 	{
@@ -828,6 +837,8 @@ int Settings::Write(AnsiString asFileName)
 	root["uaConf"]["avt"]["portMax"] = uaConf.avt.portMax;
 	root["uaConf"]["avt"]["jbufDelayMin"] = uaConf.avt.jbufDelayMin;
 	root["uaConf"]["avt"]["jbufDelayMax"] = uaConf.avt.jbufDelayMax;
+	root["uaConf"]["avt"]["jbufAdaptive"] = uaConf.avt.jbufAdaptive;
+	root["uaConf"]["avt"]["rtpRxPull"] = uaConf.avt.rtpRxPull;
 	root["uaConf"]["avt"]["rtpTimeout"] = uaConf.avt.rtpTimeout;
 
 	root["uaConf"]["autoAnswer"] = uaConf.autoAnswer;
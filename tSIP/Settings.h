@@ -129,6 +129,7 @@ public:
 	{
 		bool bLogToFile;
 		bool bFlush;
+		bool bAsync;				///< write log file from separate thread
 		enum {
 			MIN_MAX_FILE_SIZE = 0,
 			MAX_MAX_FILE_SIZE = 1000*1024*1024
@@ -149,6 +150,7 @@ public:
         _Logging(void):
             bLogToFile(false),
             bFlush(false),
+            bAsync(false),
             iMaxFileSize(Settings::_Logging::DEF_MAX_FILE_SIZE),
             iLogRotate(Settings::_Logging::DEF_LOGROTATE),
             iMaxUiLogLines(5000)
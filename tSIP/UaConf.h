@@ -174,18 +174,28 @@ public:
 
 			RecStartLimiter
 		} recStart;
+		enum RecFormat {
+			RecFormatPcm16 = 0,			///< 16-bit linear PCM WAV
+			RecFormatPcmu,				///< G.711 u-law WAV, half of PCM16 size
+			RecFormatPcma,				///< G.711 A-law WAV, half of PCM16 size
+			RecFormatImaAdpcm,			///< IMA ADPCM WAV, quarter of PCM16 size
+
+			RecFormatLimiter
+		} recFormat;
 		RecordingCfg(void):
 			enabled(false),
 			recDir(RecDirRelative),
 			channels(1),
-			recStart(RecStartCallConfirmed)
+			recStart(RecStartCallConfirmed),
+			recFormat(RecFormatPcm16)
 		{}
 		bool operator==(const RecordingCfg& right) const {
 			return enabled == right.enabled &&
 				recDir == right.recDir &&
 				customRecDir == right.customRecDir &&
 				channels == right.channels &&
-				recStart == right.recStart
+				recStart == right.recStart &&
+				recFormat == right.recFormat
 				;
 		}
 		bool operator!=(const RecordingCfg& right) const {
@@ -258,6 +268,8 @@ public:
 		unsigned int portMax;
 		unsigned int jbufDelayMin;
 		unsigned int jbufDelayMax;
+		bool jbufAdaptive;
+		bool rtpRxPull;					///< decode RTP on playout clock instead of on receive
 		unsigned int rtpTimeout;
 		enum { DEF_PORT_MIN = 1024 };
 		enum { DEF_PORT_MAX = 49152 };
@@ -270,6 +282,8 @@ public:
 			portMax(DEF_PORT_MAX),
 			jbufDelayMin(DEF_JBUF_DELAY_MIN),
 			jbufDelayMax(DEF_JBUF_DELAY_MAX),
+			jbufAdaptive(false),
+			rtpRxPull(false),
 			rtpTimeout(DEF_RTP_TIMEOUT)
 		{
 		}
@@ -309,6 +323,8 @@ public:
 				portMax == right.portMax &&
 				jbufDelayMin == right.jbufDelayMin &&
 				jbufDelayMax == right.jbufDelayMax &&
+				jbufAdaptive == right.jbufAdaptive &&
+				rtpRxPull == right.rtpRxPull &&
 				rtpTimeout == right.rtpTimeout
 				)
 			{
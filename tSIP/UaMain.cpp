@@ -360,6 +360,8 @@ static int app_init(void)
 	cfg->avt.rtp_ports.max = appSettings.uaConf.avt.portMax;
 	cfg->avt.jbuf_del.min = appSettings.uaConf.avt.jbufDelayMin;
 	cfg->avt.jbuf_del.max = appSettings.uaConf.avt.jbufDelayMax;
+	cfg->avt.jbtype = appSettings.uaConf.avt.jbufAdaptive ? JBUF_ADAPTIVE : JBUF_FIXED;
+	cfg->avt.rtp_rxpull = appSettings.uaConf.avt.rtpRxPull;
     cfg->avt.rtp_timeout = appSettings.uaConf.avt.rtpTimeout;
 
 	cfg->recording.enabled = appSettings.uaConf.recording.enabled;
@@ -637,27 +639,9 @@ extern "C" int stderr_handler(const char *p, size_t size, void *arg)
 	return 0;
 }
 
-extern "C" void control_handler(void)
+static void control_execute(Command &cmd)
 {
-	if (app.terminating)
-	{
-		return;
-	}
-	else if (appQuit || appRestart)
-	{
-		//if (appQuit)
-		//{
-		//	app.terminating = true;
-		//}
-		quit(0);
-	}
-	
 	int err;
-	Command cmd;
-	if (UA->GetCommand(cmd))
-	{
-    	return;
-	}
 	switch (cmd.type)
 	{
 	case Command::CALL:
@@ -741,7 +725,7 @@ extern "C" void control_handler(void)
 		break;
 	}
 	case Command::RECORD: {
-        recorder_start(cmd.target.c_str(), cmd.channels);
+        recorder_start(cmd.target.c_str(), cmd.channels, static_cast<enum recorder_format>(cmd.recFormat));
 		break;
 	}
 	case Command::PAGING_TX: {
@@ -843,6 +827,31 @@ extern "C" void control_handler(void)
 	}
 }
 
+/** \brief Called by re_main after each poll; executes all queued commands
+	(loop is woken up by ControlQueue through re_wakeup)
+*/
+extern "C" void control_handler(void)
+{
+	if (app.terminating)
+	{
+		return;
+	}
+	else if (appQuit || appRestart)
+	{
+		//if (appQuit)
+		//{
+		//	app.terminating = true;
+		//}
+		quit(0);
+	}
+
+	Command cmd;
+	while (UA->GetCommand(cmd) == 0)
+	{
+		control_execute(cmd);
+	}
+}
+
 static bool app_terminated = false;
 
 __fastcall Worker::Worker(bool CreateSuspended)
@@ -917,6 +926,7 @@ void Ua::Restart(void)
 		paging_tx_hangup(app.paging_txp);
 	}
 	appRestart = true;
+	re_wakeup();
 }
 
 void Ua::Quit(void)
@@ -930,6 +940,7 @@ void Ua::Quit(void)
 		paging_tx_hangup(app.paging_txp);
 	}
 	appQuit = true;
+	re_wakeup();
 	while (!app_terminated)
 	{
 		Sleep(10);
@@ -946,6 +957,11 @@ int Ua::GetAudioCodecList(std::vector<AnsiString> &codecs)
 	codecs = audioCodecs;
 	return 0;
 }
+
+int Ua::GetAudioLevel(bool tx, unsigned int &peak, unsigned int &rms)
+{
+	return softvol_level_get(tx, &peak, &rms);
+}
 
 
 
@@ -24,6 +24,10 @@ public:
 	void Restart(void);
 	void Quit(void);
 	int GetAudioCodecList(std::vector<AnsiString> &codecs);
+	/** \brief Get peak and RMS level (0..32767) of the last audio frame
+		\param tx true for microphone direction, false for speaker
+	*/
+	int GetAudioLevel(bool tx, unsigned int &peak, unsigned int &rms);
 };
 
 #endif
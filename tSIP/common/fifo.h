@@ -1,54 +1,90 @@
 #ifndef FifoH
 #define FifoH
 
+#include <windows.h>
+
+/** \brief Lock-free single producer / single consumer ring buffer
+
+	Read and write positions are free-running counters masked with
+	Size-1, so all Size slots are usable. Producer fills element returned
+	by getWriteable() and publishes it with push(), consumer reads element
+	returned by getReadable() and releases it with pop().
+	Index updates use interlocked exchange (full memory barrier), so element
+	data is visible to the other thread before the index changes.
+	\param Size number of elements, must be power of two
+*/
 template<class T, int Size>
 class Fifo {
 private:
-	volatile int m_Read;
-	volatile int m_Write;
-	volatile T m_Data[Size];
+	typedef char SizeMustBePowerOfTwo[(Size > 0 && (Size & (Size - 1)) == 0) ? 1 : -1];
+	enum { Mask = Size - 1 };
+
+	volatile LONG m_Read;
+	volatile LONG m_Write;
+	volatile LONG m_Overflows;
+	T m_Data[Size];
+
+	static void publish(volatile LONG &pos, LONG value) {
+		InterlockedExchange(const_cast<LONG*>(&pos), value);
+	}
 
 public:
 	Fifo()
 	{
 		m_Read = 0;
 		m_Write = 0;
+		m_Overflows = 0;
 	}
 
+	/** \brief Get element to fill (producer)
+		\return NULL if fifo is full, overflow counter is incremented then
+	*/
 	T* getWriteable(void) {
-		int nextElement = (m_Write + 1) % Size;
-		if(nextElement != m_Read) {
-			return const_cast<T*>(&m_Data[m_Write]);
-		} else {
+		if ((unsigned long)(m_Write - m_Read) >= (unsigned long)Size) {
+			InterlockedIncrement(const_cast<LONG*>(&m_Overflows));
 			return NULL;
-		}		
+		}
+		return &m_Data[m_Write & Mask];
 	}
 
+	/** \brief Publish element previously obtained with getWriteable() (producer)
+	*/
 	bool push(void) {
-		int nextElement = (m_Write + 1) % Size;
-		if(nextElement != m_Read) 
-		{
-			m_Write = nextElement;
-			return true;
-		}
-		else
+		if ((unsigned long)(m_Write - m_Read) >= (unsigned long)Size)
 			return false;
+		publish(m_Write, m_Write + 1);
+		return true;
 	}
 
+	/** \brief Get oldest element (consumer)
+		\return NULL if fifo is empty
+	*/
 	T* getReadable(void) {
-		if(m_Read == m_Write)
+		if (m_Read == m_Write)
 			return NULL;
-		return const_cast<T*>(&m_Data[m_Read]);
+		return &m_Data[m_Read & Mask];
 	}
 
+	/** \brief Release element previously obtained with getReadable() (consumer)
+	*/
 	bool pop(void) {
-		if(m_Read == m_Write)
+		if (m_Read == m_Write)
 			return false;
-		int nextElement = (m_Read + 1) % Size;
-		m_Read = nextElement;
+		publish(m_Read, m_Read + 1);
 		return true;
 	}
+
+	/** \brief Number of elements waiting to be read
+	*/
+	unsigned int count(void) const {
+		return (unsigned int)(m_Write - m_Read);
+	}
+
+	/** \brief Number of elements that were dropped because fifo was full
+	*/
+	unsigned int getOverflowCount(void) const {
+		return (unsigned int)m_Overflows;
+	}
 };
 
 #endif
-